@@ -0,0 +1,233 @@
+#include "asset_cache.hpp"
+#include "mesh_codec.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <vector>
+
+using namespace std;
+
+namespace {
+const char magic[8] = {'S', 'A', 'N', 'D', 'Y', 'A', 'C', '1'};
+// Page-aligned, so each entry can go to the driver straight out of the
+// mapping, and faulting one in never drags in its neighbours.
+const size_t alignment = 4096;
+
+struct PendingEntry {
+    const char *name;
+    const void *data;
+    size_t size;
+    uint32_t width;
+    uint32_t height;
+    uint32_t encoded;
+};
+
+const CachedAssetEntry &find_entry(const AssetCache &cache, const char *name) {
+    for (uint32_t i = 0; i < cache.header->count; ++i) {
+        auto &e = cache.header->entries[i];
+        if (strncmp(e.name, name, sizeof(e.name)) == 0) {
+            return e;
+        }
+    }
+    throw runtime_error(string("Asset cache has no \"") + name + "\"");
+}
+
+string read_file(const string &path) {
+    ifstream file(path, ios::binary);
+    if (!file) {
+        throw runtime_error("Unable to read \"" + path + "\"");
+    }
+    return string(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+}
+}
+
+uint64_t fnv1a(const void *data, size_t size, uint64_t hash) {
+    auto bytes = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+const char *const cached_shaders[4] = {
+        "data/vertex.glsl",
+        "data/frag.glsl",
+        "data/post_vertex.glsl",
+        "data/fxaa_frag.glsl",
+};
+
+void write_asset_cache(const string &path, const SceneAssets &assets, bool compress_meshes) {
+    vector<PendingEntry> pending = {
+            {"mesh", assets.mesh.data.data(), assets.mesh.data.size() * sizeof(GLfloat), unsigned(assets.mesh.num_tris), 0,
+             0},
+            {"flame", assets.flame.data.data(), assets.flame.data.size() * sizeof(GLfloat),
+             unsigned(assets.flame.num_tris), 0, 0},
+            {"meshImage", assets.meshImage.pixels.data(), assets.meshImage.pixels.size(), assets.meshImage.width,
+             assets.meshImage.height, 0},
+            {"flameImage", assets.flameImage.pixels.data(), assets.flameImage.pixels.size(), assets.flameImage.width,
+             assets.flameImage.height, 0},
+            {"ditherMap", assets.ditherMap.texels.data(), assets.ditherMap.texels.size(),
+             unsigned(assets.ditherMap.width), unsigned(assets.ditherMap.height), 0},
+    };
+    // The two meshes replace their raw streams in pending.
+    vector<unsigned char> encoded[2];
+    if (compress_meshes) {
+        encoded[0] = encode_mesh(assets.mesh);
+        encoded[1] = encode_mesh(assets.flame);
+        for (int i = 0; i < 2; ++i) {
+            pending[i].data = encoded[i].data();
+            pending[i].size = encoded[i].size();
+            pending[i].encoded = 1;
+        }
+    }
+    // Reserved, so pending's pointers into it stay put.
+    vector<string> shaders;
+    shaders.reserve(sizeof(cached_shaders) / sizeof(cached_shaders[0]));
+    for (auto path : cached_shaders) {
+        shaders.push_back(read_file(path));
+        pending.push_back({path, shaders.back().data(), shaders.back().size(), 0, 0, 0});
+    }
+
+    AssetCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, magic, sizeof(magic));
+    header.version = asset_cache_version;
+    header.count = pending.size();
+
+    size_t offset = (sizeof(header) + alignment - 1) / alignment * alignment;
+    for (size_t i = 0; i < pending.size(); ++i) {
+        auto &e = header.entries[i];
+        strncpy(e.name, pending[i].name, sizeof(e.name) - 1);
+        e.offset = offset;
+        e.size = pending[i].size;
+        e.hash = fnv1a(pending[i].data, pending[i].size);
+        e.width = pending[i].width;
+        e.height = pending[i].height;
+        e.encoded = pending[i].encoded;
+        offset += (e.size + alignment - 1) / alignment * alignment;
+    }
+
+    // Per process, as several may bake the same path at once.
+    string tmp = path + "." + to_string(getpid()) + ".tmp";
+    {
+        ofstream file(tmp, ios::binary | ios::trunc);
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        for (size_t i = 0; i < pending.size(); ++i) {
+            file.seekp(header.entries[i].offset);
+            file.write(static_cast<const char *>(pending[i].data), pending[i].size);
+        }
+        // Pad the tail so the last entry's alignment slack is inside the file.
+        file.seekp(offset - 1);
+        file.put(0);
+        if (!file) {
+            throw runtime_error("Unable to write \"" + tmp + "\"");
+        }
+    }
+    if (rename(tmp.c_str(), path.c_str()) != 0) {
+        throw runtime_error("Unable to rename \"" + tmp + "\": " + strerror(errno));
+    }
+}
+
+AssetCache map_asset_cache(const string &path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw runtime_error("Unable to open \"" + path + "\": " + strerror(errno));
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(AssetCacheHeader)) {
+        close(fd);
+        throw runtime_error("\"" + path + "\" is not an asset cache");
+    }
+
+    AssetCache rv;
+    rv.size = st.st_size;
+    void *map = mmap(nullptr, rv.size, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping keeps the file alive.
+    close(fd);
+    if (map == MAP_FAILED) {
+        throw runtime_error("Unable to map \"" + path + "\": " + strerror(errno));
+    }
+    rv.base = static_cast<const unsigned char *>(map);
+    rv.header = static_cast<const AssetCacheHeader *>(map);
+
+    auto &h = *rv.header;
+    bool valid = memcmp(h.magic, magic, sizeof(magic)) == 0 && h.version == asset_cache_version &&
+                 h.count <= max_cached_assets;
+    for (uint32_t i = 0; valid && i < h.count; ++i) {
+        valid = h.entries[i].offset + h.entries[i].size <= rv.size;
+    }
+    if (!valid) {
+        unmap_asset_cache(rv);
+        throw runtime_error("\"" + path + "\" is not an asset cache");
+    }
+    return rv;
+}
+
+void verify_asset_cache(const AssetCache &cache) {
+    for (uint32_t i = 0; i < cache.header->count; ++i) {
+        auto &e = cache.header->entries[i];
+        if (fnv1a(cache.base + e.offset, e.size) != e.hash) {
+            throw runtime_error("Asset cache entry \"" + string(e.name, strnlen(e.name, sizeof(e.name))) +
+                                "\" is corrupt");
+        }
+    }
+}
+
+void unmap_asset_cache(AssetCache &cache) {
+    if (cache.base) {
+        munmap(const_cast<unsigned char *>(cache.base), cache.size);
+    }
+    cache = AssetCache{};
+}
+
+MeshView cached_mesh(const AssetCache &cache, const char *name, vector<GLfloat> &storage) {
+    auto &e = find_entry(cache, name);
+    MeshView rv;
+    if (e.encoded) {
+        storage.resize(decoded_mesh_floats(cache.base + e.offset, e.size));
+        decode_mesh(cache.base + e.offset, e.size, storage.data());
+        rv.data = storage.data();
+        rv.floats = storage.size();
+    } else {
+        rv.data = reinterpret_cast<const GLfloat *>(cache.base + e.offset);
+        rv.floats = e.size / sizeof(GLfloat);
+    }
+    rv.num_tris = e.width;
+    return rv;
+}
+
+ImageView cached_image(const AssetCache &cache, const char *name) {
+    auto &e = find_entry(cache, name);
+    ImageView rv;
+    if (e.size > 0) {
+        rv.pixels = cache.base + e.offset;
+        rv.width = e.width;
+        rv.height = e.height;
+    }
+    return rv;
+}
+
+string cached_text(const AssetCache &cache, const char *name) {
+    auto &e = find_entry(cache, name);
+    return string(reinterpret_cast<const char *>(cache.base + e.offset), e.size);
+}
+
+// A copy; the volume is a few hundred bytes.
+DitherVolume cached_dither(const AssetCache &cache, const char *name) {
+    auto &e = find_entry(cache, name);
+    DitherVolume rv;
+    rv.width = e.width;
+    rv.height = e.height;
+    rv.depth = e.width && e.height ? int(e.size / (size_t(e.width) * e.height)) : 0;
+    rv.texels.assign(cache.base + e.offset, cache.base + e.offset + e.size);
+    return rv;
+}
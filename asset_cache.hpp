@@ -0,0 +1,75 @@
+#pragma once
+
+#include "scene.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Everything the GL scene reads from data/, parsed and baked into one flat
+// file: shaders, vertex streams, RGBA8 textures and the dither map. Every
+// process that renders maps it read-only, so the OBJ parse and PNG decode
+// happen once, and startup is one open plus page faults instead of a file
+// per asset. The pages are shared through the page cache instead of being
+// copied per process.
+
+const int max_cached_assets = 16;
+// Bumped whenever the layout or anything baked into it changes.
+const uint32_t asset_cache_version = 4;
+
+// The shader sources packed next to the scene assets, named by path.
+extern const char *const cached_shaders[4];
+
+struct CachedAssetEntry {
+    char name[32];
+    uint64_t offset;
+    uint64_t size;
+    // FNV-1a over the entry's bytes, checked when a view is taken.
+    uint64_t hash;
+    // Image or dither layer size, or the triangle count of a mesh in width.
+    uint32_t width;
+    uint32_t height;
+    // Nonzero for a mesh stored through encode_mesh.
+    uint32_t encoded;
+    uint32_t reserved;
+};
+
+struct AssetCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t count;
+    CachedAssetEntry entries[max_cached_assets];
+};
+
+struct AssetCache {
+    size_t size = 0;
+    const unsigned char *base = nullptr;
+    const AssetCacheHeader *header = nullptr;
+    // An asset store (see asset_store.hpp) that load_program keeps program
+    // binaries in, if any.
+    std::string program_store;
+};
+
+// 64-bit FNV-1a, continuing from hash.
+uint64_t fnv1a(const void *data, size_t size, uint64_t hash = 14695981039346656037ull);
+
+// Writes to a temporary name and renames it, so a reader never maps a
+// half-written cache.
+// compress_meshes trades the zero-copy mesh views for a smaller file; see
+// mesh_codec.hpp.
+void write_asset_cache(const std::string &path, const SceneAssets &assets, bool compress_meshes = false);
+AssetCache map_asset_cache(const std::string &path);
+void unmap_asset_cache(AssetCache &cache);
+
+// Throws if any entry's bytes do not match their hash. It reads the whole
+// file, so it runs when a cache is baked into a store or on request, not
+// on every load.
+void verify_asset_cache(const AssetCache &cache);
+
+// Views into the mapping; throw if the cache has no such entry. A
+// compressed mesh is decoded into storage, which the view then points at.
+MeshView cached_mesh(const AssetCache &cache, const char *name, std::vector<GLfloat> &storage);
+ImageView cached_image(const AssetCache &cache, const char *name);
+std::string cached_text(const AssetCache &cache, const char *name);
+DitherVolume cached_dither(const AssetCache &cache, const char *name);
@@ -0,0 +1,162 @@
+#include "asset_store.hpp"
+#include "asset_cache.hpp"
+#include "file_batch.hpp"
+#include "scene.hpp"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+using namespace std;
+
+namespace {
+void make_directories(const string &path) {
+    for (size_t end = path.find('/', 1);; end = path.find('/', end + 1)) {
+        string dir = path.substr(0, end);
+        if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+            throw runtime_error("Unable to create \"" + dir + "\": " + strerror(errno));
+        }
+        if (end == string::npos) {
+            break;
+        }
+    }
+}
+
+// Hashes every file the scene package is baked from, read in one batch,
+// along with the parameters of the bake.
+uint64_t scene_assets_key(JobSystem &jobs, bool compress_meshes) {
+    vector<string> paths(begin(cached_shaders), end(cached_shaders));
+    const SceneAsset assets[] = {SceneAsset::mesh, SceneAsset::flame, SceneAsset::meshTexture,
+                                 SceneAsset::flameTexture};
+    for (auto asset : assets) {
+        paths.push_back(scene_asset_path(asset));
+    }
+    // Per file, so the reads can land in any order.
+    vector<uint64_t> hashes(paths.size());
+    jobs.wait_all(read_files(jobs, paths, [&](size_t i, string &bytes) {
+        hashes[i] = fnv1a(bytes.data(), bytes.size(), fnv1a(paths[i].data(), paths[i].size()));
+    }));
+
+    uint32_t params[] = {asset_cache_version, compress_meshes};
+    uint64_t rv = fnv1a(params, sizeof(params));
+    return fnv1a(hashes.data(), hashes.size() * sizeof(hashes[0]), rv);
+}
+
+// Whether path holds a pack map_asset_cache takes: header, version and
+// every entry inside the file, so one cut short does not count. Only
+// verify reads the entries themselves, to check their hashes.
+bool valid_pack(const string &path, bool verify) {
+    if (access(path.c_str(), R_OK) != 0) {
+        return false;
+    }
+    AssetCache cache;
+    try {
+        cache = map_asset_cache(path);
+        if (verify) {
+            verify_asset_cache(cache);
+        }
+    } catch (const exception &) {
+        unmap_asset_cache(cache);
+        return false;
+    }
+    unmap_asset_cache(cache);
+    return true;
+}
+}
+
+string asset_store_key(uint64_t hash) {
+    char rv[17];
+    snprintf(rv, sizeof(rv), "%016" PRIx64, hash);
+    return rv;
+}
+
+StoredFile map_stored_file(const string &store, const string &name) {
+    StoredFile rv;
+    string path = store + "/" + name;
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return rv;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (map != MAP_FAILED) {
+            rv.data = static_cast<const unsigned char *>(map);
+            rv.size = st.st_size;
+        }
+    }
+    close(fd);
+    return rv;
+}
+
+void unmap_stored_file(StoredFile &file) {
+    if (file.data) {
+        munmap(const_cast<unsigned char *>(file.data), file.size);
+    }
+    file = StoredFile{};
+}
+
+void write_stored_file(const string &store, const string &name, const void *data, size_t size) {
+    make_directories(store);
+    string path = store + "/" + name;
+    string tmp = path + "." + to_string(getpid()) + ".tmp";
+    FILE *file = fopen(tmp.c_str(), "wb");
+    bool written = file && fwrite(data, 1, size, file) == size;
+    if (file && fclose(file) != 0) {
+        written = false;
+    }
+    if (!written || rename(tmp.c_str(), path.c_str()) != 0) {
+        unlink(tmp.c_str());
+        throw runtime_error("Unable to write \"" + path + "\": " + strerror(errno));
+    }
+}
+
+string store_scene_assets(const string &store, JobSystem &jobs, bool compress_meshes) {
+    make_directories(store);
+    string path = store + "/" + asset_store_key(scene_assets_key(jobs, compress_meshes)) + ".pack";
+    if (valid_pack(path, false)) {
+        return path;
+    }
+
+    // The lock file stays behind; removing it would let a third process
+    // lock a fresh one while the second still holds the old.
+    string lock = path + ".lock";
+    int fd = open(lock.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0 || flock(fd, LOCK_EX) != 0) {
+        string error = strerror(errno);
+        if (fd >= 0) {
+            close(fd);
+        }
+        throw runtime_error("Unable to lock \"" + lock + "\": " + error);
+    }
+    try {
+        // Another process may have baked it, or replaced a bad one, while
+        // this one waited. A pack is checked in full once, here, rather
+        // than on every start.
+        if (!valid_pack(path, true)) {
+            if (access(path.c_str(), F_OK) == 0) {
+                clog << "Warning: \"" << path << "\" is not a valid asset cache, baking it again" << endl;
+            }
+            write_asset_cache(path, parse_scene_assets(jobs), compress_meshes);
+            if (!valid_pack(path, true)) {
+                throw runtime_error("\"" + path + "\" does not read back as it was baked");
+            }
+            clog << "Baked assets into \"" << path << "\"" << endl;
+        }
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+    close(fd);
+    return path;
+}
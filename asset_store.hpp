@@ -0,0 +1,38 @@
+#pragma once
+
+#include "jobs.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// A directory of baked files named by a hash of everything that went into
+// them: source bytes, bake parameters and, for program binaries, the
+// driver. Any number of processes on one host can share a store. Files are
+// written under a per-process name and renamed into place, so a reader
+// either maps a whole file or finds none. A file is only rewritten under
+// its key when it turns out unusable: a scene pack that fails its checks
+// is baked again, and a program binary the driver rejects is replaced by
+// the one linked from source.
+
+// Key as it appears in file names.
+std::string asset_store_key(uint64_t hash);
+
+// Read-only mapping of one stored file.
+struct StoredFile {
+    const unsigned char *data = nullptr;
+    size_t size = 0;
+};
+
+// Empty if the store has no file by that name.
+StoredFile map_stored_file(const std::string &store, const std::string &name);
+void unmap_stored_file(StoredFile &file);
+
+// Creates the store if needed. A concurrent writer of the same name wins or
+// loses the rename as a whole; both wrote the same bytes.
+void write_stored_file(const std::string &store, const std::string &name, const void *data, size_t size);
+
+// Path of the asset cache (see asset_cache.hpp) for the current data/ files
+// in store. Only the first process to ask for a key bakes it; any others
+// asking meanwhile wait on a lock for that bake instead of repeating it.
+std::string store_scene_assets(const std::string &store, JobSystem &jobs, bool compress_meshes);
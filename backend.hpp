@@ -0,0 +1,100 @@
+#pragma once
+
+#include "scene.hpp"
+
+#include <chrono>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+struct AssetCache;
+struct FrameCapture;
+struct GLFWwindow;
+struct Options;
+class JobSystem;
+
+// What the viewer loop needs from a graphics API: draw a frame of the scene
+// into the window and show it. Everything API-specific, from render targets
+// to anti-aliasing, lives behind it.
+class RenderBackend {
+public:
+    virtual ~RenderBackend() = default;
+
+    // Draws params into the window's next image at the framebuffer size.
+    // index and time label the frame for capture.
+    virtual void draw_frame(const SceneParams &params, int width, int height, long long index, double time) = 0;
+    virtual void present() = 0;
+    virtual void set_swap_interval(int interval) = 0;
+
+    // Reads the scene's meshes and textures from data/ again and swaps them
+    // in as they become ready, without holding up frames in between.
+    virtual void reload_assets() = 0;
+
+    // Swaps in whatever reloads have finished, after starting reloads of any
+    // watched assets that changed on disk. True if the scene changed, so an
+    // idle viewer knows to draw it.
+    virtual bool update_assets() = 0;
+
+    // Extra lines for --pacing-stats.
+    virtual void report_stats(std::ostream &out) = 0;
+};
+
+// CPU time a backend spends handing a frame to the driver, averaged per
+// frame for --pacing-stats.
+class SubmitTimer {
+public:
+    void start() {
+        began = std::chrono::steady_clock::now();
+    }
+
+    void stop() {
+        total_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - began).count();
+        ++frames;
+    }
+
+    // Starts the next average.
+    void report(std::ostream &out, const char *api) {
+        if (frames > 0) {
+            out << api << ": " << total_ms / frames << " ms CPU submit per frame" << std::endl;
+        }
+        total_ms = 0;
+        frames = 0;
+    }
+
+private:
+    std::chrono::steady_clock::time_point began;
+    double total_ms = 0;
+    long long frames = 0;
+};
+
+// Renders the scene without a window, for --serve.
+class OffscreenBackend {
+public:
+    virtual ~OffscreenBackend() = default;
+
+    // RGBA8, bottom row first, as glReadPixels would return it.
+    virtual void render(const SceneParams &params, int width, int height, std::vector<unsigned char> &pixels) = 0;
+};
+
+// Needs the window's GL context current and loaded. When capture is given
+// every frame is queued for readback into it. description replaces the
+// built-in scene, which is all cache holds.
+std::unique_ptr<RenderBackend> create_gl_backend(GLFWwindow *window, const Options &options, JobSystem &jobs,
+                                                 const AssetCache *cache, FrameCapture *capture,
+                                                 const SceneDescription *description = nullptr);
+
+// Needs a window created with GLFW_NO_API. Throws when the build has no
+// Vulkan support.
+std::unique_ptr<RenderBackend> create_vulkan_backend(GLFWwindow *window, const Options &options, JobSystem &jobs,
+                                                     const AssetCache *cache);
+std::unique_ptr<OffscreenBackend> create_vulkan_offscreen(const Options &options, JobSystem &jobs,
+                                                          const AssetCache *cache);
+
+// CPU milliseconds per frame spent handing draws draws of the flame to the
+// driver, each with its own uniforms and bindings, without waiting for the
+// GPU, for --bench submit. The GL one needs a current context. The Vulkan
+// one records its command buffer again every frame with rerecord, and
+// otherwise only submits it, as the viewer does; it throws when the build
+// has no Vulkan support.
+double measure_gl_submit(JobSystem &jobs, int draws, int frames);
+double measure_vulkan_submit(JobSystem &jobs, int draws, int frames, bool rerecord);
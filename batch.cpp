@@ -0,0 +1,340 @@
+#include "batch.hpp"
+#include "capture.hpp"
+#include "encode.hpp"
+#include "jobs.hpp"
+#include "offscreen.hpp"
+#include "options.hpp"
+#include "scene.hpp"
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <json/json.h>
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace glm;
+
+namespace {
+// Fields a keyframe leaves out are the built-in scene's, filled in by
+// load_batch_job.
+struct CameraKey {
+    double time = 0;
+    vec3 eye;
+    vec3 target;
+    float fov = 0;
+};
+
+struct LightKey {
+    double time = 0;
+    vec3 position = vec3(5, 3, 1);
+    float radius = 5.f;
+};
+
+struct ModelKey {
+    double time = 0;
+    vec3 position = vec3(0.f);
+    float rotate_y = 0;
+};
+
+struct BatchJob {
+    int width = 512;
+    int height = 512;
+    int fps = 30;
+    int frames = 1;
+    EncoderSettings encoder;
+    vector<CameraKey> camera;
+    vector<LightKey> light;
+    vector<ModelKey> model;
+};
+
+vec3 parse_vec3(const Json::Value &v, vec3 fallback) {
+    if (!v.isArray() || v.size() != 3) {
+        return fallback;
+    }
+    return vec3(v[0].asFloat(), v[1].asFloat(), v[2].asFloat());
+}
+
+ImageFormat parse_format(const string &name) {
+    if (name == "png") {
+        return ImageFormat::png;
+    } else if (name == "qoi") {
+        return ImageFormat::qoi;
+    } else if (name == "y4m") {
+        return ImageFormat::y4m;
+    }
+    throw runtime_error("Unknown format \"" + name + "\"");
+}
+
+template <typename Key>
+void sort_keys(vector<Key> &keys) {
+    stable_sort(begin(keys), end(keys), [](const Key &a, const Key &b) { return a.time < b.time; });
+}
+
+BatchJob load_batch_job(const string &fname, const Options &options) {
+    ifstream file(fname);
+    if (!file) {
+        throw runtime_error("Unable to open \"" + fname + "\"");
+    }
+
+    Json::Value root;
+    Json::CharReaderBuilder builder;
+    string errors;
+    if (!Json::parseFromStream(builder, file, &root, &errors)) {
+        throw runtime_error(fname + ": " + errors);
+    }
+
+    BatchJob rv;
+    rv.width = root.get("width", rv.width).asInt();
+    rv.height = root.get("height", rv.height).asInt();
+    rv.fps = root.get("fps", rv.fps).asInt();
+    if (root.isMember("frames")) {
+        rv.frames = root["frames"].asInt();
+    } else if (root.isMember("duration")) {
+        rv.frames = int(root["duration"].asDouble() * rv.fps + 0.5);
+    }
+    if (rv.width <= 0 || rv.height <= 0 || rv.fps <= 0 || rv.frames <= 0) {
+        throw runtime_error(fname + ": width, height, fps and frames must be positive");
+    }
+
+    rv.encoder.format = root.isMember("format") ? parse_format(root["format"].asString()) : options.capture_format;
+    rv.encoder.output = root.get("output", options.capture_out).asString();
+    rv.encoder.fps = rv.fps;
+    rv.encoder.max_in_flight = options.encode_jobs;
+    rv.encoder.report = false;
+    if (rv.encoder.output.empty()) {
+        throw runtime_error(fname + ": no \"output\" given");
+    }
+
+    SceneDescription description = default_scene_description();
+    CameraKey builtin;
+    builtin.eye = description.eye;
+    builtin.target = description.target;
+    builtin.fov = description.fovy;
+    for (auto &k : root["camera"]) {
+        CameraKey key = builtin;
+        key.time = k.get("time", 0.0).asDouble();
+        key.eye = parse_vec3(k["eye"], key.eye);
+        key.target = parse_vec3(k["target"], key.target);
+        key.fov = k.get("fov", key.fov).asFloat();
+        rv.camera.push_back(key);
+    }
+    for (auto &k : root["light"]) {
+        LightKey key;
+        key.time = k.get("time", 0.0).asDouble();
+        key.position = parse_vec3(k["position"], key.position);
+        key.radius = k.get("radius", key.radius).asFloat();
+        rv.light.push_back(key);
+    }
+    for (auto &k : root["model"]) {
+        ModelKey key;
+        key.time = k.get("time", 0.0).asDouble();
+        key.position = parse_vec3(k["position"], key.position);
+        key.rotate_y = k.get("rotate_y", key.rotate_y).asFloat();
+        rv.model.push_back(key);
+    }
+    sort_keys(rv.camera);
+    sort_keys(rv.light);
+    sort_keys(rv.model);
+    return rv;
+}
+
+// Interpolates between the keyframes around time t with lerp(a, b, f).
+template <typename Key, typename F>
+Key sample(const vector<Key> &keys, double t, F lerp) {
+    if (keys.empty()) {
+        return Key{};
+    }
+    auto next = upper_bound(begin(keys), end(keys), t, [](double t, const Key &k) { return t < k.time; });
+    if (next == begin(keys)) {
+        return keys.front();
+    }
+    if (next == end(keys)) {
+        return keys.back();
+    }
+    auto &a = *(next - 1);
+    auto &b = *next;
+    float f = b.time > a.time ? float((t - a.time) / (b.time - a.time)) : 1.f;
+    return lerp(a, b, f);
+}
+
+SceneParams evaluate(const BatchJob &job, double t) {
+    float aspect = float(job.width) / job.height;
+    SceneParams rv = default_scene_params(aspect);
+
+    if (!job.camera.empty()) {
+        CameraKey cam = sample(job.camera, t, [](const CameraKey &a, const CameraKey &b, float f) {
+            CameraKey rv;
+            rv.eye = mix(a.eye, b.eye, f);
+            rv.target = mix(a.target, b.target, f);
+            rv.fov = mix(a.fov, b.fov, f);
+            return rv;
+        });
+        rv.cam_view = lookAt(cam.eye, cam.target, vec3(0.f, 1.f, 0.f));
+        rv.cam_proj = perspective(radians(cam.fov), aspect, 0.01f, 100.f);
+    }
+
+    if (!job.light.empty()) {
+        LightKey light = sample(job.light, t, [](const LightKey &a, const LightKey &b, float f) {
+            LightKey rv;
+            rv.position = mix(a.position, b.position, f);
+            rv.radius = mix(a.radius, b.radius, f);
+            return rv;
+        });
+        rv.light_pos = light.position;
+        rv.light_radius = light.radius;
+    }
+
+    if (!job.model.empty()) {
+        ModelKey model = sample(job.model, t, [](const ModelKey &a, const ModelKey &b, float f) {
+            ModelKey rv;
+            rv.position = mix(a.position, b.position, f);
+            rv.rotate_y = mix(a.rotate_y, b.rotate_y, f);
+            return rv;
+        });
+        rv.model = rotate(translate(mat4(1.f), model.position), radians(model.rotate_y), vec3(0.f, 1.f, 0.f));
+    }
+
+    return rv;
+}
+
+struct ContextResult {
+    long long frames = 0;
+    double render_seconds = 0;
+    exception_ptr error;
+};
+
+// Renders every stride-th frame starting at first on the calling thread,
+// which must have window's context current.
+void render_frames(const BatchJob &job, int first, int stride, const Options &options, JobSystem &jobs,
+                   FrameEncoder &encoder, shared_ptr<FrameQueue> spare, ContextResult &result) {
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
+    glClearDepth(1.f);
+
+    Scene scene = load_scene(jobs);
+    OffscreenRenderer renderer = create_offscreen_renderer(options.aa, options.msaa_samples);
+    FrameCapture capture = create_frame_capture(options.capture_ring, 4);
+    capture.lossless = true;
+    capture.spare = move(spare);
+
+    thread consumer([frames = capture.frames, &encoder] {
+        CapturedFrame frame;
+        while (frames->pop(frame)) {
+            encoder.encode(move(frame));
+        }
+    });
+
+    auto start = chrono::steady_clock::now();
+    try {
+        for (int i = first; i < job.frames; i += stride) {
+            double t = double(i) / job.fps;
+            render_offscreen(renderer, scene, evaluate(job, t), job.width, job.height);
+            capture_frame(capture, job.width, job.height, i, t);
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+            poll_frame_capture(capture);
+        }
+        finish_frame_capture(capture);
+    } catch (...) {
+        result.error = current_exception();
+        capture.frames->close();
+    }
+    consumer.join();
+    result.render_seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    result.frames = capture.captured;
+
+    destroy_frame_capture(capture);
+    destroy_offscreen_renderer(renderer);
+    destroy_scene(scene);
+    glFinish();
+}
+}
+
+int run_batch(const string &fname, GLFWwindow *window, const Options &options, JobSystem &jobs) {
+    BatchJob job = load_batch_job(fname, options);
+
+    int contexts = max(options.batch_contexts, 1);
+    if (job.encoder.format == ImageFormat::y4m && contexts > 1) {
+        // Frames reach the encoder in completion order, which is only frame
+        // order with a single context.
+        clog << "Warning: y4m output renders on a single context" << endl;
+        contexts = 1;
+    }
+    contexts = min(contexts, job.frames);
+
+    // Windows can only be created on the main thread; they stay hidden, and
+    // each render thread makes its own current.
+    vector<GLFWwindow *> windows = {window};
+    for (int i = 1; i < contexts; ++i) {
+        GLFWwindow *extra = glfwCreateWindow(1, 1, "Shader Sandy", nullptr, nullptr);
+        if (!extra) {
+            clog << "Warning: Only " << i << " render contexts available" << endl;
+            break;
+        }
+        windows.push_back(extra);
+    }
+    contexts = windows.size();
+    glfwMakeContextCurrent(nullptr);
+
+    clog << "Rendering " << job.frames << " frames at " << job.width << "x" << job.height << " on " << contexts
+         << (contexts == 1 ? " context" : " contexts") << endl;
+
+    // Shared by every context, so pixel buffers circulate between them.
+    auto spare = make_shared<FrameQueue>(options.capture_ring * contexts + 8);
+    FrameEncoder encoder(jobs, job.encoder, spare);
+
+    auto start = chrono::steady_clock::now();
+    vector<ContextResult> results(contexts);
+    vector<thread> threads;
+    for (int i = 0; i < contexts; ++i) {
+        threads.emplace_back([&, i] {
+            glfwMakeContextCurrent(windows[i]);
+            try {
+                render_frames(job, i, contexts, options, jobs, encoder, spare, results[i]);
+            } catch (...) {
+                results[i].error = current_exception();
+            }
+            glfwMakeContextCurrent(nullptr);
+        });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+    double render_seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    encoder.finish();
+    double total_seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    for (size_t i = 1; i < windows.size(); ++i) {
+        glfwDestroyWindow(windows[i]);
+    }
+    glfwMakeContextCurrent(window);
+
+    for (auto &r : results) {
+        if (r.error) {
+            rethrow_exception(r.error);
+        }
+    }
+
+    long long rendered = 0;
+    for (int i = 0; i < contexts; ++i) {
+        rendered += results[i].frames;
+        if (contexts > 1) {
+            clog << "Context " << i << ": " << results[i].frames << " frames, "
+                 << results[i].frames / results[i].render_seconds << " fps" << endl;
+        }
+    }
+    clog << "Rendered " << rendered << " frames in " << render_seconds << " s (" << rendered / render_seconds
+         << " fps), encoded " << encoder.frames_written() << " in " << total_seconds << " s ("
+         << encoder.frames_written() / total_seconds << " fps end to end)" << endl;
+
+    return encoder.frames_written() == job.frames ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+
+class JobSystem;
+struct GLFWwindow;
+struct Options;
+
+// Offline rendering of a JSON job file: camera, light and model keyframes
+// sampled at a fixed frame rate, rendered headlessly and encoded. Frames are
+// dealt out round-robin to --batch-contexts GL contexts, each on its own
+// thread, with readback and encoding pipelined behind the draws.
+//
+// {
+//     "width": 512, "height": 512,
+//     "fps": 30, "frames": 90,              // or "duration" in seconds
+//     "output": "turntable", "format": "png",
+//     "camera": [{"time": 0, "eye": [0, 2, 6], "target": [0, 2, 0], "fov": 60}, ...],
+//     "light": [{"time": 0, "position": [5, 3, 1], "radius": 5}, ...],
+//     "model": [{"time": 0, "position": [0, 0, 0], "rotate_y": 0},
+//               {"time": 3, "rotate_y": 360}]
+// }
+//
+// Keyframes are linearly interpolated and held past either end; fields a
+// keyframe leaves out keep the viewer's defaults.
+//
+// window must have a current context; it becomes the first render context.
+int run_batch(const std::string &fname, GLFWwindow *window, const Options &options, JobSystem &jobs);
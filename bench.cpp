@@ -0,0 +1,351 @@
+#include "bench.hpp"
+#include "backend.hpp"
+#include "encode.hpp"
+#include "jobs.hpp"
+#include "mesh_codec.hpp"
+#include "raytrace.hpp"
+#include "scene.hpp"
+#include "swrast.hpp"
+#include "vertex_pipeline.hpp"
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+template <typename F>
+double seconds(F &&fn) {
+    auto start = chrono::steady_clock::now();
+    fn();
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+double busy_work(int i) {
+    double acc = 0;
+    for (int k = 0; k < 64; ++k) {
+        acc += sqrt(double(i + k));
+    }
+    return acc;
+}
+
+void bench_jobs(JobSystem &jobs) {
+    cout << "jobs: " << jobs.num_workers() << " workers" << endl;
+
+    const int num_jobs = 100000;
+
+    {
+        double t = seconds([&] {
+            vector<JobHandle> handles;
+            handles.reserve(num_jobs);
+            for (int i = 0; i < num_jobs; ++i) {
+                handles.push_back(jobs.run([] {}));
+            }
+            jobs.wait_all(handles);
+        });
+        report("jobs/spawn_wait_empty", t * 1e9 / num_jobs, "ns/job");
+    }
+
+    {
+        atomic<int> count{0};
+        double t = seconds([&] {
+            auto root = jobs.run([&] {
+                vector<JobHandle> children;
+                for (int i = 0; i < num_jobs; ++i) {
+                    children.push_back(jobs.run([&] { ++count; }));
+                }
+                jobs.wait_all(children);
+            });
+            jobs.wait(root);
+        });
+        report("jobs/spawn_from_worker", t * 1e9 / num_jobs, "ns/job");
+    }
+
+    {
+        const int chain = 10000;
+        double t = seconds([&] {
+            JobHandle prev = jobs.run([] {});
+            for (int i = 1; i < chain; ++i) {
+                prev = jobs.run([] {}, {prev});
+            }
+            jobs.wait(prev);
+        });
+        report("jobs/dependency_chain", t * 1e9 / chain, "ns/link");
+    }
+
+    {
+        const int fan = 1000;
+        vector<double> out(fan);
+        double t = seconds([&] {
+            for (int round = 0; round < 10; ++round) {
+                vector<JobHandle> leaves;
+                for (int i = 0; i < fan; ++i) {
+                    leaves.push_back(jobs.run([&out, i] { out[i] = busy_work(i); }));
+                }
+                jobs.wait(jobs.run([] {}, leaves));
+            }
+        });
+        report("jobs/fan_in", t * 1e9 / (fan * 10), "ns/leaf");
+    }
+
+    {
+        const int n = 1 << 20;
+        vector<double> out(n);
+        double serial = seconds([&] {
+            for (int i = 0; i < n; ++i) {
+                out[i] = busy_work(i);
+            }
+        });
+        for (int grain : {256, 4096, 65536}) {
+            double t = seconds([&] {
+                jobs.parallel_for(0, n, grain, [&](int lo, int hi) {
+                    for (int i = lo; i < hi; ++i) {
+                        out[i] = busy_work(i);
+                    }
+                });
+            });
+            report("jobs/parallel_for_grain_" + to_string(grain), serial / t, "x serial");
+        }
+    }
+}
+
+void bench_encode(JobSystem &) {
+    // Smooth gradients with a little noise, roughly what a render looks like.
+    CapturedFrame frame;
+    frame.width = 1920;
+    frame.height = 1080;
+    frame.pixels.resize(size_t(frame.width) * frame.height * 4);
+    unsigned noise = 1;
+    for (size_t i = 0; i < frame.pixels.size(); i += 4) {
+        noise = noise * 1103515245 + 12345;
+        int x = i / 4 % frame.width;
+        int y = i / 4 / frame.width;
+        frame.pixels[i] = x * 255 / frame.width;
+        frame.pixels[i + 1] = y * 255 / frame.height;
+        frame.pixels[i + 2] = 128 + (noise >> 28);
+        frame.pixels[i + 3] = 255;
+    }
+    double mb = frame.pixels.size() / 1e6;
+
+    using Encoder = vector<unsigned char> (*)(const CapturedFrame &);
+    const pair<const char *, Encoder> encoders[] = {
+            {"png", encode_png},
+            {"qoi", encode_qoi},
+            {"y4m", encode_y4m_frame},
+    };
+    for (auto &enc : encoders) {
+        const int reps = 3;
+        size_t size = 0;
+        double t = seconds([&] {
+            for (int i = 0; i < reps; ++i) {
+                size = enc.second(frame).size();
+            }
+        });
+        report(string("encode/") + enc.first + "_1080p", mb * reps / t, "MB/s");
+        report(string("encode/") + enc.first + "_ratio", size * 100.0 / frame.pixels.size(), "% of raw");
+    }
+}
+
+void bench_raster(JobSystem &jobs) {
+    SceneAssets assets = parse_scene_assets(jobs);
+    CpuScene scene = make_cpu_scene(assets);
+    cout << "raster: " << jobs.num_workers() + 1 << " threads, "
+         << (assets.mesh.data.size() + assets.flame.data.size()) / 24 << " triangles" << endl;
+
+    const pair<int, int> sizes[] = {{640, 480}, {1280, 720}, {1920, 1080}};
+    for (auto &size : sizes) {
+        SceneParams params = default_scene_params(float(size.first) / size.second);
+        SoftwareRasterizer rasterizer(jobs);
+        vector<unsigned char> pixels;
+        rasterizer.render(scene, params, size.first, size.second, pixels);
+
+        const int reps = 10;
+        double t = seconds([&] {
+            for (int i = 0; i < reps; ++i) {
+                rasterizer.render(scene, params, size.first, size.second, pixels);
+            }
+        });
+        string name = "raster/" + to_string(size.second) + "p";
+        report(name + "_frame", t * 1000 / reps, "ms");
+        report(name + "_mpixels", double(size.first) * size.second * reps / (t * 1e6), "Mpixel/s");
+        report(name + "_binned", rasterizer.triangles_binned() * reps / (t * 1e6), "Mtri/s");
+    }
+}
+
+void bench_trace(JobSystem &jobs) {
+    SceneAssets assets = parse_scene_assets(jobs);
+    CpuScene scene = make_cpu_scene(assets);
+    RayTracer tracer(jobs, scene);
+    unsigned threads = jobs.num_workers() + 1;
+    cout << "trace: " << threads << " threads" << endl;
+
+    const pair<int, int> sizes[] = {{640, 480}, {1280, 720}, {1920, 1080}};
+    for (auto &size : sizes) {
+        SceneParams params = default_scene_params(float(size.first) / size.second);
+        vector<unsigned char> pixels;
+        tracer.render(params, size.first, size.second, pixels);
+
+        const int reps = 5;
+        double t = seconds([&] {
+            for (int i = 0; i < reps; ++i) {
+                tracer.render(params, size.first, size.second, pixels);
+            }
+        });
+        string name = "trace/" + to_string(size.second) + "p";
+        report(name + "_frame", t * 1000 / reps, "ms");
+        report(name + "_rays", tracer.rays_traced() * reps / (t * 1e6), "Mray/s");
+        report(name + "_rays_per_core", tracer.rays_traced() * reps / (t * 1e6) / threads, "Mray/s");
+    }
+}
+
+void bench_vertex(JobSystem &jobs) {
+    ObjData obj = parse_obj("data/kawaii.obj");
+    IndexedMesh mesh = index_mesh(obj);
+    unsigned threads = jobs.num_workers() + 1;
+    cout << "vertex: kawaii.obj, " << mesh.indices.size() << " vertices welded to " << mesh.vertices << ", "
+         << threads << " threads" << endl;
+
+    SceneParams params = default_scene_params();
+    glm::mat4 mvp = params.cam_proj * params.cam_view * params.model;
+    glm::mat4 normal_matrix = glm::transpose(glm::inverse(params.cam_view * params.model));
+    TransformedVertices out;
+    prepare_transformed(out, mesh);
+    report("vertex/post_transform_reuse", double(mesh.indices.size()) / mesh.vertices, "x");
+
+    const int reps = 200;
+    for (bool simd : {false, true}) {
+        if (simd && !has_avx2_transform()) {
+            cout << "vertex: no AVX2 on this CPU" << endl;
+            continue;
+        }
+        string name = simd ? "vertex/avx2" : "vertex/scalar";
+
+        double t = seconds([&] {
+            for (int i = 0; i < reps; ++i) {
+                transform_vertices(mesh, mvp, normal_matrix, out, 0, mesh.vertices, simd);
+            }
+        });
+        report(name + "_per_core", double(mesh.vertices) * reps / (t * 1e6), "Mvert/s");
+
+        t = seconds([&] {
+            for (int i = 0; i < reps; ++i) {
+                jobs.parallel_for(0, int(mesh.vertices), 4096, [&](int lo, int hi) {
+                    transform_vertices(mesh, mvp, normal_matrix, out, lo, hi, simd);
+                });
+            }
+        });
+        report(name + "_parallel", double(mesh.vertices) * reps / (t * 1e6), "Mvert/s");
+        report(name + "_parallel_per_core", double(mesh.vertices) * reps / (t * 1e6) / threads, "Mvert/s");
+    }
+}
+
+void bench_mesh(JobSystem &) {
+    ObjData obj = parse_obj("data/kawaii.obj");
+    size_t rawBytes = obj.data.size() * sizeof(GLfloat);
+    cout << "mesh: kawaii.obj, " << rawBytes << " bytes unindexed" << endl;
+
+    vector<unsigned char> encoded;
+    const int reps = 20;
+    double t = seconds([&] {
+        for (int i = 0; i < reps; ++i) {
+            encoded = encode_mesh(obj);
+        }
+    });
+    report("mesh/encoded_size", encoded.size() / 1024.0, "KiB");
+    report("mesh/ratio", double(rawBytes) / encoded.size(), "x");
+    report("mesh/encode", rawBytes * reps / (t * 1e6), "MB/s");
+
+    vector<GLfloat> decoded(decoded_mesh_floats(encoded.data(), encoded.size()));
+    t = seconds([&] {
+        for (int i = 0; i < reps * 10; ++i) {
+            decode_mesh(encoded.data(), encoded.size(), decoded.data());
+        }
+    });
+    // Throughput of what comes out, the figure that matters at load time.
+    report("mesh/decode", rawBytes * reps * 10 / (t * 1e9), "GB/s");
+    if (decoded != obj.data) {
+        throw runtime_error("mesh: decoded mesh differs from the original");
+    }
+}
+
+// The scene's flame drawn more and more times a frame: how CPU submit cost
+// grows with draw count in GL, and in Vulkan both recording every frame and
+// replaying a recorded command buffer. Makes its own hidden window for GL.
+void bench_submit(JobSystem &jobs) {
+    if (!glfwInit()) {
+        throw runtime_error("submit: Unable to initialise GLFW");
+    }
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    GLFWwindow *window = glfwCreateWindow(64, 64, "Shader Sandy", nullptr, nullptr);
+    if (!window) {
+        throw runtime_error("submit: Unable to create a GL context");
+    }
+    glfwMakeContextCurrent(window);
+    if (!gladLoadGL()) {
+        throw runtime_error("submit: Unable to load GL");
+    }
+
+    bool vulkan = true;
+    const int counts[] = {2, 16, 128, 1024, 8192};
+    for (int draws : counts) {
+        int frames = max(20, 20000 / draws);
+        string name = "submit/" + to_string(draws) + "_draws_";
+        report(name + "gl", measure_gl_submit(jobs, draws, frames), "ms/frame");
+        if (!vulkan) {
+            continue;
+        }
+        try {
+            report(name + "vulkan_record", measure_vulkan_submit(jobs, draws, frames, true), "ms/frame");
+            report(name + "vulkan_replay", measure_vulkan_submit(jobs, draws, frames, false), "ms/frame");
+        } catch (const runtime_error &e) {
+            cout << "submit: no Vulkan results, " << e.what() << endl;
+            vulkan = false;
+        }
+    }
+
+    glfwDestroyWindow(window);
+    glfwTerminate();
+}
+
+const map<string, function<void(JobSystem &)>> &suites() {
+    static const map<string, function<void(JobSystem &)>> rv = {
+            {"encode", bench_encode},
+            {"jobs", bench_jobs},
+            {"mesh", bench_mesh},
+            {"raster", bench_raster},
+            {"submit", bench_submit},
+            {"trace", bench_trace},
+            {"vertex", bench_vertex},
+    };
+    return rv;
+}
+}
+
+void report(const string &name, double value, const string &unit) {
+    cout << left << setw(36) << name << right << setw(14) << fixed << setprecision(2) << value << " " << unit
+         << endl;
+}
+
+void run_benchmarks(const vector<string> &names, JobSystem &jobs) {
+    for (auto &name : names) {
+        auto it = suites().find(name);
+        if (it == suites().end()) {
+            throw runtime_error("Unknown benchmark suite \"" + name + "\"");
+        }
+        it->second(jobs);
+    }
+}
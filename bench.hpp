@@ -0,0 +1,13 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+class JobSystem;
+
+// Prints one result line on stdout, "name value unit", in columns. Every
+// measurement meant to be collected by scripts goes through here.
+void report(const std::string &name, double value, const std::string &unit);
+
+// Runs each named microbenchmark suite, printing one result per line.
+void run_benchmarks(const std::vector<std::string> &suites, JobSystem &jobs);
@@ -0,0 +1,213 @@
+#include "capture.hpp"
+#include "glext.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+namespace {
+// GL_AMD_pinned_memory
+const GLenum external_virtual_memory_buffer = 0x9160;
+
+bool signalled(GLsync fence) {
+    GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    return status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+}
+
+void hand_to_ring(FrameCapture &capture, CaptureSlot &slot) {
+    auto &ring = *capture.shared;
+    bool ok = true;
+
+    if (!capture.pinned) {
+        uint32_t seq = ring.header->write_seq.load();
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+        auto data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, slot.size, GL_MAP_READ_BIT);
+        if (data) {
+            memcpy(shared_slot_pixels(ring, seq), data, slot.size);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        ok = data != nullptr;
+    }
+
+    glDeleteSync(slot.fence);
+    slot.fence = nullptr;
+
+    if (ok) {
+        SharedFrameSlot meta;
+        meta.width = slot.width;
+        meta.height = slot.height;
+        meta.size = slot.size;
+        meta.index = slot.index;
+        meta.time = slot.time;
+        publish_shared_frame(ring, meta);
+        ++capture.captured;
+    } else {
+        ++capture.dropped;
+    }
+}
+
+void hand_over(FrameCapture &capture, CaptureSlot &slot, bool block) {
+    if (capture.shared) {
+        hand_to_ring(capture, slot);
+        return;
+    }
+
+    CapturedFrame frame;
+    capture.spare->try_pop(frame);
+    frame.width = slot.width;
+    frame.height = slot.height;
+    frame.index = slot.index;
+    frame.time = slot.time;
+    frame.pixels.resize(slot.size);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+    auto data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, slot.size, GL_MAP_READ_BIT);
+    if (data) {
+        memcpy(frame.pixels.data(), data, slot.size);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    glDeleteSync(slot.fence);
+    slot.fence = nullptr;
+
+    bool queued = data && (block ? capture.frames->push(frame) : capture.frames->try_push(frame));
+    if (queued) {
+        ++capture.captured;
+    } else {
+        ++capture.dropped;
+        capture.spare->try_push(frame);
+    }
+}
+
+void retire_oldest(FrameCapture &capture, bool block) {
+    hand_over(capture, capture.slots[capture.oldest], block);
+    capture.oldest = (capture.oldest + 1) % capture.slots.size();
+    --capture.pending;
+}
+
+void wait_and_retire_oldest(FrameCapture &capture) {
+    auto fence = capture.slots[capture.oldest].fence;
+    while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 100000000) == GL_TIMEOUT_EXPIRED) {
+    }
+    retire_oldest(capture, true);
+}
+}
+
+FrameCapture create_frame_capture(int ring_size, int queue_size) {
+    FrameCapture rv;
+    rv.slots.resize(max(ring_size, 1));
+    for (auto &slot : rv.slots) {
+        glGenBuffers(1, &slot.pbo);
+    }
+    rv.frames = make_shared<FrameQueue>(max(queue_size, 1));
+    rv.spare = make_shared<FrameQueue>(max(queue_size, 1) + rv.slots.size());
+    return rv;
+}
+
+FrameCapture create_shared_frame_capture(SharedFrameRing &ring) {
+    FrameCapture rv;
+    rv.shared = &ring;
+    rv.slots.resize(ring.header->slot_count);
+    for (auto &slot : rv.slots) {
+        glGenBuffers(1, &slot.pbo);
+    }
+
+    // Slot i's PBO is pinned to ring slot i, which works because frames are
+    // published in capture order: oldest always equals write_seq % slot_count.
+    if (has_gl_extension("GL_AMD_pinned_memory")) {
+        while (glGetError() != GL_NO_ERROR) {
+        }
+        size_t capacity = ring.header->slot_capacity;
+        for (size_t i = 0; i < rv.slots.size(); ++i) {
+            glBindBuffer(external_virtual_memory_buffer, rv.slots[i].pbo);
+            glBufferData(external_virtual_memory_buffer, capacity, shared_slot_pixels(ring, i), GL_STREAM_READ);
+        }
+        glBindBuffer(external_virtual_memory_buffer, 0);
+        rv.pinned = glGetError() == GL_NO_ERROR;
+
+        if (!rv.pinned) {
+            // Start over with ordinary buffers.
+            for (auto &slot : rv.slots) {
+                glDeleteBuffers(1, &slot.pbo);
+                glGenBuffers(1, &slot.pbo);
+            }
+        }
+    }
+
+    clog << "Sharing frames through " << (rv.pinned ? "pinned" : "mapped") << " pixel buffers" << endl;
+    return rv;
+}
+
+void destroy_frame_capture(FrameCapture &capture) {
+    for (auto &slot : capture.slots) {
+        if (slot.fence) {
+            glDeleteSync(slot.fence);
+        }
+        glDeleteBuffers(1, &slot.pbo);
+    }
+    if (capture.frames) {
+        capture.frames->close();
+    }
+    capture = FrameCapture{};
+}
+
+void capture_frame(FrameCapture &capture, int width, int height, long long index, double time) {
+    int n = capture.slots.size();
+    if (capture.pending == n && capture.lossless) {
+        wait_and_retire_oldest(capture);
+    } else if (capture.pending == n) {
+        ++capture.dropped;
+        return;
+    }
+
+    auto &slot = capture.slots[(capture.oldest + capture.pending) % n];
+    size_t size = size_t(width) * height * 4;
+
+    if (capture.shared) {
+        auto &ring = *capture.shared;
+        uint32_t seq = ring.header->write_seq.load() + capture.pending;
+        if (!shared_slot_free(ring, seq) || size > ring.header->slot_capacity) {
+            ++capture.dropped;
+            return;
+        }
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+    if (capture.pinned) {
+        slot.size = size;
+    } else if (slot.size != size) {
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+        slot.size = size;
+    }
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.width = width;
+    slot.height = height;
+    slot.index = index;
+    slot.time = time;
+    ++capture.pending;
+}
+
+void poll_frame_capture(FrameCapture &capture) {
+    while (capture.pending > 0 && signalled(capture.slots[capture.oldest].fence)) {
+        retire_oldest(capture, capture.lossless);
+    }
+}
+
+void finish_frame_capture(FrameCapture &capture) {
+    while (capture.pending > 0) {
+        wait_and_retire_oldest(capture);
+    }
+    if (capture.shared) {
+        close_shared_frames(*capture.shared);
+    } else {
+        capture.frames->close();
+    }
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "queue.hpp"
+#include "shm_ring.hpp"
+
+#include <glad/glad.h>
+
+#include <memory>
+#include <vector>
+
+struct CapturedFrame {
+    int width = 0;
+    int height = 0;
+    long long index = 0;
+    double time = 0;
+    // RGBA8, bottom row first, as glReadPixels returns it.
+    std::vector<unsigned char> pixels;
+};
+
+using FrameQueue = BoundedQueue<CapturedFrame>;
+
+struct CaptureSlot {
+    GLuint pbo = 0;
+    GLsync fence = nullptr;
+    size_t size = 0;
+    int width = 0;
+    int height = 0;
+    long long index = 0;
+    double time = 0;
+};
+
+// Asynchronous readback through a ring of pixel pack buffers. Each capture
+// only queues a glReadPixels into a PBO and a fence; the copy out happens a
+// few frames later, once the fence has signalled, so the render thread never
+// waits for the GPU. A frame is dropped rather than stalling when every slot
+// is still in flight or the consumer is too far behind.
+struct FrameCapture {
+    std::vector<CaptureSlot> slots;
+    int oldest = 0;
+    int pending = 0;
+
+    // Filled frames for the consumer.
+    std::shared_ptr<FrameQueue> frames;
+    // Consumed frames handed back so their pixel storage is reused.
+    std::shared_ptr<FrameQueue> spare;
+
+    // Set instead of frames when publishing into another process's ring.
+    SharedFrameRing *shared = nullptr;
+    // PBOs are backed by the shared pages themselves (GL_AMD_pinned_memory).
+    bool pinned = false;
+    // Wait for readbacks and queue space instead of dropping, for offline
+    // rendering where every frame counts.
+    bool lossless = false;
+
+    long long captured = 0;
+    long long dropped = 0;
+};
+
+FrameCapture create_frame_capture(int ring_size, int queue_size);
+
+// Captures straight into the slots of a shared frame ring, one PBO per slot.
+// Where the driver can pin client memory, the readback DMA lands in the
+// shared pages directly; otherwise the PBO is mapped and copied into the
+// slot, still without any intermediate buffer.
+FrameCapture create_shared_frame_capture(SharedFrameRing &ring);
+void destroy_frame_capture(FrameCapture &capture);
+
+// Queues a read of the (0, 0, width, height) region of the current read
+// framebuffer.
+void capture_frame(FrameCapture &capture, int width, int height, long long index, double time);
+
+// Hands every finished readback to the consumer queue without blocking.
+void poll_frame_capture(FrameCapture &capture);
+
+// Waits for every readback in flight and hands it over, then closes the
+// consumer queue or shared ring.
+void finish_frame_capture(FrameCapture &capture);
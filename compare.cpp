@@ -0,0 +1,85 @@
+#include "compare.hpp"
+#include "bench.hpp"
+#include "jobs.hpp"
+#include "offscreen.hpp"
+#include "options.hpp"
+#include "raytrace.hpp"
+#include "scene.hpp"
+#include "swrast.hpp"
+
+#include <glad/glad.h>
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+// Out of 255.
+const int channel_tolerance = 16;
+
+double percent_differing(const vector<unsigned char> &reference, const vector<unsigned char> &pixels) {
+    size_t count = reference.size() / 4;
+    size_t differing = 0;
+    for (size_t i = 0; i < count; ++i) {
+        for (int c = 0; c < 4; ++c) {
+            if (abs(int(reference[i * 4 + c]) - int(pixels[i * 4 + c])) > channel_tolerance) {
+                ++differing;
+                break;
+            }
+        }
+    }
+    return count > 0 ? differing * 100.0 / count : 0;
+}
+
+struct Comparison {
+    const char *name;
+    const vector<unsigned char> &pixels;
+    const vector<unsigned char> &reference;
+};
+}
+
+int run_render_comparison(const Options &options, JobSystem &jobs) {
+    int width, height;
+    parse_size(options.compare, width, height);
+    SceneParams params = default_scene_params(float(width) / height);
+
+    vector<unsigned char> gl;
+    {
+        glEnable(GL_DEPTH_TEST);
+        glDepthFunc(GL_LESS);
+        glClearDepth(1.f);
+        Scene scene = load_scene(jobs);
+        OffscreenRenderer renderer = create_offscreen_renderer(AntiAliasing::none, 0);
+        render_offscreen(renderer, scene, params, width, height, gl);
+        destroy_offscreen_renderer(renderer);
+        destroy_scene(scene);
+    }
+
+    SceneAssets assets = parse_scene_assets(jobs);
+    CpuScene scene = make_cpu_scene(assets);
+    vector<unsigned char> cpu;
+    SoftwareRasterizer(jobs).render(scene, params, width, height, cpu);
+    vector<unsigned char> trace;
+    RayTracer(jobs, scene).render(params, width, height, trace);
+
+    // The last pair needs no GPU, for machines that can't run the others.
+    const Comparison comparisons[] = {
+            {"cpu_vs_gl", cpu, gl},
+            {"trace_vs_gl", trace, gl},
+            {"cpu_vs_trace", cpu, trace},
+    };
+    bool ok = true;
+    for (auto &c : comparisons) {
+        double differing = percent_differing(c.reference, c.pixels);
+        report(string("compare/") + c.name, differing, "% of pixels");
+        if (differing > options.compare_max) {
+            clog << "Error: " << c.name << ": " << differing << "% of pixels differ, more than "
+                 << options.compare_max << "%" << endl;
+            ok = false;
+        }
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+class JobSystem;
+struct Options;
+
+// Image regression check for the CPU renderers: renders the built-in scene
+// at --compare WxH with GL, the software rasterizer and the ray tracer from
+// the same parameters and reports, per pair, the percentage of pixels that
+// differ. A pixel differs when any channel is off by more than a few
+// levels, so filtering and rounding pass but a wrong dither level or a
+// missing triangle does not. Fails if any pair exceeds --compare-max.
+//
+// Needs a current GL context; anti-aliasing is off on every side.
+int run_render_comparison(const Options &options, JobSystem &jobs);
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "scene.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+
+// data/frag.glsl on the CPU, for the software backends. Sampling follows the
+// GL state the scene sets up: GL_LINEAR everywhere, the mesh textures wrap
+// with GL_REPEAT, the dither volume wraps in x and y and clamps in depth.
+
+inline int wrap(int i, int n) {
+    i %= n;
+    return i < 0 ? i + n : i;
+}
+
+inline glm::vec4 texel(const ImageView &image, int x, int y) {
+    const unsigned char *p = image.pixels + (size_t(wrap(y, image.height)) * image.width + wrap(x, image.width)) * 4;
+    return glm::vec4(p[0], p[1], p[2], p[3]) * (1.f / 255.f);
+}
+
+inline glm::vec4 sample_texture(const ImageView &image, glm::vec2 uv) {
+    if (!image.pixels) {
+        // What GL returns for an incomplete texture.
+        return glm::vec4(0.f, 0.f, 0.f, 1.f);
+    }
+    float x = uv.x * image.width - 0.5f;
+    float y = uv.y * image.height - 0.5f;
+    float x0 = std::floor(x);
+    float y0 = std::floor(y);
+    float fx = x - x0;
+    float fy = y - y0;
+    int ix = int(x0);
+    int iy = int(y0);
+    glm::vec4 top = glm::mix(texel(image, ix, iy), texel(image, ix + 1, iy), fx);
+    glm::vec4 bottom = glm::mix(texel(image, ix, iy + 1), texel(image, ix + 1, iy + 1), fx);
+    return glm::mix(top, bottom, fy);
+}
+
+// x and y in texels (gl_FragCoord units), r in [0, 1] across the layers.
+inline float sample_dither(const DitherVolume &dither, float x, float y, float r) {
+    auto at = [&](int ix, int iy, int iz) {
+        return dither.texels[(size_t(iz) * dither.height + wrap(iy, dither.height)) * dither.width +
+                             wrap(ix, dither.width)];
+    };
+    float fx = x - 0.5f;
+    float fy = y - 0.5f;
+    float fz = glm::clamp(r * dither.depth - 0.5f, 0.f, float(dither.depth - 1));
+    int ix = int(std::floor(fx));
+    int iy = int(std::floor(fy));
+    int iz = int(fz);
+    int iz1 = iz + 1 < dither.depth ? iz + 1 : iz;
+    fx -= ix;
+    fy -= iy;
+    fz -= iz;
+
+    float rv = 0;
+    for (int layer = 0; layer < 2; ++layer) {
+        int z = layer == 0 ? iz : iz1;
+        float top = at(ix, iy, z) + (at(ix + 1, iy, z) - at(ix, iy, z)) * fx;
+        float bottom = at(ix, iy + 1, z) + (at(ix + 1, iy + 1, z) - at(ix, iy + 1, z)) * fx;
+        rv += (top + (bottom - top) * fy) * (layer == 0 ? 1.f - fz : fz);
+    }
+    return rv * (1.f / 255.f);
+}
+
+// One fragment of data/frag.glsl. frag_coord is gl_FragCoord.xy plus
+// FragCoordOffset.
+inline glm::vec4 shade_fragment(const ImageView &texture, const DitherVolume &dither, glm::vec2 uv,
+                                glm::vec3 normal, glm::vec3 light_pos, glm::vec2 frag_coord) {
+    const float fullBright = 0.8f;
+    const float lowBright = 0.2f;
+    float shade = glm::clamp((glm::dot(glm::normalize(normal), glm::normalize(light_pos)) - lowBright) /
+                             (fullBright - lowBright), 0.f, 1.f);
+    if (shade > 0.f && shade < 1.f) {
+        float d = sample_dither(dither, frag_coord.x, frag_coord.y, 1.f - shade);
+        shade = 0.2f + 0.8f * d * d;
+    } else {
+        shade = glm::clamp(shade, 0.2f, 1.f);
+    }
+    return sample_texture(texture, uv) * shade;
+}
+
+// An RGBA8 framebuffer write, with GL's clamp and rounding.
+inline void store_color(unsigned char *p, glm::vec4 color) {
+    color = glm::clamp(color, 0.f, 1.f);
+    p[0] = (unsigned char)(color.x * 255.f + 0.5f);
+    p[1] = (unsigned char)(color.y * 255.f + 0.5f);
+    p[2] = (unsigned char)(color.z * 255.f + 0.5f);
+    p[3] = (unsigned char)(color.w * 255.f + 0.5f);
+}
+
+// draw_scene's glClearColor(1, 0, 1, 1).
+inline void store_clear_color(unsigned char *p) {
+    p[0] = 255;
+    p[1] = 0;
+    p[2] = 255;
+    p[3] = 255;
+}
@@ -7,11 +7,15 @@ in vec3 Position;
 uniform sampler2D Texture;
 uniform sampler3D DitherMap;
 
-uniform vec3 LightPos;
-uniform float LightRadius;
-
-uniform float ScreenWidth;
-uniform float ScreenHeight;
+layout(std140) uniform DrawUniforms {
+    mat4 camProj;
+    mat4 camView;
+    mat4 modelPos;
+    vec3 LightPos;
+    float LightRadius;
+    vec2 FragCoordOffset;
+    vec2 DitherSize;
+};
 
 out vec4 FragColor;
 
@@ -27,7 +31,7 @@ void main() {
         shade = 0.2;
     } else {
         float ditherStrength = 1.0-(shade-lowBright)/(fullBright-lowBright);
-        vec4 dither = texture(DitherMap, vec3(gl_FragCoord.x/ScreenWidth,gl_FragCoord.y/ScreenHeight,ditherStrength));
+        vec4 dither = texture(DitherMap, vec3(gl_FragCoord.x/DitherSize.x,gl_FragCoord.y/DitherSize.y,ditherStrength));
         if (dither.r > 0.5) {
             shade = 1.0;
         } else {
@@ -40,7 +44,8 @@ void main() {
     float lowBright = 0.2;
     float shade = clamp((dot(normalize(Normal), normalize(LightPos))-lowBright)/(fullBright-lowBright),0.0,1.0);
     if (shade > 0.0 && shade < 1.0) {
-        shade = mix(0.2,1.0,pow(texture(DitherMap, vec3(gl_FragCoord.x/ScreenWidth, gl_FragCoord.y/ScreenHeight, 1.0-shade)).r,2.0));
+        vec2 fragCoord = gl_FragCoord.xy + FragCoordOffset;
+        shade = mix(0.2,1.0,pow(texture(DitherMap, vec3(fragCoord.x/DitherSize.x, fragCoord.y/DitherSize.y, 1.0-shade)).r,2.0));
     } else {
         shade = clamp(shade, 0.2, 1.0);
     }
@@ -0,0 +1,46 @@
+#version 330
+
+in vec2 TexCoord;
+
+uniform sampler2D Source;
+// 1 / size of the Source texture.
+uniform vec2 SourceTexel;
+// Rendered corner of Source, in texture coordinates.
+uniform vec2 SourceExtent;
+
+out vec4 FragColor;
+
+const float ReduceMin = 1.0 / 128.0;
+const float ReduceMul = 1.0 / 8.0;
+const float SpanMax = 8.0;
+
+// Keep taps inside the rendered corner; the rest of Source is stale.
+vec3 tap(vec2 uv) {
+    return texture(Source, clamp(uv, SourceTexel * 0.5, SourceExtent - SourceTexel * 0.5)).rgb;
+}
+
+void main() {
+    vec2 uv = TexCoord * SourceExtent;
+    vec3 luma = vec3(0.299, 0.587, 0.114);
+
+    vec3 rgbM = tap(uv);
+    float lumaNW = dot(tap(uv + vec2(-1.0, -1.0) * SourceTexel), luma);
+    float lumaNE = dot(tap(uv + vec2(1.0, -1.0) * SourceTexel), luma);
+    float lumaSW = dot(tap(uv + vec2(-1.0, 1.0) * SourceTexel), luma);
+    float lumaSE = dot(tap(uv + vec2(1.0, 1.0) * SourceTexel), luma);
+    float lumaM = dot(rgbM, luma);
+
+    float lumaMin = min(lumaM, min(min(lumaNW, lumaNE), min(lumaSW, lumaSE)));
+    float lumaMax = max(lumaM, max(max(lumaNW, lumaNE), max(lumaSW, lumaSE)));
+
+    vec2 dir = vec2(-((lumaNW + lumaNE) - (lumaSW + lumaSE)), (lumaNW + lumaSW) - (lumaNE + lumaSE));
+    float dirReduce = max((lumaNW + lumaNE + lumaSW + lumaSE) * 0.25 * ReduceMul, ReduceMin);
+    float rcpDirMin = 1.0 / (min(abs(dir.x), abs(dir.y)) + dirReduce);
+    dir = clamp(dir * rcpDirMin, vec2(-SpanMax), vec2(SpanMax)) * SourceTexel;
+
+    vec3 rgbA = 0.5 * (tap(uv + dir * (1.0 / 3.0 - 0.5)) + tap(uv + dir * (2.0 / 3.0 - 0.5)));
+    vec3 rgbB = rgbA * 0.5 + 0.25 * (tap(uv - dir * 0.5) + tap(uv + dir * 0.5));
+    float lumaB = dot(rgbB, luma);
+
+    FragColor = vec4((lumaB < lumaMin || lumaB > lumaMax) ? rgbA : rgbB, 1.0);
+}
@@ -0,0 +1,10 @@
+#version 330
+
+out vec2 TexCoord;
+
+// Single triangle covering the screen, generated from gl_VertexID.
+void main() {
+    vec2 pos = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    TexCoord = pos;
+    gl_Position = vec4(pos * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -4,9 +4,15 @@ in vec3 VertexPosition;
 in vec2 VertexTexcoord;
 in vec3 VertexNormal;
 
-uniform mat4 camProj;
-uniform mat4 camView;
-uniform mat4 modelPos;
+layout(std140) uniform DrawUniforms {
+    mat4 camProj;
+    mat4 camView;
+    mat4 modelPos;
+    vec3 LightPos;
+    float LightRadius;
+    vec2 FragCoordOffset;
+    vec2 DitherSize;
+};
 
 out vec2 TexCoord;
 out vec3 Normal;
@@ -0,0 +1,37 @@
+#version 450
+
+// data/frag.glsl for Vulkan.
+
+layout(location = 0) in vec2 TexCoord;
+layout(location = 1) in vec3 Normal;
+layout(location = 2) in vec3 Position;
+
+layout(std140, set = 0, binding = 0) uniform SceneUniforms {
+    mat4 camProj;
+    mat4 camView;
+    mat4 modelPos[2];
+    vec4 LightPos;
+    vec2 DitherSize;
+    vec2 FragCoordOffset;
+    float TargetHeight;
+};
+
+layout(set = 0, binding = 1) uniform sampler2D Texture;
+layout(set = 0, binding = 2) uniform sampler3D DitherMap;
+
+layout(location = 0) out vec4 FragColor;
+
+void main() {
+    float fullBright = 0.8;
+    float lowBright = 0.2;
+    float shade = clamp((dot(normalize(Normal), normalize(LightPos.xyz))-lowBright)/(fullBright-lowBright),0.0,1.0);
+    if (shade > 0.0 && shade < 1.0) {
+        // gl_FragCoord counts rows from the top here, from the bottom in GL.
+        vec2 fragCoord = vec2(gl_FragCoord.x, TargetHeight - gl_FragCoord.y) + FragCoordOffset;
+        shade = mix(0.2,1.0,pow(texture(DitherMap, vec3(fragCoord.x/DitherSize.x, fragCoord.y/DitherSize.y, 1.0-shade)).r,2.0));
+    } else {
+        shade = clamp(shade, 0.2, 1.0);
+    }
+
+    FragColor = texture(Texture, TexCoord) * shade;
+}
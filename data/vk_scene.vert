@@ -0,0 +1,41 @@
+#version 450
+
+// data/vertex.glsl for Vulkan. The uniforms live in one block shared with
+// data/vk_scene.frag, and the push constant picks the draw's model matrix.
+
+layout(location = 0) in vec3 VertexPosition;
+layout(location = 1) in vec2 VertexTexcoord;
+layout(location = 2) in vec3 VertexNormal;
+
+layout(std140, set = 0, binding = 0) uniform SceneUniforms {
+    mat4 camProj;
+    mat4 camView;
+    mat4 modelPos[2];
+    vec4 LightPos;
+    vec2 DitherSize;
+    vec2 FragCoordOffset;
+    float TargetHeight;
+};
+
+layout(push_constant) uniform Draw {
+    uint index;
+} draw;
+
+layout(location = 0) out vec2 TexCoord;
+layout(location = 1) out vec3 Normal;
+layout(location = 2) out vec3 Position;
+
+void main() {
+    mat4 model = modelPos[draw.index];
+    mat4 MVP = camProj * camView * model;
+
+    mat4 NormalMatrix = transpose(inverse(camView * model));
+
+    TexCoord = VertexTexcoord;
+    Normal = (NormalMatrix * vec4(VertexNormal,1.0)).xyz;
+    Position = (model * vec4(VertexPosition,1.0)).xyz;
+
+    gl_Position = MVP * vec4(VertexPosition,1.0);
+    // The projection is GL's, with depth in [-w, w]; Vulkan clips to [0, w].
+    gl_Position.z = (gl_Position.z + gl_Position.w) * 0.5;
+}
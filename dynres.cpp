@@ -0,0 +1,81 @@
+#include "dynres.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+GpuTimer create_gpu_timer() {
+    GpuTimer rv;
+    glGenQueries(GpuTimer::depth, rv.queries);
+    return rv;
+}
+
+void destroy_gpu_timer(GpuTimer &timer) {
+    glDeleteQueries(GpuTimer::depth, timer.queries);
+    timer = GpuTimer{};
+}
+
+void begin_gpu_timer(GpuTimer &timer) {
+    // All queries still in flight: skip this frame rather than stall.
+    timer.active = timer.pending < GpuTimer::depth;
+    if (timer.active) {
+        glBeginQuery(GL_TIME_ELAPSED, timer.queries[(timer.oldest + timer.pending) % GpuTimer::depth]);
+    }
+}
+
+void end_gpu_timer(GpuTimer &timer) {
+    if (timer.active) {
+        glEndQuery(GL_TIME_ELAPSED);
+        ++timer.pending;
+        timer.active = false;
+    }
+}
+
+double poll_gpu_timer(GpuTimer &timer) {
+    double rv = -1;
+    while (timer.pending > 0) {
+        GLuint query = timer.queries[timer.oldest];
+        GLuint available = GL_FALSE;
+        glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            break;
+        }
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+        rv = ns / 1e6;
+        timer.oldest = (timer.oldest + 1) % GpuTimer::depth;
+        --timer.pending;
+    }
+    return rv;
+}
+
+namespace {
+// Snap to a coarse grid so the image does not shimmer from tiny changes.
+const double scale_step = 1.0 / 32;
+// Aim slightly under budget so noise does not push us over it.
+const double headroom = 0.9;
+}
+
+ResolutionScaler::ResolutionScaler(double budget_ms, double min_scale, double max_scale)
+        : budget_ms(budget_ms), min_scale(min_scale), max_scale(max_scale), current(max_scale),
+          snapped(max_scale) {}
+
+void ResolutionScaler::update(double measured_ms) {
+    if (measured_ms <= 0) {
+        return;
+    }
+    gpu_ms = measured_ms;
+
+    // measured_ms is the cost of the snapped scale, the one rendered.
+    double desired = snapped * sqrt(budget_ms * headroom / measured_ms);
+    double gain = desired < current ? 0.5 : 0.1;
+    double next = current + (desired - current) * gain;
+
+    current = min(max(next, min_scale), max_scale);
+    snapped = min(max(round(current / scale_step) * scale_step, min_scale), max_scale);
+}
+
+int ResolutionScaler::scaled(int size) const {
+    return max(1, int(lround(size * snapped)));
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <glad/glad.h>
+
+// GL_TIME_ELAPSED queries kept in a small ring so results are only read
+// once the GPU has them; beginning or ending a measurement never waits.
+struct GpuTimer {
+    static const int depth = 4;
+    GLuint queries[depth] = {};
+    int oldest = 0;
+    int pending = 0;
+    bool active = false;
+};
+
+GpuTimer create_gpu_timer();
+void destroy_gpu_timer(GpuTimer &timer);
+
+void begin_gpu_timer(GpuTimer &timer);
+void end_gpu_timer(GpuTimer &timer);
+
+// Most recent completed measurement in milliseconds, or a negative value if
+// nothing new has finished since the last call.
+double poll_gpu_timer(GpuTimer &timer);
+
+// Picks the render scale that keeps measured GPU time near a budget. Cost is
+// treated as proportional to pixel count, so the linear scale moves by the
+// square root of the budget ratio. Drops react fast, recovery is gradual.
+class ResolutionScaler {
+public:
+    ResolutionScaler(double budget_ms, double min_scale, double max_scale = 1.0);
+
+    void update(double gpu_ms);
+
+    // The filtered scale snapped to a coarse grid, as rendered.
+    double scale() const { return snapped; }
+    double last_gpu_ms() const { return gpu_ms; }
+    int scaled(int size) const;
+
+private:
+    double budget_ms;
+    double min_scale;
+    double max_scale;
+    // Kept off the grid, so small sustained headroom still adds up to a step.
+    double current;
+    double snapped;
+    double gpu_ms = 0;
+};
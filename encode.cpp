@@ -0,0 +1,351 @@
+#include "encode.hpp"
+#include "jobs.hpp"
+
+#include <lodepng.h>
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+const unsigned char *row_top_down(const CapturedFrame &frame, int y) {
+    return frame.pixels.data() + size_t(frame.height - 1 - y) * frame.width * 4;
+}
+
+void put_be32(vector<unsigned char> &out, uint32_t v) {
+    out.push_back(v >> 24);
+    out.push_back(v >> 16);
+    out.push_back(v >> 8);
+    out.push_back(v);
+}
+
+unsigned char clamp_byte(int v) {
+    return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+const char *extension(ImageFormat format) {
+    switch (format) {
+        case ImageFormat::png:
+            return "png";
+        case ImageFormat::qoi:
+            return "qoi";
+        case ImageFormat::y4m:
+            return "y4m";
+    }
+    return "";
+}
+
+void make_directories(const string &path) {
+    for (size_t end = path.find('/', 1);; end = path.find('/', end + 1)) {
+        string dir = path.substr(0, end);
+        if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+            throw runtime_error("Unable to create \"" + dir + "\": " + strerror(errno));
+        }
+        if (end == string::npos) {
+            break;
+        }
+    }
+}
+}
+
+vector<unsigned char> encode_png(const CapturedFrame &frame) {
+    vector<unsigned char> flipped(frame.pixels.size());
+    size_t stride = size_t(frame.width) * 4;
+    for (int y = 0; y < frame.height; ++y) {
+        memcpy(&flipped[y * stride], row_top_down(frame, y), stride);
+    }
+
+    vector<unsigned char> rv;
+    unsigned error = lodepng::encode(rv, flipped, frame.width, frame.height);
+    if (error != 0) {
+        throw runtime_error(string("PNG encode failed: ") + lodepng_error_text(error));
+    }
+    return rv;
+}
+
+// https://qoiformat.org/qoi-specification.pdf
+vector<unsigned char> encode_qoi(const CapturedFrame &frame) {
+    vector<unsigned char> rv;
+    rv.reserve(14 + size_t(frame.width) * frame.height * 5 + 8);
+
+    rv.insert(end(rv), {'q', 'o', 'i', 'f'});
+    put_be32(rv, frame.width);
+    put_be32(rv, frame.height);
+    rv.push_back(4); // RGBA
+    rv.push_back(0); // sRGB with linear alpha
+
+    unsigned char index[64][4] = {};
+    unsigned char prev[4] = {0, 0, 0, 255};
+    int run = 0;
+    size_t total = size_t(frame.width) * frame.height;
+    size_t n = 0;
+
+    for (int y = 0; y < frame.height; ++y) {
+        auto row = row_top_down(frame, y);
+        for (int x = 0; x < frame.width; ++x, ++n) {
+            auto px = row + x * 4;
+
+            if (memcmp(px, prev, 4) == 0) {
+                ++run;
+                if (run == 62 || n + 1 == total) {
+                    rv.push_back(0xc0 | (run - 1));
+                    run = 0;
+                }
+                continue;
+            }
+
+            if (run > 0) {
+                rv.push_back(0xc0 | (run - 1));
+                run = 0;
+            }
+
+            int hash = (px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64;
+            if (memcmp(index[hash], px, 4) == 0) {
+                rv.push_back(hash);
+            } else {
+                memcpy(index[hash], px, 4);
+
+                if (px[3] == prev[3]) {
+                    int vr = int8_t(px[0] - prev[0]);
+                    int vg = int8_t(px[1] - prev[1]);
+                    int vb = int8_t(px[2] - prev[2]);
+                    int vg_r = vr - vg;
+                    int vg_b = vb - vg;
+
+                    if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2) {
+                        rv.push_back(0x40 | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2));
+                    } else if (vg_r > -9 && vg_r < 8 && vg > -33 && vg < 32 && vg_b > -9 && vg_b < 8) {
+                        rv.push_back(0x80 | (vg + 32));
+                        rv.push_back((vg_r + 8) << 4 | (vg_b + 8));
+                    } else {
+                        rv.insert(end(rv), {0xfe, px[0], px[1], px[2]});
+                    }
+                } else {
+                    rv.insert(end(rv), {0xff, px[0], px[1], px[2], px[3]});
+                }
+            }
+
+            memcpy(prev, px, 4);
+        }
+    }
+
+    rv.insert(end(rv), {0, 0, 0, 0, 0, 0, 0, 1});
+    return rv;
+}
+
+// Full-range BT.601 in 8.8 fixed point, chroma averaged over 2x2 blocks.
+vector<unsigned char> encode_y4m_frame(const CapturedFrame &frame) {
+    int w = frame.width;
+    int h = frame.height;
+    int cw = (w + 1) / 2;
+    int ch = (h + 1) / 2;
+
+    const char tag[] = "FRAME\n";
+    vector<unsigned char> rv(sizeof(tag) - 1 + size_t(w) * h + size_t(cw) * ch * 2);
+    memcpy(rv.data(), tag, sizeof(tag) - 1);
+    auto yp = rv.data() + sizeof(tag) - 1;
+    auto up = yp + size_t(w) * h;
+    auto vp = up + size_t(cw) * ch;
+
+    for (int y = 0; y < h; ++y) {
+        auto row = row_top_down(frame, y);
+        for (int x = 0; x < w; ++x) {
+            auto px = row + x * 4;
+            yp[size_t(y) * w + x] = (77 * px[0] + 150 * px[1] + 29 * px[2] + 128) >> 8;
+        }
+    }
+
+    for (int cy = 0; cy < ch; ++cy) {
+        auto row0 = row_top_down(frame, cy * 2);
+        auto row1 = row_top_down(frame, min(cy * 2 + 1, h - 1));
+        for (int cx = 0; cx < cw; ++cx) {
+            int x0 = cx * 2 * 4;
+            int x1 = min(cx * 2 + 1, w - 1) * 4;
+            int r = row0[x0] + row0[x1] + row1[x0] + row1[x1];
+            int g = row0[x0 + 1] + row0[x1 + 1] + row1[x0 + 1] + row1[x1 + 1];
+            int b = row0[x0 + 2] + row0[x1 + 2] + row1[x0 + 2] + row1[x1 + 2];
+            // Sums are 4x the average, so shift by 10 instead of 8.
+            up[size_t(cy) * cw + cx] = clamp_byte((-43 * r - 85 * g + 128 * b + (128 << 10) + 512) >> 10);
+            vp[size_t(cy) * cw + cx] = clamp_byte((128 * r - 107 * g - 21 * b + (128 << 10) + 512) >> 10);
+        }
+    }
+
+    return rv;
+}
+
+FrameEncoder::FrameEncoder(JobSystem &jobs, EncoderSettings settings, shared_ptr<FrameQueue> spare)
+        : jobs(jobs), settings(move(settings)), spare(move(spare)) {
+    if (this->settings.max_in_flight <= 0) {
+        this->settings.max_in_flight = jobs.num_workers() + 1;
+    }
+    if (this->settings.format == ImageFormat::y4m) {
+        stream.open(this->settings.output, ios::binary);
+        if (!stream) {
+            throw runtime_error("Unable to open \"" + this->settings.output + "\" for writing");
+        }
+    } else {
+        make_directories(this->settings.output);
+    }
+}
+
+FrameEncoder::~FrameEncoder() {
+    wait_idle();
+}
+
+void FrameEncoder::encode(CapturedFrame frame) {
+    long long sequence;
+    {
+        unique_lock<mutex> lock(state_mutex);
+        slot_free.wait(lock, [&] { return in_flight < settings.max_in_flight; });
+        if (!error.empty()) {
+            return;
+        }
+        ++in_flight;
+        sequence = next_sequence++;
+    }
+
+    try {
+        if (settings.format == ImageFormat::y4m) {
+            lock_guard<mutex> lock(stream_mutex);
+            if (stream_width == 0) {
+                stream_width = frame.width;
+                stream_height = frame.height;
+                stream << "YUV4MPEG2 W" << frame.width << " H" << frame.height << " F" << settings.fps
+                       << ":1 Ip A1:1 C420jpeg\n";
+            }
+        }
+
+        auto shared = make_shared<CapturedFrame>(move(frame));
+        jobs.run([this, sequence, shared] { encode_job(sequence, *shared); });
+    } catch (const exception &e) {
+        // A y4m stream now has a gap it will never fill, so nothing after
+        // this frame can be written anyway.
+        fail(e.what());
+        release_slot(false);
+    }
+}
+
+void FrameEncoder::encode_job(long long sequence, CapturedFrame &frame) {
+    auto start = chrono::steady_clock::now();
+    vector<unsigned char> bytes;
+
+    try {
+        switch (settings.format) {
+            case ImageFormat::png:
+                bytes = encode_png(frame);
+                break;
+            case ImageFormat::qoi:
+                bytes = encode_qoi(frame);
+                break;
+            case ImageFormat::y4m:
+                if (frame.width == stream_width && frame.height == stream_height) {
+                    bytes = encode_y4m_frame(frame);
+                } else {
+                    clog << "Warning: Skipping frame " << frame.index << ", y4m streams cannot change size" << endl;
+                }
+                break;
+        }
+    } catch (const exception &e) {
+        fail("Frame " + to_string(frame.index) + ": " + e.what());
+    }
+
+    double encode_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    size_t raw_size = frame.pixels.size();
+    size_t encoded_size = bytes.size();
+
+    if (settings.format == ImageFormat::y4m) {
+        write_in_order(sequence, move(bytes));
+    } else if (!bytes.empty()) {
+        ostringstream fname;
+        fname << settings.output << "/frame_" << setw(6) << setfill('0') << frame.index << "."
+              << extension(settings.format);
+        ofstream file(fname.str(), ios::binary);
+        file.write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+        file.close();
+        if (!file) {
+            fail("Unable to write \"" + fname.str() + "\"");
+            encoded_size = 0;
+        }
+    }
+
+    if (settings.report && encoded_size > 0) {
+        ostringstream line;
+        line << "Encoded frame " << frame.index << " (" << extension(settings.format) << ", " << frame.width << "x"
+             << frame.height << "): " << fixed << setprecision(2) << encode_ms << " ms, "
+             << raw_size / (encode_ms * 1e3) << " MB/s, " << encoded_size * 100.0 / raw_size << "% of raw";
+        clog << line.str() << endl;
+    }
+
+    if (spare) {
+        spare->try_push(frame);
+    }
+
+    release_slot(encoded_size > 0);
+}
+
+void FrameEncoder::write_in_order(long long sequence, vector<unsigned char> bytes) {
+    lock_guard<mutex> lock(stream_mutex);
+    out_of_order[sequence] = move(bytes);
+
+    auto it = out_of_order.begin();
+    while (it != out_of_order.end() && it->first == next_to_write) {
+        stream.write(reinterpret_cast<const char *>(it->second.data()), it->second.size());
+        it = out_of_order.erase(it);
+        ++next_to_write;
+    }
+    if (!stream) {
+        fail("Unable to write \"" + settings.output + "\"");
+    }
+}
+
+void FrameEncoder::wait_idle() {
+    unique_lock<mutex> lock(state_mutex);
+    slot_free.wait(lock, [&] { return in_flight == 0; });
+}
+
+void FrameEncoder::fail(const string &message) {
+    lock_guard<mutex> lock(state_mutex);
+    if (error.empty()) {
+        clog << "Error: " << message << endl;
+        error = message;
+    }
+}
+
+void FrameEncoder::release_slot(bool wrote) {
+    lock_guard<mutex> lock(state_mutex);
+    --in_flight;
+    if (wrote) {
+        ++written;
+    }
+    // Notify under the lock: finish() may destroy us as soon as it sees zero.
+    slot_free.notify_all();
+}
+
+void FrameEncoder::finish() {
+    wait_idle();
+    {
+        lock_guard<mutex> lock(stream_mutex);
+        if (stream.is_open() && !stream.flush()) {
+            fail("Unable to write \"" + settings.output + "\"");
+        }
+    }
+    lock_guard<mutex> lock(state_mutex);
+    if (!error.empty()) {
+        throw runtime_error(error);
+    }
+}
+
+long long FrameEncoder::frames_written() const {
+    lock_guard<mutex> lock(state_mutex);
+    return written;
+}
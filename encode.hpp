@@ -0,0 +1,80 @@
+#pragma once
+
+#include "capture.hpp"
+#include "options.hpp"
+
+#include <condition_variable>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class JobSystem;
+
+struct EncoderSettings {
+    ImageFormat format = ImageFormat::png;
+    // Directory for png/qoi image sequences, file name for a y4m stream.
+    std::string output;
+    int fps = 60;
+    // Frames allowed to be encoding at once; 0 picks one per job thread.
+    int max_in_flight = 0;
+    bool report = true;
+};
+
+// Single-frame encoders. Input rows are bottom-up, as captured; output is
+// top-down.
+std::vector<unsigned char> encode_png(const CapturedFrame &frame);
+std::vector<unsigned char> encode_qoi(const CapturedFrame &frame);
+// One "FRAME" record of a C420jpeg YUV4MPEG2 stream.
+std::vector<unsigned char> encode_y4m_frame(const CapturedFrame &frame);
+
+// Encodes captured frames on the job system. encode() blocks once
+// max_in_flight frames are outstanding, which is the backpressure towards
+// whoever feeds it. Image files are written by the job that encoded them;
+// y4m frames are put back into arrival order before being appended.
+class FrameEncoder {
+public:
+    // Creates the output directory or opens the y4m file, throwing if it
+    // can't.
+    FrameEncoder(JobSystem &jobs, EncoderSettings settings, std::shared_ptr<FrameQueue> spare = nullptr);
+    FrameEncoder(const FrameEncoder &) = delete;
+    FrameEncoder &operator=(const FrameEncoder &) = delete;
+    ~FrameEncoder();
+
+    // Never throws, so it can be fed from any thread. Once a frame has failed
+    // to encode or write, further frames are dropped.
+    void encode(CapturedFrame frame);
+
+    // Blocks until everything passed to encode() is on disk, then throws the
+    // first failure, if any.
+    void finish();
+
+    long long frames_written() const;
+
+private:
+    void encode_job(long long sequence, CapturedFrame &frame);
+    void write_in_order(long long sequence, std::vector<unsigned char> bytes);
+    void wait_idle();
+    void fail(const std::string &message);
+    void release_slot(bool wrote);
+
+    JobSystem &jobs;
+    EncoderSettings settings;
+    std::shared_ptr<FrameQueue> spare;
+
+    mutable std::mutex state_mutex;
+    std::condition_variable slot_free;
+    int in_flight = 0;
+    long long next_sequence = 0;
+    long long written = 0;
+    std::string error;
+
+    std::mutex stream_mutex;
+    std::ofstream stream;
+    int stream_width = 0;
+    int stream_height = 0;
+    long long next_to_write = 0;
+    std::map<long long, std::vector<unsigned char>> out_of_order;
+};
@@ -0,0 +1,314 @@
+#include "file_batch.hpp"
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+// No liburing: the three syscalls and the ring layout are all it takes.
+struct Ring {
+    int fd = -1;
+    unsigned entries = 0;
+
+    void *sq = MAP_FAILED;
+    size_t sqSize = 0;
+    void *cq = MAP_FAILED;
+    size_t cqSize = 0;
+    io_uring_sqe *sqes = static_cast<io_uring_sqe *>(MAP_FAILED);
+    size_t sqesSize = 0;
+
+    unsigned *sqTail = nullptr;
+    unsigned *sqMask = nullptr;
+    unsigned *sqArray = nullptr;
+    unsigned *cqHead = nullptr;
+    unsigned *cqTail = nullptr;
+    unsigned *cqMask = nullptr;
+    io_uring_cqe *cqes = nullptr;
+};
+
+void destroy_ring(Ring &ring) {
+    if (ring.sqes != MAP_FAILED) {
+        munmap(ring.sqes, ring.sqesSize);
+    }
+    if (ring.cq != MAP_FAILED && ring.cq != ring.sq) {
+        munmap(ring.cq, ring.cqSize);
+    }
+    if (ring.sq != MAP_FAILED) {
+        munmap(ring.sq, ring.sqSize);
+    }
+    if (ring.fd >= 0) {
+        close(ring.fd);
+    }
+    ring = Ring{};
+}
+
+// False where io_uring is missing or locked down, e.g. by seccomp.
+bool create_ring(Ring &ring, unsigned entries) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring.fd = int(syscall(__NR_io_uring_setup, entries, &params));
+    if (ring.fd < 0) {
+        return false;
+    }
+    ring.entries = params.sq_entries;
+
+    ring.sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring.cqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single) {
+        ring.sqSize = ring.cqSize = max(ring.sqSize, ring.cqSize);
+    }
+    ring.sq = mmap(nullptr, ring.sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd,
+                   IORING_OFF_SQ_RING);
+    if (ring.sq == MAP_FAILED) {
+        destroy_ring(ring);
+        return false;
+    }
+    ring.cq = single ? ring.sq
+                     : mmap(nullptr, ring.cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd,
+                            IORING_OFF_CQ_RING);
+    ring.sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void *sqes = mmap(nullptr, ring.sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd,
+                      IORING_OFF_SQES);
+    ring.sqes = static_cast<io_uring_sqe *>(sqes);
+    if (ring.cq == MAP_FAILED || sqes == MAP_FAILED) {
+        destroy_ring(ring);
+        return false;
+    }
+
+    auto sq = static_cast<unsigned char *>(ring.sq);
+    auto cq = static_cast<unsigned char *>(ring.cq);
+    ring.sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    ring.sqMask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    ring.sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    ring.cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    ring.cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    ring.cqMask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    ring.cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+    return true;
+}
+
+// The caller keeps no more than ring.entries reads in flight, so there is
+// always a free slot.
+void queue_read(Ring &ring, int fd, char *buffer, size_t size, size_t offset, uint64_t user_data) {
+    unsigned tail = *ring.sqTail;
+    unsigned index = tail & *ring.sqMask;
+    io_uring_sqe &sqe = ring.sqes[index];
+    memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_READ;
+    sqe.fd = fd;
+    sqe.addr = reinterpret_cast<uint64_t>(buffer);
+    sqe.len = unsigned(min<size_t>(size, 1u << 30));
+    sqe.off = offset;
+    sqe.user_data = user_data;
+    ring.sqArray[index] = index;
+    __atomic_store_n(ring.sqTail, tail + 1, __ATOMIC_RELEASE);
+}
+
+struct PendingFile {
+    int fd = -1;
+    string bytes;
+    size_t read = 0;
+    // Submitted to the kernel, or about to be, and not yet completed.
+    bool queued = false;
+};
+
+// Opens and sizes the file, or warns and leaves fd at -1.
+PendingFile open_file(const string &path) {
+    PendingFile rv;
+    rv.fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (rv.fd >= 0 && fstat(rv.fd, &st) == 0) {
+        rv.bytes.resize(st.st_size);
+        return rv;
+    }
+    clog << "Warning: Unable to read \"" << path << "\": " << strerror(errno) << endl;
+    if (rv.fd >= 0) {
+        close(rv.fd);
+        rv.fd = -1;
+    }
+    return rv;
+}
+
+// Whatever is left of file, with plain reads; io_uring falls back to this
+// when a kernel does not know IORING_OP_READ.
+void pread_rest(PendingFile &file, const string &path) {
+    while (file.read < file.bytes.size()) {
+        ssize_t n = pread(file.fd, &file.bytes[file.read], file.bytes.size() - file.read, file.read);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            clog << "Warning: Unable to read \"" << path << "\": " << strerror(errno) << endl;
+            file.bytes.clear();
+            return;
+        }
+        if (n == 0) {
+            break;
+        }
+        file.read += n;
+    }
+    file.bytes.resize(file.read);
+}
+
+const unsigned ring_entries = 64;
+
+vector<JobHandle> read_with_ring(Ring &ring, JobSystem &jobs, const vector<string> &paths,
+                                 const function<void(size_t, string &)> &done) {
+    vector<JobHandle> rv;
+    unique_ptr<vector<PendingFile>> owned(new vector<PendingFile>(paths.size()));
+    vector<PendingFile> &files = *owned;
+    auto finish = [&](size_t i, PendingFile &file) {
+        if (file.fd >= 0) {
+            close(file.fd);
+        }
+        rv.push_back(jobs.run([&done, i, bytes = move(file.bytes)]() mutable { done(i, bytes); }));
+    };
+
+    size_t next = 0;
+    unsigned inFlight = 0;
+    unsigned toSubmit = 0;
+    // Cleared when io_uring_enter fails; what is in flight is then reaped
+    // and everything else read with pread, so no read outlives files.
+    bool useRing = true;
+    auto enqueue = [&](size_t i) {
+        PendingFile &file = files[i];
+        queue_read(ring, file.fd, &file.bytes[file.read], file.bytes.size() - file.read, file.read, i);
+        file.queued = true;
+        ++inFlight;
+        ++toSubmit;
+    };
+    while (next < paths.size() || inFlight > 0) {
+        while (next < paths.size() && (!useRing || inFlight < ring.entries)) {
+            size_t i = next++;
+            files[i] = open_file(paths[i]);
+            if (useRing && files[i].fd >= 0 && !files[i].bytes.empty()) {
+                enqueue(i);
+                continue;
+            }
+            if (files[i].fd >= 0) {
+                pread_rest(files[i], paths[i]);
+            }
+            finish(i, files[i]);
+        }
+        if (inFlight == 0) {
+            continue;
+        }
+
+        int entered = int(syscall(__NR_io_uring_enter, ring.fd, toSubmit, 1, IORING_ENTER_GETEVENTS, nullptr, 0));
+        if (entered < 0 && errno == EINTR) {
+            continue;
+        }
+        if (entered < 0 && useRing) {
+            clog << "Warning: io_uring_enter failed, reading with pread instead: " << strerror(errno) << endl;
+            useRing = false;
+            // A failed enter submitted nothing, so the reads it was given
+            // come back off the ring before the kernel can see them.
+            unsigned tail = *ring.sqTail;
+            for (unsigned k = 1; k <= toSubmit; ++k) {
+                size_t i = ring.sqes[(tail - k) & *ring.sqMask].user_data;
+                files[i].queued = false;
+                pread_rest(files[i], paths[i]);
+                finish(i, files[i]);
+            }
+            __atomic_store_n(ring.sqTail, tail - toSubmit, __ATOMIC_RELEASE);
+            inFlight -= toSubmit;
+            toSubmit = 0;
+            continue;
+        }
+        if (entered < 0) {
+            // Not even waiting works. The kernel may still write into the
+            // buffers of reads in flight, so files is leaked rather than
+            // freed and those files are read again into fresh buffers.
+            clog << "Warning: Unable to wait for io_uring reads: " << strerror(errno) << endl;
+            owned.release();
+            for (size_t i = 0; i < next; ++i) {
+                if (files[i].queued) {
+                    PendingFile again;
+                    again.fd = files[i].fd;
+                    again.bytes.resize(files[i].bytes.size());
+                    pread_rest(again, paths[i]);
+                    finish(i, again);
+                }
+            }
+            inFlight = 0;
+            continue;
+        }
+        toSubmit -= min<unsigned>(toSubmit, entered);
+
+        unsigned head = *ring.cqHead;
+        unsigned tail = __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            io_uring_cqe cqe = ring.cqes[head & *ring.cqMask];
+            size_t i = cqe.user_data;
+            PendingFile &file = files[i];
+            file.queued = false;
+            --inFlight;
+            if (cqe.res > 0) {
+                file.read += cqe.res;
+            }
+            bool retry = cqe.res == -EINTR || cqe.res == -EAGAIN;
+            if (useRing && (retry || (cqe.res > 0 && file.read < file.bytes.size()))) {
+                enqueue(i);
+                continue;
+            }
+            if (cqe.res < 0 || (cqe.res > 0 && file.read < file.bytes.size())) {
+                // Including -EINVAL from kernels before IORING_OP_READ.
+                pread_rest(file, paths[i]);
+            } else {
+                // Shorter than fstat said if the file shrank meanwhile.
+                file.bytes.resize(file.read);
+            }
+            finish(i, file);
+        }
+        __atomic_store_n(ring.cqHead, head, __ATOMIC_RELEASE);
+    }
+    return rv;
+}
+
+vector<JobHandle> read_with_jobs(JobSystem &jobs, const vector<string> &paths,
+                                 const function<void(size_t, string &)> &done) {
+    vector<JobHandle> rv;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        rv.push_back(jobs.run([&paths, &done, i] {
+            PendingFile file = open_file(paths[i]);
+            if (file.fd >= 0) {
+                pread_rest(file, paths[i]);
+                close(file.fd);
+            }
+            done(i, file.bytes);
+        }));
+    }
+    // Same contract as the ring: every read is over on return.
+    jobs.wait_all(rv);
+    return rv;
+}
+}
+
+vector<JobHandle> read_files(JobSystem &jobs, const vector<string> &paths,
+                             const function<void(size_t index, string &bytes)> &done) {
+    Ring ring;
+    if (paths.empty() || !create_ring(ring, min<unsigned>(ring_entries, paths.size()))) {
+        return read_with_jobs(jobs, paths, done);
+    }
+    try {
+        vector<JobHandle> rv = read_with_ring(ring, jobs, paths, done);
+        destroy_ring(ring);
+        return rv;
+    } catch (...) {
+        destroy_ring(ring);
+        throw;
+    }
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "jobs.hpp"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// Reads whole files with every read in flight at once, through io_uring
+// where the kernel allows it and pread jobs otherwise. As each file lands,
+// done(index, bytes) is queued as a job of its own, so parsing overlaps the
+// reads still outstanding. A file that cannot be read arrives empty, after
+// a warning.
+//
+// Returns once every read has finished; the returned jobs are the done
+// calls, which may still be running, so done has to outlive them.
+std::vector<JobHandle> read_files(JobSystem &jobs, const std::vector<std::string> &paths,
+                                  const std::function<void(size_t index, std::string &bytes)> &done);
@@ -0,0 +1,65 @@
+#include "file_watch.hpp"
+
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+FileWatcher::FileWatcher(const vector<string> &paths) {
+    fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) {
+        clog << "Warning: Unable to watch asset files: " << strerror(errno) << endl;
+        return;
+    }
+    for (auto &path : paths) {
+        size_t slash = path.rfind('/');
+        string dir = slash == string::npos ? "." : path.substr(0, slash);
+        string name = slash == string::npos ? path : path.substr(slash + 1);
+        // Directories shared by several files come back with the same
+        // descriptor.
+        int wd = inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (wd < 0) {
+            clog << "Warning: Unable to watch \"" << dir << "\": " << strerror(errno) << endl;
+        }
+        files.push_back({wd, name});
+    }
+}
+
+FileWatcher::~FileWatcher() {
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+vector<size_t> FileWatcher::changed() {
+    vector<size_t> rv;
+    if (fd < 0) {
+        return rv;
+    }
+    alignas(inotify_event) char buffer[4096];
+    for (;;) {
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n <= 0) {
+            break;
+        }
+        for (ssize_t offset = 0; offset < n;) {
+            auto event = reinterpret_cast<const inotify_event *>(buffer + offset);
+            offset += sizeof(inotify_event) + event->len;
+            if (event->len == 0) {
+                continue;
+            }
+            for (size_t i = 0; i < files.size(); ++i) {
+                if (files[i].dir == event->wd && files[i].name == event->name &&
+                    find(rv.begin(), rv.end(), i) == rv.end()) {
+                    rv.push_back(i);
+                }
+            }
+        }
+    }
+    return rv;
+}
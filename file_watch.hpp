@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Notices files being rewritten, through inotify on the directories that
+// hold them, so an editor that saves by renaming a new file over the old
+// one is seen as well. Without inotify it warns once and sees nothing.
+class FileWatcher {
+public:
+    explicit FileWatcher(const std::vector<std::string> &paths);
+    FileWatcher(const FileWatcher &) = delete;
+    FileWatcher &operator=(const FileWatcher &) = delete;
+    ~FileWatcher();
+
+    // Indices into paths of the files written since the last call, each
+    // once. Never waits.
+    std::vector<size_t> changed();
+
+private:
+    struct Watched {
+        int dir;
+        std::string name;
+    };
+
+    int fd = -1;
+    std::vector<Watched> files;
+};
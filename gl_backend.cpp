@@ -0,0 +1,301 @@
+#include "backend.hpp"
+#include "capture.hpp"
+#include "dynres.hpp"
+#include "file_watch.hpp"
+#include "loader.hpp"
+#include "options.hpp"
+#include "post.hpp"
+#include "render_target.hpp"
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <exception>
+#include <iostream>
+
+using namespace std;
+
+namespace {
+// Anti-aliasing and dynamic resolution both render offscreen and blit or
+// filter into the window, so the window itself is never multisampled.
+class GlBackend : public RenderBackend {
+public:
+    GlBackend(GLFWwindow *window, const Options &options, JobSystem &jobs, const AssetCache *cache,
+              FrameCapture *capture, const SceneDescription *description)
+            : window(window), capture(capture), aa(options.aa), scaler(options.gpu_budget, options.min_scale) {
+        dynamicResolution = options.gpu_budget > 0;
+        offscreen = dynamicResolution || aa != AntiAliasing::none;
+        sceneSamples = aa == AntiAliasing::msaa ? options.msaa_samples : 0;
+
+        glEnable(GL_DEPTH_TEST);
+        glDepthFunc(GL_LESS);
+        glClearDepth(1.f);
+
+        try {
+            loader = make_unique<AssetLoader>(window, options.watch_assets);
+        } catch (const exception &e) {
+            clog << "Warning: " << e.what() << "; assets will not stream" << endl;
+        }
+
+        SceneDescription builtin;
+        if (!description) {
+            builtin = default_scene_description();
+            description = &builtin;
+        }
+        for (size_t i = 0; i < description->meshes.size(); ++i) {
+            assets.push_back({true, int(i), description->meshes[i].path});
+        }
+        for (size_t i = 0; i < description->textures.size(); ++i) {
+            assets.push_back({false, int(i), description->textures[i]});
+        }
+        if (loader && options.watch_assets) {
+            vector<string> paths;
+            for (auto &a : assets) {
+                paths.push_back(a.path);
+            }
+            watcher = make_unique<FileWatcher>(paths);
+        }
+
+        // Mapped assets are as quick to upload as placeholders, but only
+        // cover the built-in scene. A capture should not start with frames
+        // of boxes.
+        bool mapped = cache && description == &builtin;
+        if (loader && !mapped && !capture) {
+            scene = load_placeholder_scene(jobs, *description);
+            stream_assets();
+        } else if (description == &builtin) {
+            scene = load_scene(jobs, cache);
+        } else {
+            scene = load_scene(jobs, *description);
+        }
+        if (aa == AntiAliasing::fxaa) {
+            fxaa = create_fxaa_pass(cache);
+        }
+        gpuTimer = create_gpu_timer();
+    }
+
+    ~GlBackend() override {
+        if (sceneTarget.fbo != 0) {
+            destroy_render_target(sceneTarget);
+        }
+        if (resolveTarget.fbo != 0) {
+            destroy_render_target(resolveTarget);
+        }
+        if (fxaa.program != 0) {
+            destroy_fxaa_pass(fxaa);
+        }
+        destroy_gpu_timer(gpuTimer);
+        loader.reset();
+        destroy_scene(scene);
+    }
+
+    void draw_frame(const SceneParams &params, int fbWidth, int fbHeight, long long index, double time) override {
+        timer.start();
+        renderWidth = fbWidth;
+        renderHeight = fbHeight;
+
+        if (dynamicResolution) {
+            scaler.update(poll_gpu_timer(gpuTimer));
+            renderWidth = scaler.scaled(fbWidth);
+            renderHeight = scaler.scaled(fbHeight);
+            begin_gpu_timer(gpuTimer);
+        }
+        if (offscreen) {
+            resize_render_target(sceneTarget, fbWidth, fbHeight, sceneSamples);
+            glBindFramebuffer(GL_FRAMEBUFFER, sceneTarget.fbo);
+        }
+        glViewport(0, 0, renderWidth, renderHeight);
+        draw_scene(scene, params);
+
+        if (dynamicResolution) {
+            end_gpu_timer(gpuTimer);
+        }
+        if (offscreen) {
+            // A same-size blit out of a multisampled target is itself the
+            // resolve; scaling or filtering needs an explicit one first.
+            const RenderTarget *source = &sceneTarget;
+            bool scaling = renderWidth != fbWidth || renderHeight != fbHeight;
+            if (sceneTarget.samples > 0 && scaling) {
+                resize_render_target(resolveTarget, fbWidth, fbHeight);
+                resolve_render_target(sceneTarget, resolveTarget, renderWidth, renderHeight);
+                source = &resolveTarget;
+            }
+            if (aa == AntiAliasing::fxaa) {
+                draw_fxaa(fxaa, *source, renderWidth, renderHeight, fbWidth, fbHeight);
+            } else {
+                blit_to_screen(*source, renderWidth, renderHeight, fbWidth, fbHeight);
+            }
+        }
+        timer.stop();
+
+        if (capture) {
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+            glReadBuffer(GL_BACK);
+            capture_frame(*capture, fbWidth, fbHeight, index, time);
+        }
+    }
+
+    void present() override {
+        glfwSwapBuffers(window);
+    }
+
+    void set_swap_interval(int interval) override {
+        glfwSwapInterval(interval);
+    }
+
+    void reload_assets() override {
+        if (!loader) {
+            clog << "Warning: No loader context to stream assets on" << endl;
+            return;
+        }
+        stream_assets();
+    }
+
+    bool update_assets() override {
+        if (watcher) {
+            for (size_t i : watcher->changed()) {
+                request(assets[i]);
+            }
+        }
+        feed_loader();
+        return swap_in_streamed_assets();
+    }
+
+    void report_stats(ostream &out) override {
+        timer.report(out, "GL");
+        if (scene.uniforms.stalls > 0) {
+            out << "Waited on the GPU for uniform buffer slots " << scene.uniforms.stalls << " times" << endl;
+        }
+        if (dynamicResolution) {
+            out << "Render scale " << scaler.scale() << " (" << renderWidth << "x" << renderHeight << "), "
+                << scaler.last_gpu_ms() << " ms GPU" << endl;
+        }
+    }
+
+private:
+    void stream_assets() {
+        for (auto &a : assets) {
+            request(a);
+        }
+        feed_loader();
+    }
+
+    // Queued here rather than dropped while the loader is behind, which a
+    // scene with more files than its queue would always be at first.
+    void request(const AssetRequest &asset) {
+        auto same = [&](const AssetRequest &a) { return a.mesh == asset.mesh && a.index == asset.index; };
+        if (any_of(waiting.begin(), waiting.end(), same)) {
+            return;
+        }
+        if (streaming == 0) {
+            streamStart = chrono::steady_clock::now();
+        }
+        waiting.push_back(asset);
+        ++streaming;
+    }
+
+    void feed_loader() {
+        while (!waiting.empty()) {
+            AssetRequest next = waiting.front();
+            if (!loader->request(next)) {
+                break;
+            }
+            waiting.pop_front();
+        }
+    }
+
+    bool swap_in_streamed_assets() {
+        bool rv = false;
+        StreamedAsset a;
+        while (loader && loader->poll(a)) {
+            if (a.vbo != 0) {
+                replace_scene_mesh(scene, a.asset.index, a.vbo, a.num_tris);
+                rv = true;
+            } else if (a.texture.handle != 0) {
+                replace_scene_texture(scene, a.asset.index, a.texture);
+                rv = true;
+            } else if (!a.patch.empty()) {
+                if (a.rows > 0) {
+                    patch_scene_texture(scene, a.asset.index, a.first_row, a.rows, a.patch.data());
+                } else {
+                    patch_scene_mesh(scene, a.asset.index, a.ranges, a.patch.data());
+                }
+                clog << "Updated " << a.patch.size() << " bytes of \"" << a.asset.path << "\" in place"
+                     << endl;
+                rv = true;
+            }
+            if (--streaming == 0) {
+                clog << "Streamed assets in after "
+                     << chrono::duration<double, milli>(chrono::steady_clock::now() - streamStart).count() << " ms"
+                     << endl;
+            }
+        }
+        return rv;
+    }
+
+    GLFWwindow *window;
+    FrameCapture *capture;
+    AntiAliasing aa;
+    bool dynamicResolution = false;
+    bool offscreen = false;
+    int sceneSamples = 0;
+
+    Scene scene;
+    RenderTarget sceneTarget;
+    RenderTarget resolveTarget;
+    FxaaPass fxaa;
+    GpuTimer gpuTimer;
+    ResolutionScaler scaler;
+    int renderWidth = 0;
+    int renderHeight = 0;
+    SubmitTimer timer;
+    unique_ptr<AssetLoader> loader;
+    unique_ptr<FileWatcher> watcher;
+    // Every mesh and texture of the scene, in the order a watcher reports.
+    vector<AssetRequest> assets;
+    // Requested but not yet taken by the loader.
+    deque<AssetRequest> waiting;
+    // Requests not swapped in yet, and when the first of them was made.
+    int streaming = 0;
+    chrono::steady_clock::time_point streamStart;
+};
+}
+
+unique_ptr<RenderBackend> create_gl_backend(GLFWwindow *window, const Options &options, JobSystem &jobs,
+                                            const AssetCache *cache, FrameCapture *capture,
+                                            const SceneDescription *description) {
+    return make_unique<GlBackend>(window, options, jobs, cache, capture, description);
+}
+
+double measure_gl_submit(JobSystem &jobs, int draws, int frames) {
+    SceneDescription description = default_scene_description();
+    SceneInstance flame = description.instances[1];
+    description.instances.assign(draws, flame);
+    Scene scene = load_scene(jobs, description);
+    RenderTarget target = create_render_target(64, 64);
+    glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+    glViewport(0, 0, target.width, target.height);
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
+    glClearDepth(1.f);
+
+    SceneParams params = default_scene_params();
+    draw_scene(scene, params);
+    glFinish();
+    double total = 0;
+    for (int i = 0; i < frames; ++i) {
+        auto start = chrono::steady_clock::now();
+        draw_scene(scene, params);
+        glFlush();
+        total += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        glFinish();
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    destroy_render_target(target);
+    destroy_scene(scene);
+    return total / frames;
+}
@@ -0,0 +1,17 @@
+#include "glext.hpp"
+
+#include <glad/glad.h>
+
+#include <cstring>
+
+bool has_gl_extension(const char *name) {
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; ++i) {
+        auto ext = reinterpret_cast<const char *>(glGetStringi(GL_EXTENSIONS, i));
+        if (ext && strcmp(ext, name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,4 @@
+#pragma once
+
+// True if the current context advertises the named extension.
+bool has_gl_extension(const char *name);
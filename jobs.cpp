@@ -0,0 +1,192 @@
+#include "jobs.hpp"
+
+using namespace std;
+
+namespace {
+thread_local const JobSystem *tls_owner = nullptr;
+thread_local int tls_worker = -1;
+}
+
+JobSystem::JobSystem(unsigned num_workers) {
+    if (num_workers == 0) {
+        unsigned hw = thread::hardware_concurrency();
+        num_workers = hw > 1 ? hw - 1 : 1;
+    }
+
+    for (unsigned i = 0; i < num_workers; ++i) {
+        queues.push_back(make_unique<Queue>());
+    }
+    for (unsigned i = 0; i < num_workers; ++i) {
+        workers.emplace_back([this, i] { worker_main(i); });
+    }
+}
+
+JobSystem::~JobSystem() {
+    quit = true;
+    notify(true);
+    for (auto &t : workers) {
+        t.join();
+    }
+}
+
+JobHandle JobSystem::run(function<void()> fn, const vector<JobHandle> &deps) {
+    auto job = make_shared<Job>();
+    job->fn = move(fn);
+
+    for (auto &dep : deps) {
+        lock_guard<mutex> lock(dep->mutex);
+        if (!dep->done) {
+            ++job->pending;
+            dep->continuations.push_back(job);
+        }
+    }
+
+    release(job);
+    return job;
+}
+
+void JobSystem::wait(const JobHandle &job) {
+    wait_done(job);
+    if (job->error) {
+        rethrow_exception(job->error);
+    }
+}
+
+void JobSystem::wait_all(const vector<JobHandle> &jobs) {
+    drain(jobs);
+    for (auto &job : jobs) {
+        if (job->error) {
+            rethrow_exception(job->error);
+        }
+    }
+}
+
+void JobSystem::drain(const vector<JobHandle> &jobs) noexcept {
+    for (auto &job : jobs) {
+        wait_done(job);
+    }
+}
+
+void JobSystem::wait_done(const JobHandle &job) {
+    while (!job->done) {
+        if (auto next = pop_or_steal()) {
+            execute(next);
+            continue;
+        }
+        unique_lock<mutex> lock(sleep_mutex);
+        ++sleepers;
+        sleep_cv.wait(lock, [&] { return job->done || queued > 0; });
+        --sleepers;
+    }
+}
+
+void JobSystem::push(JobHandle job) {
+    unsigned index;
+    if (tls_owner == this) {
+        index = tls_worker;
+    } else {
+        index = next_queue++ % queues.size();
+    }
+
+    {
+        auto &q = *queues[index];
+        lock_guard<mutex> lock(q.mutex);
+        q.jobs.push_back(move(job));
+    }
+    ++queued;
+    notify(false);
+}
+
+void JobSystem::release(const JobHandle &job) {
+    if (--job->pending == 0) {
+        push(job);
+    }
+}
+
+JobHandle JobSystem::pop_or_steal() {
+    if (queued == 0) {
+        return nullptr;
+    }
+
+    int n = queues.size();
+    int self = tls_owner == this ? tls_worker : -1;
+
+    if (self >= 0) {
+        auto &q = *queues[self];
+        lock_guard<mutex> lock(q.mutex);
+        if (!q.jobs.empty()) {
+            auto job = move(q.jobs.back());
+            q.jobs.pop_back();
+            --queued;
+            return job;
+        }
+    }
+
+    int start = self >= 0 ? self + 1 : int(next_queue % n);
+    for (int i = 0; i < n; ++i) {
+        int victim = (start + i) % n;
+        if (victim == self) {
+            continue;
+        }
+        auto &q = *queues[victim];
+        lock_guard<mutex> lock(q.mutex);
+        if (!q.jobs.empty()) {
+            auto job = move(q.jobs.front());
+            q.jobs.pop_front();
+            --queued;
+            return job;
+        }
+    }
+
+    return nullptr;
+}
+
+void JobSystem::execute(const JobHandle &job) {
+    try {
+        job->fn();
+    } catch (...) {
+        job->error = current_exception();
+    }
+    job->fn = nullptr;
+
+    vector<JobHandle> continuations;
+    {
+        lock_guard<mutex> lock(job->mutex);
+        job->done = true;
+        continuations.swap(job->continuations);
+    }
+    notify(true);
+
+    for (auto &next : continuations) {
+        release(next);
+    }
+}
+
+void JobSystem::worker_main(int index) {
+    tls_owner = this;
+    tls_worker = index;
+
+    while (!quit) {
+        if (auto job = pop_or_steal()) {
+            execute(job);
+            continue;
+        }
+        unique_lock<mutex> lock(sleep_mutex);
+        ++sleepers;
+        sleep_cv.wait(lock, [&] { return quit || queued > 0; });
+        --sleepers;
+    }
+}
+
+void JobSystem::notify(bool all) {
+    if (sleepers == 0) {
+        return;
+    }
+    // Taking the lock orders this wakeup after a sleeper's predicate check.
+    { lock_guard<mutex> lock(sleep_mutex); }
+    if (all) {
+        sleep_cv.notify_all();
+    } else {
+        sleep_cv.notify_one();
+    }
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct Job {
+    std::function<void()> fn;
+    std::atomic<int> pending{1};
+    std::atomic<bool> done{false};
+    std::exception_ptr error;
+    std::mutex mutex;
+    std::vector<std::shared_ptr<Job>> continuations;
+};
+
+using JobHandle = std::shared_ptr<Job>;
+
+// Work-stealing scheduler. Each worker owns a deque: it pushes and pops at the
+// back, idle workers steal from the front of everyone else's. Threads that
+// block in wait() run queued jobs instead of sleeping.
+class JobSystem {
+public:
+    explicit JobSystem(unsigned num_workers = 0);
+    JobSystem(const JobSystem &) = delete;
+    JobSystem &operator=(const JobSystem &) = delete;
+    ~JobSystem();
+
+    // Queues fn to run once every job in deps has finished.
+    JobHandle run(std::function<void()> fn, const std::vector<JobHandle> &deps = {});
+
+    // Blocks until job is done, rethrowing anything it threw.
+    void wait(const JobHandle &job);
+    // Blocks until every job is done, then rethrows the first error among
+    // them, so none is still running once this returns.
+    void wait_all(const std::vector<JobHandle> &jobs);
+    // As wait_all, dropping errors; for unwinding.
+    void drain(const std::vector<JobHandle> &jobs) noexcept;
+
+    // Calls fn(lo, hi) over [first, last) in chunks of at most grain.
+    template <typename F>
+    void parallel_for(int first, int last, int grain, const F &fn);
+
+    unsigned num_workers() const { return unsigned(workers.size()); }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<JobHandle> jobs;
+    };
+
+    void wait_done(const JobHandle &job);
+    void push(JobHandle job);
+    void release(const JobHandle &job);
+    JobHandle pop_or_steal();
+    void execute(const JobHandle &job);
+    void worker_main(int index);
+    void notify(bool all);
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<unsigned> next_queue{0};
+    std::atomic<int> queued{0};
+    std::atomic<int> sleepers{0};
+    std::atomic<bool> quit{false};
+    std::mutex sleep_mutex;
+    std::condition_variable sleep_cv;
+};
+
+// Drains jobs when the scope holding it is left, as by an exception thrown
+// before their wait, so jobs writing to the scope's locals never outlive
+// them. Declare it after those locals and jobs.
+class JobDrain {
+public:
+    JobDrain(JobSystem &jobs, const std::vector<JobHandle> &handles) : jobs(jobs), handles(handles) {}
+    JobDrain(const JobDrain &) = delete;
+    JobDrain &operator=(const JobDrain &) = delete;
+    ~JobDrain() { jobs.drain(handles); }
+
+private:
+    JobSystem &jobs;
+    const std::vector<JobHandle> &handles;
+};
+
+template <typename F>
+void JobSystem::parallel_for(int first, int last, int grain, const F &fn) {
+    if (last <= first) {
+        return;
+    }
+    grain = std::max(grain, 1);
+
+    std::vector<JobHandle> chunks;
+    chunks.reserve((last - first + grain - 1) / grain);
+    JobDrain drain(*this, chunks);
+    for (int lo = first; lo < last; lo += grain) {
+        int hi = std::min(lo + grain, last);
+        chunks.push_back(run([&fn, lo, hi] { fn(lo, hi); }));
+    }
+    wait_all(chunks);
+}
@@ -0,0 +1,202 @@
+#include "loader.hpp"
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+const size_t max_pending_requests = 16;
+// Vertex bytes compared at a time; changed neighbours merge into one range.
+const size_t diff_block = 4096;
+
+// Fills a new buffer with write, which gets it mapped.
+template <typename Fn>
+GLuint upload_mesh(int num_tris, Fn write) {
+    GLuint rv = create_mesh_buffer(num_tris);
+    try {
+        write(map_mesh_buffer(rv, num_tris));
+        unmap_mesh_buffer(rv);
+    } catch (...) {
+        glDeleteBuffers(1, &rv);
+        throw;
+    }
+    return rv;
+}
+
+// The blocks where next differs from old, into ranges and patch. Gives up,
+// returning false, once the patch would pass limit bytes.
+bool diff_bytes(const unsigned char *old, const unsigned char *next, size_t size, size_t limit,
+                vector<BufferRange> &ranges, vector<unsigned char> &patch) {
+    for (size_t offset = 0; offset < size; offset += diff_block) {
+        size_t n = min(diff_block, size - offset);
+        if (memcmp(old + offset, next + offset, n) == 0) {
+            continue;
+        }
+        if (patch.size() + n > limit) {
+            return false;
+        }
+        if (!ranges.empty() && size_t(ranges.back().offset + ranges.back().size) == offset) {
+            ranges.back().size += n;
+        } else {
+            ranges.push_back({GLintptr(offset), GLsizeiptr(n)});
+        }
+        patch.insert(patch.end(), next + offset, next + offset + n);
+    }
+    return true;
+}
+}
+
+AssetLoader::AssetLoader(GLFWwindow *share, bool incremental)
+        : requests(max_pending_requests), incremental(incremental) {
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    context = glfwCreateWindow(1, 1, "Shader Sandy loader", nullptr, share);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+    if (!context) {
+        throw runtime_error("Unable to create a shared context for loading");
+    }
+    thread = std::thread([this] { run(); });
+}
+
+AssetLoader::~AssetLoader() {
+    requests.close();
+    thread.join();
+    for (auto &a : loaded) {
+        glDeleteSync(a.fence);
+        glDeleteBuffers(1, &a.vbo);
+        glDeleteTextures(1, &a.texture.handle);
+    }
+    glfwDestroyWindow(context);
+}
+
+bool AssetLoader::request(AssetRequest &asset) {
+    return requests.try_push(asset);
+}
+
+bool AssetLoader::poll(StreamedAsset &out) {
+    lock_guard<std::mutex> lock(mutex);
+    if (loaded.empty()) {
+        return false;
+    }
+    GLenum status = glClientWaitSync(loaded.front().fence, 0, 0);
+    if (status == GL_TIMEOUT_EXPIRED) {
+        return false;
+    }
+    if (status == GL_WAIT_FAILED) {
+        throw runtime_error("Waiting on a streamed asset failed");
+    }
+    out = loaded.front();
+    loaded.pop_front();
+    glDeleteSync(out.fence);
+    out.fence = nullptr;
+    return true;
+}
+
+void AssetLoader::run() {
+    glfwMakeContextCurrent(context);
+    AssetRequest asset;
+    while (requests.pop(asset)) {
+        // A failure is still handed over, empty, so the caller can tell the
+        // request is done.
+        StreamedAsset a;
+        a.asset = asset;
+        try {
+            a = incremental ? load_incremental(asset) : load(asset);
+        } catch (const exception &e) {
+            clog << "Warning: Unable to stream \"" << asset.path << "\": " << e.what() << endl;
+        }
+        // Flushed, so the fence reaches the GPU without the drawing context
+        // having to wait on this one.
+        a.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
+        {
+            lock_guard<std::mutex> lock(mutex);
+            loaded.push_back(move(a));
+        }
+        // Wakes a viewer idling in glfwWaitEvents to pick it up.
+        glfwPostEmptyEvent();
+    }
+    glfwMakeContextCurrent(nullptr);
+}
+
+StreamedAsset AssetLoader::load(const AssetRequest &asset) {
+    StreamedAsset rv;
+    rv.asset = asset;
+    const string &path = asset.path;
+    if (asset.mesh) {
+        ObjSource src = scan_obj(path);
+        if (src.num_tris == 0) {
+            throw runtime_error("no triangles");
+        }
+        rv.vbo = upload_mesh(src.num_tris, [&](GLfloat *out) { write_obj_vertices(src, out); });
+        rv.num_tris = src.num_tris;
+    } else {
+        rv.texture = load_texture(decode_png(path));
+        if (rv.texture.handle == 0) {
+            throw runtime_error("no image");
+        }
+    }
+    return rv;
+}
+
+// Anything that changes the triangle count or image size, or more than half
+// of the bytes, is uploaded whole into a new object as load() would.
+StreamedAsset AssetLoader::load_incremental(const AssetRequest &asset) {
+    StreamedAsset rv;
+    rv.asset = asset;
+    auto &residents = asset.mesh ? residentMeshes : residentTextures;
+    if (size_t(asset.index) >= residents.size()) {
+        residents.resize(asset.index + 1);
+    }
+    Resident &r = residents[asset.index];
+    const string &path = asset.path;
+    if (asset.mesh) {
+        ObjData obj = parse_obj(path);
+        if (obj.num_tris == 0) {
+            throw runtime_error("no triangles");
+        }
+        size_t size = obj.data.size() * sizeof(GLfloat);
+        if (obj.num_tris != r.num_tris ||
+            !diff_bytes(reinterpret_cast<const unsigned char *>(r.vertices.data()),
+                        reinterpret_cast<const unsigned char *>(obj.data.data()), size, size / 2, rv.ranges,
+                        rv.patch)) {
+            rv.ranges.clear();
+            rv.patch.clear();
+            rv.vbo = upload_mesh(obj.num_tris, [&](GLfloat *out) { memcpy(out, obj.data.data(), size); });
+            rv.num_tris = obj.num_tris;
+        }
+        r.vertices = move(obj.data);
+        r.num_tris = obj.num_tris;
+    } else {
+        Image image = decode_png(path);
+        if (image.pixels.empty()) {
+            throw runtime_error("no image");
+        }
+        bool fits = image.width == r.image.width && image.height == r.image.height;
+        size_t stride = size_t(image.width) * 4;
+        auto row_changed = [&](unsigned y) {
+            return memcmp(&image.pixels[y * stride], &r.image.pixels[y * stride], stride) != 0;
+        };
+        unsigned first = 0, last = fits ? image.height : 0;
+        while (first < last && !row_changed(first)) {
+            ++first;
+        }
+        while (last > first && !row_changed(last - 1)) {
+            --last;
+        }
+        if (!fits || (last - first) * 2 > image.height) {
+            rv.texture = load_texture(image);
+        } else if (last > first) {
+            rv.first_row = first;
+            rv.rows = last - first;
+            rv.patch.assign(image.pixels.begin() + first * stride, image.pixels.begin() + last * stride);
+        }
+        r.image = move(image);
+    }
+    return rv;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "queue.hpp"
+#include "scene.hpp"
+
+#include <glad/glad.h>
+
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct GLFWwindow;
+
+// A mesh or texture of a Scene, by its index there, and the file it comes
+// from.
+struct AssetRequest {
+    bool mesh = true;
+    int index = 0;
+    std::string path;
+};
+
+// A scene asset built on the loader's context. Its commands are done once
+// fence signals; until then the drawing context must not touch it. Nothing
+// is set if loading failed or, for an incremental loader, if nothing
+// changed.
+struct StreamedAsset {
+    AssetRequest asset;
+    // An OBJ, laid out for vao_from_buffer.
+    GLuint vbo = 0;
+    int num_tris = 0;
+    // A PNG.
+    Texture texture;
+    // Or, for a reload that fits what the drawing context already has, the
+    // bytes that changed, end to end in patch: ranges of the vertex buffer,
+    // or rows of the texture from first_row.
+    std::vector<BufferRange> ranges;
+    int first_row = 0;
+    int rows = 0;
+    std::vector<unsigned char> patch;
+    GLsync fence = nullptr;
+};
+
+// Parses, uploads and creates buffers and textures on a thread of its own,
+// with a hidden context shared with the window's, so the render thread only
+// swaps finished objects in.
+class AssetLoader {
+public:
+    // On the main thread, which GLFW needs for the hidden window, with
+    // share's context current. Throws if no shared context can be made.
+    //
+    // An incremental loader keeps a copy of each asset it hands over, and
+    // answers a later request for it with a patch when little has changed.
+    // The drawing context has to apply everything it is handed, in order.
+    explicit AssetLoader(GLFWwindow *share, bool incremental = false);
+    AssetLoader(const AssetLoader &) = delete;
+    AssetLoader &operator=(const AssetLoader &) = delete;
+    // Deletes whatever was loaded but never picked up, so share's context
+    // has to be current.
+    ~AssetLoader();
+
+    // Returns false without waiting if the loader is too far behind. Moves
+    // from asset only on success.
+    bool request(AssetRequest &asset);
+
+    // An asset whose fence has signalled, if there is one. Never waits.
+    bool poll(StreamedAsset &out);
+
+private:
+    // What the drawing context has of an asset as of the last hand-over.
+    struct Resident {
+        std::vector<GLfloat> vertices;
+        int num_tris = 0;
+        Image image;
+    };
+
+    void run();
+    StreamedAsset load(const AssetRequest &asset);
+    StreamedAsset load_incremental(const AssetRequest &asset);
+
+    GLFWwindow *context = nullptr;
+    BoundedQueue<AssetRequest> requests;
+    bool incremental;
+    // By index; only the loader thread touches them.
+    std::vector<Resident> residentMeshes;
+    std::vector<Resident> residentTextures;
+    std::mutex mutex;
+    // In completion order; guarded by mutex.
+    std::deque<StreamedAsset> loaded;
+    std::thread thread;
+};
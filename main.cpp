@@ -2,9 +2,25 @@
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
-#include <glm/gtc/type_ptr.hpp>
-#include <lodepng.h>
 
+#include "asset_cache.hpp"
+#include "asset_store.hpp"
+#include "backend.hpp"
+#include "batch.hpp"
+#include "bench.hpp"
+#include "capture.hpp"
+#include "compare.hpp"
+#include "encode.hpp"
+#include "jobs.hpp"
+#include "options.hpp"
+#include "pacing.hpp"
+#include "scene.hpp"
+#include "scene_file.hpp"
+#include "server.hpp"
+#include "sidecar.hpp"
+#include "tiled.hpp"
+
+#include <chrono>
 #include <iostream>
 #include <sstream>
 #include <string>
@@ -15,271 +31,118 @@
 #include <exception>
 #include <vector>
 #include <fstream>
+#include <thread>
+
+#include <unistd.h>
 
 using namespace std;
 using namespace glm;
 
-auto load_file(const string &fname) {
-    ifstream file(fname);
-    string line;
-    vector<string> rv;
-    while (getline(file, line)) {
-        line += "\n";
-        rv.push_back(line);
-    }
-    return rv;
+void error_cb(int error, const char *description) {
+    ostringstream oss;
+    oss << "ERROR " << error << ": " << description << endl;
+    throw runtime_error(oss.str());
 }
 
-auto compile_shader(GLenum type, const vector<string> &file) {
-    GLuint rv = glCreateShader(type);
-    if (rv == 0) {
-        throw runtime_error("Failed to create shader!");
-    }
-
-    vector<const GLchar *> code;
-    code.reserve(file.size());
-    transform(begin(file), end(file), back_inserter(code), [](const auto &line) { return line.data(); });
-
-    glShaderSource(rv, code.size(), &code[0], nullptr);
-
-    glCompileShader(rv);
-
-    GLint result;
-    glGetShaderiv(rv, GL_COMPILE_STATUS, &result);
-    if (result == GL_FALSE) {
-        cerr << "Shader compilation failed!" << endl;
-
-        GLint logLen;
-        glGetShaderiv(rv, GL_INFO_LOG_LENGTH, &logLen);
-
-        if (logLen > 0) {
-            auto log = make_unique<GLchar[]>(logLen);
-            glGetShaderInfoLog(rv, logLen, nullptr, log.get());
+struct ViewerState {
+    // Set whenever the next frame would differ from the one on screen.
+    bool dirty = true;
+    bool paused = false;
+    int swap_interval = -1;
+    bool swap_interval_changed = false;
+    bool reload_assets = false;
+};
 
-            cerr << "Shader compilation log:\n" << log.get() << endl;
-        }
+void key_cb(GLFWwindow *window, int key, int, int action, int) {
+    auto viewer = static_cast<ViewerState *>(glfwGetWindowUserPointer(window));
+    if (key == GLFW_KEY_P && action == GLFW_PRESS) {
+        viewer->paused = !viewer->paused;
     }
-
-    return rv;
-}
-
-auto link_program(GLuint vertex_shader, GLuint frag_shader) {
-    GLuint rv = glCreateProgram();
-    if (rv == 0) {
-        throw runtime_error("Failed to create shader program!");
+    if (key == GLFW_KEY_V && action == GLFW_PRESS) {
+        viewer->swap_interval = viewer->swap_interval == 0 ? 1 : 0;
+        viewer->swap_interval_changed = true;
     }
-
-    glAttachShader(rv, vertex_shader);
-    glAttachShader(rv, frag_shader);
-    glLinkProgram(rv);
-
-    GLint result;
-    glGetProgramiv(rv, GL_LINK_STATUS, &result);
-    if (result == GL_FALSE) {
-        cerr << "Shader link failed!" << endl;
-
-        GLint logLen;
-        glGetProgramiv(rv, GL_INFO_LOG_LENGTH, &logLen);
-
-        if (logLen > 0) {
-            auto log = make_unique<GLchar[]>(logLen);
-            glGetProgramInfoLog(rv, logLen, nullptr, log.get());
-
-            cerr << "Shader compilation log:\n" << log.get() << endl;
-        }
+    if (key == GLFW_KEY_L && action == GLFW_PRESS) {
+        viewer->reload_assets = true;
     }
-
-    return rv;
+    viewer->dirty = true;
 }
 
-struct VAO {
-    GLuint handle = 0;
-    GLuint vbo = 0;
-    int num_tris = 0;
-};
-
-VAO vao_from_obj(const string &fname, GLint posAttrib, GLint uvAttrib, GLint normAttrib) {
-    ifstream file(fname);
-
-    vector<vec3> pos;
-    vector<vec2> uv;
-    vector<vec3> norm;
-    vector<GLfloat> data;
-    int num_tris = 0;
-
-    string line;
-    string word;
-    while (getline(file, line)) {
-        istringstream iss(line);
-        iss >> word;
-        if (word == "v") {
-            vec3 v;
-            iss >> v.x >> v.y >> v.z;
-            pos.push_back(v);
-        } else if (word == "vt") {
-            vec2 v;
-            iss >> v.x >> v.y;
-            uv.push_back(v);
-        } else if (word == "vn") {
-            vec3 v;
-            iss >> v.x >> v.y >> v.z;
-            norm.push_back(v);
-        } else if (word == "f") {
-            string fs[3];
-            iss >> fs[0] >> fs[1] >> fs[2];
-            for (auto &f : fs) {
-                replace(begin(f), end(f), '/', ' ');
-                istringstream fiss(f);
-                int ipos;
-                int iuv;
-                int inorm;
-                fiss >> ipos >> iuv >> inorm;
-                --ipos;
-                --iuv;
-                --inorm;
-                GLfloat vals[] = {
-                        pos[ipos].x,
-                        pos[ipos].y,
-                        pos[ipos].z,
-                        uv[iuv].x,
-                        1.f - uv[iuv].y,
-                        norm[inorm].x,
-                        norm[inorm].y,
-                        norm[inorm].z,
-                };
-                data.insert(end(data), begin(vals), end(vals));
-                ++num_tris;
-            }
-        } else if (word[0] == '#') {
-        } else {
-            clog << "Warning: Unknown OBJ directive \"" << word << "\"" << endl;
-        }
-    }
-
-    VAO vao;
-    glGenBuffers(1, &vao.vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vao.vbo);
-    glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(GLfloat), &data[0], GL_STATIC_DRAW);
-
-    glGenVertexArrays(1, &vao.handle);
-    vao.num_tris = num_tris;
-
-    glBindVertexArray(vao.handle);
-
-    auto stride = sizeof(GLfloat) * (3 + 2 + 3);
-    glEnableVertexAttribArray(posAttrib);
-    glEnableVertexAttribArray(uvAttrib);
-    glEnableVertexAttribArray(normAttrib);
-    glVertexAttribPointer(posAttrib, 3, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<const GLvoid *>(0));
-    glVertexAttribPointer(uvAttrib, 2, GL_FLOAT, GL_FALSE, stride,
-                          reinterpret_cast<const GLvoid *>(sizeof(GLfloat) * 3));
-    glVertexAttribPointer(normAttrib, 3, GL_FLOAT, GL_FALSE, stride,
-                          reinterpret_cast<const GLvoid *>(sizeof(GLfloat) * (3 + 2)));
-
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+void refresh_cb(GLFWwindow *window) {
+    static_cast<ViewerState *>(glfwGetWindowUserPointer(window))->dirty = true;
+}
 
-    clog << "Created vao " << vao.handle << " with " << vao.num_tris << " tris." << endl;
-    return vao;
+void framebuffer_size_cb(GLFWwindow *window, int, int) {
+    static_cast<ViewerState *>(glfwGetWindowUserPointer(window))->dirty = true;
 }
 
-struct Texture {
-    GLuint handle = 0;
-    int width = 0;
-    int height = 0;
+const int control_keys[] = {
+        GLFW_KEY_LEFT, GLFW_KEY_RIGHT, GLFW_KEY_UP, GLFW_KEY_DOWN,
+        GLFW_KEY_W, GLFW_KEY_S, GLFW_KEY_D, GLFW_KEY_A, GLFW_KEY_R, GLFW_KEY_F,
+        GLFW_KEY_KP_8, GLFW_KEY_KP_2, GLFW_KEY_KP_4, GLFW_KEY_KP_6,
+        GLFW_KEY_PAGE_UP, GLFW_KEY_PAGE_DOWN,
 };
 
-Texture load_texture(const string &fname) {
-    std::vector<unsigned char> image;
-    unsigned width, height;
-    unsigned error = lodepng::decode(image, width, height, fname);
-
-    Texture rv;
-
-    if (error != 0) {
-        clog << "Error: Unable to load texture \"" << fname << "\"" << endl;
-        return rv;
+bool scene_animating(GLFWwindow *window, const ViewerState &viewer) {
+    if (!viewer.paused && glfwGetKey(window, GLFW_KEY_SPACE) != GLFW_PRESS) {
+        return true;
     }
-
-    rv.width = width;
-    rv.height = height;
-
-    glGenTextures(1, &rv.handle);
-    glBindTexture(GL_TEXTURE_2D, rv.handle);
-
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, &image[0]);
-
-    glBindTexture(GL_TEXTURE_2D, 0);
-
-    return rv;
+    return any_of(begin(control_keys), end(control_keys),
+                  [&](int key) { return glfwGetKey(window, key) == GLFW_PRESS; });
 }
 
-struct Texture3D {
-    GLuint handle = 0;
-    int width = 0;
-    int height = 0;
-    int depth = 0;
-};
+int main(int argc, char *argv[]) try {
+    auto started = chrono::steady_clock::now();
+    Options options = parse_options(argc, argv);
+    JobSystem jobs(options.threads);
 
-using DitherArr = vector<vector<double>>;
-
-Texture3D gen_dithermap(int width, int height, const vector<DitherArr> &arrs) {
-    std::vector<unsigned char> image;
-    int depth = arrs.size();
-    image.resize(width * height * depth);
-
-    for (int d = 0; d < depth; ++d) {
-        for (int r = 0; r < height; ++r) {
-            for (int c = 0; c < width; ++c) {
-                int i = d * width * height + r * width + c;
-                auto& dm = arrs[depth-d-1];
-                auto& row = dm[r % dm.size()];
-                auto& pix = row[c % row.size()];
-                image[i] = clamp(int(pix * 255), 0, 255);
-            }
-        }
+    if (!options.bench.empty()) {
+        run_benchmarks(options.bench, jobs);
+        return EXIT_SUCCESS;
+    }
+    if (!options.pack_assets.empty()) {
+        write_asset_cache(options.pack_assets, parse_scene_assets(jobs), options.compress_meshes);
+        clog << "Packed assets into \"" << options.pack_assets << "\"" << endl;
+        return EXIT_SUCCESS;
+    }
+    if (!options.asset_store.empty() && options.asset_cache.empty()) {
+        options.asset_cache = store_scene_assets(options.asset_store, jobs, options.compress_meshes);
+    }
+    if (!options.attach_frames.empty()) {
+        return run_frame_sidecar(options.attach_frames, options, jobs);
+    }
+    if (!options.poster.empty()) {
+        return run_tiled_render(options, jobs);
+    }
+    if (!options.serve.empty() && options.renderer == Renderer::vulkan) {
+        return run_vulkan_render_server(options.serve, options, jobs);
+    }
+    if (!options.serve.empty() && options.renderer != Renderer::gl) {
+        return run_cpu_render_server(options.serve, options, jobs);
     }
 
-    Texture3D rv;
-    rv.width = width;
-    rv.height = height;
-    rv.depth = arrs.size();
-
-    glGenTextures(1, &rv.handle);
-    glBindTexture(GL_TEXTURE_3D, rv.handle);
-
-    glTexParameterf(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameterf(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameterf(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-    glTexParameterf(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameterf(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexImage3D(GL_TEXTURE_3D, 0, GL_RED, width, height, depth, 0, GL_RED, GL_UNSIGNED_BYTE, &image[0]);
-
-    glBindTexture(GL_TEXTURE_3D, 0);
-
-    return rv;
-}
-
-void error_cb(int error, const char *description) {
-    ostringstream oss;
-    oss << "ERROR " << error << ": " << description << endl;
-    throw runtime_error(oss.str());
-}
-
-int main() try {
     glfwSetErrorCallback(error_cb);
 
     if (!glfwInit()) {
         throw runtime_error("Failed to init GLFW!");
     }
 
-    glfwWindowHint(GLFW_SAMPLES, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    bool vulkan = options.renderer == Renderer::vulkan;
+    glfwWindowHint(GLFW_SAMPLES, 0);
+    if (vulkan) {
+        glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+    } else {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    }
+    bool serving = !options.serve.empty();
+    bool batch = !options.batch.empty();
+    bool comparing = !options.compare.empty();
+    if (serving || batch || comparing) {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    }
 
     int screenWidth = 800;
     int screenHeight = 600;
@@ -288,227 +151,269 @@ int main() try {
         throw runtime_error("Failed to open window!");
     }
 
-    glfwMakeContextCurrent(window);
-
-    if (!gladLoadGL()) {
-        throw runtime_error("Failed to load GL!");
+    ViewerState viewer;
+    viewer.swap_interval = options.swap_interval;
+    viewer.swap_interval_changed = options.swap_interval >= 0;
+    glfwSetWindowUserPointer(window, &viewer);
+    glfwSetKeyCallback(window, key_cb);
+    glfwSetWindowRefreshCallback(window, refresh_cb);
+    glfwSetFramebufferSizeCallback(window, framebuffer_size_cb);
+
+    if (!vulkan) {
+        glfwMakeContextCurrent(window);
+        if (!gladLoadGL()) {
+            throw runtime_error("Failed to load GL!");
+        }
     }
 
-    glEnable(GL_DEPTH_TEST);
-    glDepthFunc(GL_LESS);
-    glClearDepth(1.f);
-
-    GLuint vertex_shader = compile_shader(GL_VERTEX_SHADER, load_file("data/vertex.glsl"));
-    GLuint frag_shader = compile_shader(GL_FRAGMENT_SHADER, load_file("data/frag.glsl"));
-    GLuint shader = link_program(
-            vertex_shader,
-            frag_shader
-    );
-    glDeleteShader(vertex_shader);
-    glDeleteShader(frag_shader);
-    glUseProgram(shader);
-
-    glUniform1f(glGetUniformLocation(shader, "ScreenWidth"), screenWidth);
-    glUniform1f(glGetUniformLocation(shader, "ScreenHeight"), screenHeight);
-
-    glUniform1i(glGetUniformLocation(shader, "Texture"), 0);
-    glUniform1i(glGetUniformLocation(shader, "DitherMap"), 1);
-
-    VAO mesh = vao_from_obj(
-            "data/kawaii.obj",
-            glGetAttribLocation(shader, "VertexPosition"),
-            glGetAttribLocation(shader, "VertexTexcoord"),
-            glGetAttribLocation(shader, "VertexNormal")
-    );
-
-    VAO flameMesh = vao_from_obj(
-            "data/flame.obj",
-            glGetAttribLocation(shader, "VertexPosition"),
-            glGetAttribLocation(shader, "VertexTexcoord"),
-            glGetAttribLocation(shader, "VertexNormal")
-    );
-
-    Texture meshTexture = load_texture("data/kawaii.png");
-    Texture flameTexture = load_texture("data/flame.png");
-
-    vector<DitherArr> dithers = {
-            DitherArr{{0.0}},
-            DitherArr{
-                    {0.5, 1.0, 0.5, 0.0, 0.0, 0.0},
-                    {1.0, 1.0, 1.0, 0.0, 0.0, 0.0},
-                    {0.5, 1.0, 0.5, 0.0, 0.0, 0.0},
-                    {0.0, 0.0, 0.0, 0.0, 0.0, 0.0},
-                    {0.0, 0.0, 0.0, 0.0, 0.0, 0.0},
-                    {0.0, 0.0, 0.0, 0.0, 0.0, 0.0},
-            },
-            DitherArr{
-                    {0.5, 1.0, 0.5, 0.0, 0.0, 0.0},
-                    {1.0, 1.0, 1.0, 0.0, 0.0, 0.0},
-                    {0.5, 1.0, 0.5, 0.0, 0.0, 0.0},
-                    {0.0, 0.0, 0.0, 0.0, 0.0, 0.0},
-                    {0.0, 0.0, 0.0, 0.0, 0.0, 0.0},
-                    {0.0, 0.0, 0.0, 0.0, 0.0, 0.0},
-            },
-            DitherArr{
-                    {0.5, 1.0, 0.5, 0.5, 0.0, 0.5},
-                    {1.0, 1.0, 1.0, 0.0, 0.0, 0.0},
-                    {0.5, 1.0, 0.5, 0.5, 0.0, 0.5},
-                    {0.5, 0.0, 0.5, 0.5, 1.0, 0.5},
-                    {0.0, 0.0, 0.0, 1.0, 1.0, 1.0},
-                    {0.5, 0.0, 0.5, 0.5, 1.0, 0.5},
-            },
-            DitherArr{
-                    {0.5, 1.0, 0.5, 0.5, 0.0, 0.5},
-                    {1.0, 1.0, 1.0, 0.0, 0.0, 0.0},
-                    {0.5, 1.0, 0.5, 0.5, 0.0, 0.5},
-                    {0.5, 0.0, 0.5, 0.5, 1.0, 0.5},
-                    {0.0, 0.0, 0.0, 1.0, 1.0, 1.0},
-                    {0.5, 0.0, 0.5, 0.5, 1.0, 0.5},
-            },
-            DitherArr{
-                    {1.0, 1.0, 1.0, 1.0, 1.0, 1.0},
-                    {1.0, 1.0, 1.0, 1.0, 1.0, 1.0},
-                    {1.0, 1.0, 1.0, 1.0, 1.0, 1.0},
-                    {0.5, 0.0, 0.5, 1.0, 1.0, 1.0},
-                    {0.0, 0.0, 0.0, 1.0, 1.0, 1.0},
-                    {0.5, 0.0, 0.5, 1.0, 1.0, 1.0},
-            },
-            DitherArr{
-                    {1.0, 1.0, 1.0, 1.0, 1.0, 1.0},
-                    {1.0, 1.0, 1.0, 1.0, 1.0, 1.0},
-                    {1.0, 1.0, 1.0, 1.0, 1.0, 1.0},
-                    {0.5, 0.0, 0.5, 1.0, 1.0, 1.0},
-                    {0.0, 0.0, 0.0, 1.0, 1.0, 1.0},
-                    {0.5, 0.0, 0.5, 1.0, 1.0, 1.0},
-            },
-            DitherArr{{1.0}},
-    };
-    Texture3D ditherMap = gen_dithermap(screenWidth, screenHeight, dithers);
-
-    float fovy = 90.f;
-    mat4 camProj = perspective(fovy, 4.f / 3.f, 0.01f, 100.f);
-    mat4 camView = translate(mat4(1.f), vec3(0.f, -2.f, -6.f));
-    mat4 modelPos = mat4(1.f);
-
-    GLint camProjUniform = glGetUniformLocation(shader, "camProj");
-    GLint camViewUniform = glGetUniformLocation(shader, "camView");
-    GLint modelPosUniform = glGetUniformLocation(shader, "modelPos");
-
-    vec3 lightPos = vec3(5, 3, 1);
-    float lightRadius = 5.f;
-
-    double last_time = glfwGetTime();
-    while (!glfwWindowShouldClose(window)) {
-        double this_time = glfwGetTime();
-        double delta = this_time - last_time;
+    if (batch) {
+        int rv = run_batch(options.batch, window, options, jobs);
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        return rv;
+    }
+    if (comparing) {
+        int rv = run_render_comparison(options, jobs);
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        return rv;
+    }
 
-        glClearColor(1.0f, 0.0f, 1.0f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    AssetCache assetCache;
+    if (!options.asset_cache.empty()) {
+        assetCache = map_asset_cache(options.asset_cache);
+        assetCache.program_store = options.asset_store;
+        if (options.verify_assets) {
+            verify_asset_cache(assetCache);
+        }
+    }
+    const AssetCache *cache = assetCache.base ? &assetCache : nullptr;
+
+    if (serving) {
+        glEnable(GL_DEPTH_TEST);
+        glDepthFunc(GL_LESS);
+        glClearDepth(1.f);
+        Scene scene = load_scene(jobs, cache);
+        int rv = run_render_server(options.serve, scene, options, cache);
+        destroy_scene(scene);
+        unmap_asset_cache(assetCache);
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        return rv;
+    }
 
-        glUniformMatrix4fv(camProjUniform, 1, GL_FALSE, value_ptr(camProj));
-        glUniformMatrix4fv(camViewUniform, 1, GL_FALSE, value_ptr(camView));
+    unique_ptr<SceneDescription> description;
+    if (!options.scene.empty() && vulkan) {
+        clog << "Warning: Only the GL renderer draws --scene; showing the built-in scene" << endl;
+    } else if (!options.scene.empty()) {
+        description = make_unique<SceneDescription>(load_scene_file(options.scene));
+    }
+    float fovy = description ? description->fovy : default_scene_description().fovy;
+    SceneParams params = description ? scene_params(*description) : default_scene_params();
+
+    FramePacer pacer(options.fps_limit, options.pacing_stats);
+
+    FrameCapture capture;
+    unique_ptr<FrameEncoder> encoder;
+    thread captureConsumer;
+    SharedFrameRing sharedFrames;
+    pid_t sidecar = 0;
+    if (options.share_frames) {
+        // Sized for the framebuffer at startup; larger frames after a resize
+        // are dropped.
+        int fbWidth, fbHeight;
+        glfwGetFramebufferSize(window, &fbWidth, &fbHeight);
+        sharedFrames = create_shared_frame_ring(options.capture_ring, size_t(fbWidth) * fbHeight * 4);
+        capture = create_shared_frame_capture(sharedFrames);
+        clog << "Sharing frames at /proc/" << getpid() << "/fd/" << sharedFrames.fd << endl;
+        if (!options.share_exec.empty()) {
+            sidecar = spawn_frame_sidecar(options.share_exec, sharedFrames);
+        }
+    } else if (options.capture) {
+        capture = create_frame_capture(options.capture_ring, 8);
+        if (!options.capture_out.empty()) {
+            EncoderSettings settings;
+            settings.format = options.capture_format;
+            settings.output = options.capture_out;
+            settings.fps = options.capture_fps;
+            settings.max_in_flight = options.encode_jobs;
+            encoder = make_unique<FrameEncoder>(jobs, settings, capture.spare);
+        }
+        // Blocking in encode() backs the frame queue up, which makes the
+        // render thread drop captures instead of waiting.
+        captureConsumer = thread([frames = capture.frames, spare = capture.spare, enc = encoder.get()] {
+            CapturedFrame frame;
+            while (frames->pop(frame)) {
+                if (enc) {
+                    enc->encode(move(frame));
+                } else {
+                    spare->try_push(frame);
+                }
+            }
+        });
+    }
 
-        glUniform3fv(glGetUniformLocation(shader, "LightPos"), 1, value_ptr(lightPos));
-        glUniform1f(glGetUniformLocation(shader, "LightRadius"), lightRadius);
+    unique_ptr<RenderBackend> backend;
+    if (vulkan) {
+        backend = create_vulkan_backend(window, options, jobs, cache);
+    } else {
+        backend = create_gl_backend(window, options, jobs, cache, options.capture ? &capture : nullptr,
+                                    description.get());
+    }
 
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_3D, ditherMap.handle);
+    long long frameIndex = 0;
+    double last_stats_time = glfwGetTime();
 
-        glUniformMatrix4fv(modelPosUniform, 1, GL_FALSE, value_ptr(modelPos));
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, meshTexture.handle);
-        glBindVertexArray(mesh.handle);
-        glDrawArrays(GL_TRIANGLES, 0, mesh.num_tris * 3);
-        glBindVertexArray(0);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, 0);
+    double last_time = glfwGetTime();
+    while (!glfwWindowShouldClose(window)) {
+        if (viewer.swap_interval_changed) {
+            backend->set_swap_interval(viewer.swap_interval);
+            viewer.swap_interval_changed = false;
+            pacer.resync();
+            clog << "Swap interval " << viewer.swap_interval << endl;
+        }
+        if (viewer.reload_assets) {
+            backend->reload_assets();
+            viewer.reload_assets = false;
+        }
+        if (backend->update_assets()) {
+            viewer.dirty = true;
+        }
 
-        glUniformMatrix4fv(modelPosUniform, 1, GL_FALSE,
-                           value_ptr(scale(translate(mat4(1.f), lightPos), vec3(lightRadius / 5.f))));
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, flameTexture.handle);
-        glBindVertexArray(flameMesh.handle);
-        glDrawArrays(GL_TRIANGLES, 0, flameMesh.num_tris * 3);
-        glBindVertexArray(0);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, 0);
+        if (options.on_demand && !viewer.dirty) {
+            glfwWaitEventsTimeout(options.idle_timeout);
+            viewer.dirty = viewer.dirty || scene_animating(window, viewer);
+            pacer.resync();
+            last_time = glfwGetTime();
+            continue;
+        }
 
+        double this_time = glfwGetTime();
+        double delta = this_time - last_time;
 
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_3D, 0);
+        if (options.capture) {
+            poll_frame_capture(capture);
+        }
 
-        glfwSwapBuffers(window);
+        int fbWidth, fbHeight;
+        glfwGetFramebufferSize(window, &fbWidth, &fbHeight);
+        backend->draw_frame(params, fbWidth, fbHeight, frameIndex, this_time);
+        ++frameIndex;
+
+        backend->present();
+        if (frameIndex == 1) {
+            // Assets may still be streaming in; this is how long the window
+            // sat empty. On stdout in the bench format, for scripts to
+            // collect across runs.
+            report("startup/first_frame",
+                   chrono::duration<double, milli>(chrono::steady_clock::now() - started).count(), "ms");
+        }
+        viewer.dirty = false;
+        pacer.end_frame();
         glfwPollEvents();
 
-        if (glfwGetKey(window, GLFW_KEY_SPACE) != GLFW_PRESS) {
-            modelPos = rotate(modelPos, float(delta), vec3(0.f, 1.f, 0.f));
+        if (options.pacing_stats && this_time - last_stats_time >= 1.0) {
+            FrameStats fs = pacer.stats();
+            clog << fs.frames << " frames: " << fs.mean_ms << " ms avg, " << fs.stddev_ms << " ms jitter (stddev), "
+                 << fs.min_ms << "/" << fs.p99_ms << "/" << fs.max_ms << " ms min/p99/max" << endl;
+            backend->report_stats(clog);
+            if (options.capture) {
+                clog << "Captured " << capture.captured << " frames, dropped " << capture.dropped << endl;
+            }
+            pacer.clear_stats();
+            last_stats_time = this_time;
+        }
+
+        if (!viewer.paused && glfwGetKey(window, GLFW_KEY_SPACE) != GLFW_PRESS) {
+            params.model = rotate(params.model, float(delta), vec3(0.f, 1.f, 0.f));
         }
 
         float camSpeed = delta * 2.f;
 
         if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS) {
-            lightPos.x -= camSpeed;
+            params.light_pos.x -= camSpeed;
         }
         if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS) {
-            lightPos.x += camSpeed;
+            params.light_pos.x += camSpeed;
         }
 
         if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS) {
-            lightPos.y += camSpeed;
+            params.light_pos.y += camSpeed;
         }
         if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS) {
-            lightPos.y -= camSpeed;
+            params.light_pos.y -= camSpeed;
         }
 
         if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
-            lightPos.z += camSpeed;
+            params.light_pos.z += camSpeed;
         }
         if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) {
-            lightPos.z -= camSpeed;
+            params.light_pos.z -= camSpeed;
         }
 
         if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) {
-            lightRadius += delta;
+            params.light_radius += delta;
         }
         if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) {
-            lightRadius -= delta;
+            params.light_radius -= delta;
         }
 
         if (glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS) {
-            modelPos = translate(modelPos, vec3(0,delta,0));
+            params.model = translate(params.model, vec3(0,delta,0));
         }
         if (glfwGetKey(window, GLFW_KEY_F) == GLFW_PRESS) {
-            modelPos = translate(modelPos, vec3(0,-delta,0));
+            params.model = translate(params.model, vec3(0,-delta,0));
         }
 
         if (glfwGetKey(window, GLFW_KEY_KP_8) == GLFW_PRESS) {
-            camView = rotate(camView, float(delta), vec3(1, 0, 0));
+            params.cam_view = rotate(params.cam_view, float(delta), vec3(1, 0, 0));
         }
         if (glfwGetKey(window, GLFW_KEY_KP_2) == GLFW_PRESS) {
-            camView = rotate(camView, -float(delta), vec3(1, 0, 0));
+            params.cam_view = rotate(params.cam_view, -float(delta), vec3(1, 0, 0));
         }
 
         if (glfwGetKey(window, GLFW_KEY_KP_4) == GLFW_PRESS) {
-            camView = rotate(camView, -float(delta), vec3(0, 1, 0));
+            params.cam_view = rotate(params.cam_view, -float(delta), vec3(0, 1, 0));
         }
         if (glfwGetKey(window, GLFW_KEY_KP_6) == GLFW_PRESS) {
-            camView = rotate(camView, float(delta), vec3(0, 1, 0));
+            params.cam_view = rotate(params.cam_view, float(delta), vec3(0, 1, 0));
         }
 
+        // Degrees, at 60 a second, short of where the projection degenerates.
         if (glfwGetKey(window, GLFW_KEY_PAGE_UP) == GLFW_PRESS) {
-            fovy += delta;
+            fovy = min(fovy + 60 * float(delta), 179.f);
         }
         if (glfwGetKey(window, GLFW_KEY_PAGE_DOWN) == GLFW_PRESS) {
-            fovy -= delta;
+            fovy = max(fovy - 60 * float(delta), 1.f);
         }
 
-        camProj = perspective(fovy, 4.f / 3.f, 0.01f, 100.f);
+        params.cam_proj = perspective(radians(fovy), 4.f / 3.f, 0.01f, 100.f);
+
+        if (scene_animating(window, viewer)) {
+            viewer.dirty = true;
+        }
 
         last_time = this_time;
     }
 
-    glDeleteVertexArrays(1, &mesh.handle);
-    glDeleteProgram(shader);
+    if (options.capture) {
+        finish_frame_capture(capture);
+        if (captureConsumer.joinable()) {
+            captureConsumer.join();
+        }
+        if (encoder) {
+            encoder->finish();
+        }
+        destroy_frame_capture(capture);
+    }
+    if (sidecar > 0) {
+        wait_frame_sidecar(sidecar);
+    }
+    if (sharedFrames.header) {
+        close_shared_frame_ring(sharedFrames);
+    }
+    backend.reset();
+    unmap_asset_cache(assetCache);
     glfwDestroyWindow(window);
     glfwTerminate();
 
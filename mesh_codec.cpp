@@ -0,0 +1,365 @@
+#include "mesh_codec.hpp"
+#include "vertex_pipeline.hpp"
+
+#ifdef __SSE2__
+#define SANDY_SSE2
+#include <emmintrin.h>
+#endif
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+const char magic[4] = {'S', 'M', 'Z', '1'};
+const int channels = 8;
+
+struct Header {
+    char magic[4];
+    uint32_t vertices;
+    uint32_t indices;
+    // Sizes before and after the LZ stage.
+    uint32_t index_bytes;
+    uint32_t index_packed;
+    uint32_t vertex_packed;
+};
+
+void check(bool ok) {
+    if (!ok) {
+        throw runtime_error("Malformed encoded mesh");
+    }
+}
+
+uint32_t load32(const unsigned char *p) {
+    uint32_t rv;
+    memcpy(&rv, p, sizeof(rv));
+    return rv;
+}
+
+// LZ4's block layout: a token of literal and match length nibbles, the
+// literals, a 16-bit offset and length extensions in runs of 255. The
+// stream ends on a literal run.
+const size_t min_match = 4;
+const int hash_bits = 16;
+
+void put_length(vector<unsigned char> &out, size_t length) {
+    for (; length >= 255; length -= 255) {
+        out.push_back(255);
+    }
+    out.push_back(static_cast<unsigned char>(length));
+}
+
+void put_sequence(vector<unsigned char> &out, const unsigned char *literals, size_t numLiterals, size_t offset,
+                  size_t matchLength) {
+    size_t matchCode = matchLength - min_match;
+    out.push_back(static_cast<unsigned char>((min<size_t>(numLiterals, 15) << 4) | min<size_t>(matchCode, 15)));
+    if (numLiterals >= 15) {
+        put_length(out, numLiterals - 15);
+    }
+    out.insert(out.end(), literals, literals + numLiterals);
+    out.push_back(static_cast<unsigned char>(offset));
+    out.push_back(static_cast<unsigned char>(offset >> 8));
+    if (matchCode >= 15) {
+        put_length(out, matchCode - 15);
+    }
+}
+
+void put_last_literals(vector<unsigned char> &out, const unsigned char *literals, size_t numLiterals) {
+    out.push_back(static_cast<unsigned char>(min<size_t>(numLiterals, 15) << 4));
+    if (numLiterals >= 15) {
+        put_length(out, numLiterals - 15);
+    }
+    out.insert(out.end(), literals, literals + numLiterals);
+}
+
+vector<unsigned char> lz_compress(const vector<unsigned char> &src) {
+    vector<unsigned char> out;
+    out.reserve(src.size() + src.size() / 255 + 16);
+    vector<int64_t> table(size_t(1) << hash_bits, -1);
+
+    size_t n = src.size();
+    size_t anchor = 0;
+    size_t i = 0;
+    while (i + min_match <= n) {
+        uint32_t seq = load32(&src[i]);
+        uint32_t h = (seq * 2654435761u) >> (32 - hash_bits);
+        int64_t candidate = table[h];
+        table[h] = int64_t(i);
+        if (candidate >= 0 && i - candidate <= 0xffff && load32(&src[candidate]) == seq) {
+            size_t length = min_match;
+            while (i + length < n && src[candidate + length] == src[i + length]) {
+                ++length;
+            }
+            put_sequence(out, &src[anchor], i - anchor, i - candidate, length);
+            i += length;
+            anchor = i;
+        } else {
+            // Speed through stretches that do not compress.
+            i += 1 + ((i - anchor) >> 6);
+        }
+    }
+    put_last_literals(out, src.data() + anchor, n - anchor);
+    return out;
+}
+
+size_t get_length(const unsigned char *&ip, const unsigned char *end) {
+    size_t rv = 0;
+    unsigned char b;
+    do {
+        check(ip < end);
+        b = *ip++;
+        rv += b;
+    } while (b == 255);
+    return rv;
+}
+
+void lz_decompress(const unsigned char *src, size_t size, unsigned char *dst, size_t dstSize) {
+    const unsigned char *ip = src;
+    const unsigned char *end = src + size;
+    unsigned char *op = dst;
+    unsigned char *dstEnd = dst + dstSize;
+    // Most sequences are a few literals and a short match. Away from the
+    // ends of both buffers those are copied 16 bytes at a time, spilling
+    // into bytes that later sequences overwrite; the rest go byte-exact.
+    while (ip < end) {
+        unsigned token = *ip++;
+        size_t numLiterals = token >> 4;
+        if (numLiterals < 15 && end - ip >= 16 && dstEnd - op >= 16) {
+            memcpy(op, ip, 16);
+        } else {
+            if (numLiterals == 15) {
+                numLiterals += get_length(ip, end);
+            }
+            check(numLiterals <= size_t(end - ip) && numLiterals <= size_t(dstEnd - op));
+            // An empty mesh leaves dst null, with nothing to copy.
+            if (numLiterals > 0) {
+                memcpy(op, ip, numLiterals);
+            }
+        }
+        op += numLiterals;
+        ip += numLiterals;
+        if (ip == end) {
+            break;
+        }
+
+        check(end - ip >= 2);
+        size_t offset = ip[0] | size_t(ip[1]) << 8;
+        ip += 2;
+        size_t length = (token & 15) + min_match;
+        if ((token & 15) == 15) {
+            length += get_length(ip, end);
+        }
+        check(offset > 0 && offset <= size_t(op - dst) && length <= size_t(dstEnd - op));
+        const unsigned char *match = op - offset;
+        if (offset >= 16 && size_t(dstEnd - op) >= length + 16) {
+            // Each 16 bytes read were written before this copy began.
+            unsigned char *stop = op + length;
+            for (; op < stop; op += 16, match += 16) {
+                memcpy(op, match, 16);
+            }
+            op = stop;
+            continue;
+        }
+        if (offset >= 8) {
+            // Eight bytes at a time never reads what this copy is writing.
+            for (; length >= 8; length -= 8, op += 8, match += 8) {
+                memcpy(op, match, 8);
+            }
+        }
+        while (length-- > 0) {
+            *op++ = *match++;
+        }
+    }
+    check(op == dstEnd);
+}
+
+void put_varint(vector<unsigned char> &out, uint32_t v) {
+    while (v >= 0x80) {
+        out.push_back(static_cast<unsigned char>(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<unsigned char>(v));
+}
+
+// Bit patterns of the channel of every vertex, as integer deltas, split
+// into four planes of low to high bytes.
+void filter_channel(const vector<float> &channel, size_t vertices, unsigned char *planes) {
+    uint32_t previous = 0;
+    for (size_t i = 0; i < vertices; ++i) {
+        uint32_t bits;
+        memcpy(&bits, &channel[i], sizeof(bits));
+        uint32_t delta = bits - previous;
+        previous = bits;
+        for (int b = 0; b < 4; ++b) {
+            planes[b * vertices + i] = static_cast<unsigned char>(delta >> (8 * b));
+        }
+    }
+}
+
+// Vertices [first, last) of every channel into out interleaved, carrying
+// on from the bit patterns of the vertex before first.
+void unfilter_vertices(const unsigned char *planes, size_t vertices, size_t first, size_t last, uint32_t *bits,
+                       GLfloat *out) {
+    for (size_t i = first; i < last; ++i) {
+        for (int c = 0; c < channels; ++c) {
+            const unsigned char *p = planes + c * 4 * vertices + i;
+            bits[c] += p[0] | uint32_t(p[vertices]) << 8 | uint32_t(p[2 * vertices]) << 16 |
+                       uint32_t(p[3 * vertices]) << 24;
+            memcpy(&out[i * channels + c], &bits[c], sizeof(bits[c]));
+        }
+    }
+}
+
+#ifdef SANDY_SSE2
+// Sixteen vertices at a time: per channel the byte planes are interleaved
+// back into deltas and prefix summed, then 4x4 transposes interleave the
+// channels. Returns how many vertices it did.
+size_t unfilter_sse2(const unsigned char *planes, size_t vertices, uint32_t *bits, GLfloat *out) {
+    __m128i sums[channels];
+    for (int c = 0; c < channels; ++c) {
+        sums[c] = _mm_set1_epi32(int(bits[c]));
+    }
+    size_t i = 0;
+    for (; i + 16 <= vertices; i += 16) {
+        __m128 block[channels][4];
+        for (int c = 0; c < channels; ++c) {
+            const unsigned char *p = planes + c * 4 * vertices + i;
+            __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+            __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + vertices));
+            __m128i b2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 2 * vertices));
+            __m128i b3 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 3 * vertices));
+            __m128i low = _mm_unpacklo_epi8(b0, b1);
+            __m128i high = _mm_unpackhi_epi8(b0, b1);
+            __m128i low2 = _mm_unpacklo_epi8(b2, b3);
+            __m128i high2 = _mm_unpackhi_epi8(b2, b3);
+            __m128i deltas[4] = {_mm_unpacklo_epi16(low, low2), _mm_unpackhi_epi16(low, low2),
+                                 _mm_unpacklo_epi16(high, high2), _mm_unpackhi_epi16(high, high2)};
+            for (int k = 0; k < 4; ++k) {
+                __m128i x = deltas[k];
+                x = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+                x = _mm_add_epi32(x, _mm_slli_si128(x, 8));
+                x = _mm_add_epi32(x, sums[c]);
+                sums[c] = _mm_shuffle_epi32(x, 0xff);
+                block[c][k] = _mm_castsi128_ps(x);
+            }
+        }
+        // Shuffles only move bits, so NaN patterns come through intact.
+        for (int k = 0; k < 4; ++k) {
+            for (int c = 0; c < channels; c += 4) {
+                __m128 r0 = block[c][k];
+                __m128 r1 = block[c + 1][k];
+                __m128 r2 = block[c + 2][k];
+                __m128 r3 = block[c + 3][k];
+                _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+                GLfloat *o = out + (i + 4 * k) * channels + c;
+                _mm_storeu_ps(o, r0);
+                _mm_storeu_ps(o + channels, r1);
+                _mm_storeu_ps(o + 2 * channels, r2);
+                _mm_storeu_ps(o + 3 * channels, r3);
+            }
+        }
+    }
+    for (int c = 0; c < channels; ++c) {
+        bits[c] = uint32_t(_mm_cvtsi128_si32(sums[c]));
+    }
+    return i;
+}
+#endif
+}
+
+vector<unsigned char> encode_mesh(const MeshView &mesh) {
+    IndexedMesh indexed = index_mesh(mesh);
+    size_t vertices = indexed.vertices;
+
+    vector<unsigned char> indexBytes;
+    indexBytes.reserve(indexed.indices.size() * 2);
+    uint32_t previous = 0;
+    for (uint32_t index : indexed.indices) {
+        uint32_t delta = index - previous;
+        previous = index;
+        put_varint(indexBytes, (delta << 1) ^ (0u - (delta >> 31)));
+    }
+
+    vector<unsigned char> planes(vertices * channels * 4);
+    const vector<float> *components[channels] = {&indexed.px, &indexed.py, &indexed.pz, &indexed.u,
+                                                 &indexed.v, &indexed.nx, &indexed.ny, &indexed.nz};
+    for (int c = 0; c < channels; ++c) {
+        filter_channel(*components[c], vertices, planes.data() + c * vertices * 4);
+    }
+
+    vector<unsigned char> indexPacked = lz_compress(indexBytes);
+    vector<unsigned char> vertexPacked = lz_compress(planes);
+
+    Header header;
+    memcpy(header.magic, magic, sizeof(magic));
+    header.vertices = uint32_t(vertices);
+    header.indices = uint32_t(indexed.indices.size());
+    header.index_bytes = uint32_t(indexBytes.size());
+    header.index_packed = uint32_t(indexPacked.size());
+    header.vertex_packed = uint32_t(vertexPacked.size());
+
+    vector<unsigned char> rv(sizeof(header));
+    memcpy(rv.data(), &header, sizeof(header));
+    rv.insert(rv.end(), indexPacked.begin(), indexPacked.end());
+    rv.insert(rv.end(), vertexPacked.begin(), vertexPacked.end());
+    return rv;
+}
+
+namespace {
+Header read_header(const unsigned char *data, size_t size) {
+    Header rv;
+    check(size >= sizeof(rv));
+    memcpy(&rv, data, sizeof(rv));
+    check(memcmp(rv.magic, magic, sizeof(magic)) == 0 &&
+          uint64_t(rv.index_packed) + rv.vertex_packed == size - sizeof(rv));
+    return rv;
+}
+}
+
+size_t decoded_mesh_floats(const unsigned char *data, size_t size) {
+    return size_t(read_header(data, size).indices) * channels;
+}
+
+void decode_mesh(const unsigned char *data, size_t size, GLfloat *out) {
+    Header header = read_header(data, size);
+    const unsigned char *indexPacked = data + sizeof(header);
+    const unsigned char *vertexPacked = indexPacked + header.index_packed;
+    size_t vertices = header.vertices;
+
+    vector<unsigned char> planes(vertices * channels * 4);
+    lz_decompress(vertexPacked, header.vertex_packed, planes.data(), planes.size());
+    // Interleaved again, so each index below is one 32-byte copy.
+    vector<GLfloat> unique(vertices * channels);
+    uint32_t bits[channels] = {};
+    size_t done = 0;
+#ifdef SANDY_SSE2
+    done = unfilter_sse2(planes.data(), vertices, bits, unique.data());
+#endif
+    unfilter_vertices(planes.data(), vertices, done, vertices, bits, unique.data());
+
+    vector<unsigned char> indexBytes(header.index_bytes);
+    lz_decompress(indexPacked, header.index_packed, indexBytes.data(), indexBytes.size());
+    const unsigned char *ip = indexBytes.data();
+    const unsigned char *end = ip + indexBytes.size();
+    uint32_t index = 0;
+    for (uint32_t n = 0; n < header.indices; ++n) {
+        check(ip < end);
+        uint32_t zigzag = *ip++;
+        if (zigzag & 0x80) {
+            zigzag &= 0x7f;
+            for (int shift = 7;; shift += 7) {
+                check(ip < end && shift < 35);
+                unsigned char b = *ip++;
+                zigzag |= uint32_t(b & 0x7f) << shift;
+                if (!(b & 0x80)) {
+                    break;
+                }
+            }
+        }
+        index += (zigzag >> 1) ^ (0u - (zigzag & 1));
+        check(index < vertices);
+        memcpy(out + size_t(n) * channels, &unique[size_t(index) * channels], channels * sizeof(GLfloat));
+    }
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "scene.hpp"
+
+#include <cstddef>
+#include <vector>
+
+// Lossless compression for meshes in parse_obj's unindexed layout, for the
+// asset cache. Vertices are welded, and the index stream is delta and varint
+// coded. Each attribute is delta coded as integer bits against the previous
+// vertex and split into byte planes, so the similar high bytes sit together.
+// Both streams then go through an LZ4-style byte-oriented LZ stage, which is
+// what keeps decoding in the GB/s range.
+
+std::vector<unsigned char> encode_mesh(const MeshView &mesh);
+
+// Floats decode_mesh will write; throws if data is not an encoded mesh.
+size_t decoded_mesh_floats(const unsigned char *data, size_t size);
+
+// Writes the unindexed vertex stream back out, bit-identical to what was
+// encoded. Throws on malformed input rather than writing past out.
+void decode_mesh(const unsigned char *data, size_t size, GLfloat *out);
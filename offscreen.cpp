@@ -0,0 +1,63 @@
+#include "offscreen.hpp"
+
+#include <algorithm>
+
+using namespace std;
+
+OffscreenRenderer create_offscreen_renderer(AntiAliasing aa, int msaa_samples, const AssetCache *cache) {
+    OffscreenRenderer rv;
+    rv.aa = aa;
+    rv.samples = aa == AntiAliasing::msaa ? msaa_samples : 0;
+    if (aa == AntiAliasing::fxaa) {
+        rv.fxaa = create_fxaa_pass(cache);
+    }
+    return rv;
+}
+
+void destroy_offscreen_renderer(OffscreenRenderer &renderer) {
+    if (renderer.scene.fbo != 0) {
+        destroy_render_target(renderer.scene);
+    }
+    if (renderer.output.fbo != 0) {
+        destroy_render_target(renderer.output);
+    }
+    if (renderer.fxaa.program != 0) {
+        destroy_fxaa_pass(renderer.fxaa);
+    }
+}
+
+void render_offscreen(OffscreenRenderer &renderer, Scene &scene, const SceneParams &params, int width,
+                      int height) {
+    // Grow only, so alternating request sizes don't reallocate every time.
+    int target_w = max(width, renderer.scene.width);
+    int target_h = max(height, renderer.scene.height);
+    resize_render_target(renderer.scene, target_w, target_h, renderer.samples);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, renderer.scene.fbo);
+    glViewport(0, 0, width, height);
+    draw_scene(scene, params);
+
+    const RenderTarget *result = &renderer.scene;
+    if (renderer.samples > 0 || renderer.aa == AntiAliasing::fxaa) {
+        resize_render_target(renderer.output, target_w, target_h);
+        if (renderer.aa == AntiAliasing::fxaa) {
+            draw_fxaa(renderer.fxaa, renderer.scene, width, height, width, height, renderer.output.fbo);
+        } else {
+            resolve_render_target(renderer.scene, renderer.output, width, height);
+        }
+        result = &renderer.output;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, result->fbo);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+}
+
+void render_offscreen(OffscreenRenderer &renderer, Scene &scene, const SceneParams &params, int width,
+                      int height, vector<unsigned char> &pixels) {
+    render_offscreen(renderer, scene, params, width, height);
+    pixels.resize(size_t(width) * height * 4);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+}
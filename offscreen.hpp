@@ -0,0 +1,33 @@
+#pragma once
+
+#include "options.hpp"
+#include "post.hpp"
+#include "render_target.hpp"
+#include "scene.hpp"
+
+#include <vector>
+
+// Renders the scene into offscreen targets and reads the result back, for
+// modes without a window to present to. Anti-aliasing follows the viewer's
+// --aa settings.
+struct OffscreenRenderer {
+    RenderTarget scene;
+    // Single-sampled copy read back after an MSAA resolve or FXAA.
+    RenderTarget output;
+    FxaaPass fxaa;
+    AntiAliasing aa = AntiAliasing::none;
+    int samples = 0;
+};
+
+// Shaders come from cache when given.
+OffscreenRenderer create_offscreen_renderer(AntiAliasing aa, int msaa_samples, const AssetCache *cache = nullptr);
+void destroy_offscreen_renderer(OffscreenRenderer &renderer);
+
+// Draws one width x height frame and leaves it bound as the read
+// framebuffer, ready for glReadPixels at (0, 0).
+void render_offscreen(OffscreenRenderer &renderer, Scene &scene, const SceneParams &params, int width,
+                      int height);
+
+// render_offscreen followed by a synchronous RGBA8 readback, bottom row first.
+void render_offscreen(OffscreenRenderer &renderer, Scene &scene, const SceneParams &params, int width,
+                      int height, std::vector<unsigned char> &pixels);
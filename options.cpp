@@ -0,0 +1,221 @@
+#include "options.hpp"
+
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+void usage(const char *argv0) {
+    cout << "Usage: " << argv0 << " [options]\n"
+         << "  --threads N        Worker threads for the job system (default: cores - 1)\n"
+         << "  --on-demand        Only redraw when input, animation or assets change\n"
+         << "  --idle-timeout S   Longest sleep between event checks in --on-demand mode (default: 0.5)\n"
+         << "  --swap-interval N  glfwSwapInterval value; V toggles vsync at runtime (default: driver's choice)\n"
+         << "  --fps-limit F      Pace frames to F per second (default: unlimited)\n"
+         << "  --pacing-stats     Print frame time and jitter statistics every second\n"
+         << "  --gpu-budget MS    Scale the render resolution to keep GPU time under MS\n"
+         << "  --min-scale F      Lowest render scale --gpu-budget may pick (default: 0.5)\n"
+         << "  --aa MODE          Anti-aliasing: none, msaa or fxaa (default: msaa)\n"
+         << "  --msaa N           Samples per pixel for --aa msaa (default: 4)\n"
+         << "  --capture          Read every presented frame back asynchronously\n"
+         << "  --capture-ring N   Readback buffers in flight for --capture (default: 3)\n"
+         << "  --capture-out P    Encode captured frames into directory P (png, qoi) or file P (y4m)\n"
+         << "  --capture-format F png, qoi or y4m (default: png)\n"
+         << "  --capture-fps N    Frame rate written into y4m headers (default: 60)\n"
+         << "  --encode-jobs N    Frames encoded at once before capture backs up (default: threads + 1)\n"
+         << "  --share-frames     Publish captured frames to another process through shared memory\n"
+         << "  --share-exec CMD   Run CMD as the --share-frames consumer, e.g. \"shader_sandy --attach-frames -\"\n"
+         << "  --attach-frames P  Consume frames shared by another instance at P (- for SANDY_FRAMES_FD)\n"
+         << "  --serve PATH       Keep the scene loaded and render requests from a Unix socket at PATH\n"
+         << "  --renderer R       gl or vulkan; cpu (rasterizer) and trace (ray tracer) only for --serve and --poster (default: gl)\n"
+         << "  --pipeline-cache P Keep compiled Vulkan pipelines in cache file P between runs\n"
+         << "  --batch FILE       Render the camera path in JSON job FILE headlessly and exit\n"
+         << "  --batch-contexts N GL contexts rendering --batch frames in parallel (default: 1)\n"
+         << "  --asset-cache P    Map shaders and parsed assets from cache file P instead of reading data/\n"
+         << "  --verify-assets    Check every --asset-cache entry against its hash before use\n"
+         << "  --pack-assets P    Write data/ into cache file P for --asset-cache and exit\n"
+         << "  --compress-meshes  Store meshes compressed with --pack-assets, decoded at load\n"
+         << "  --asset-store DIR  Share baked assets and program binaries with other processes through DIR\n"
+         << "  --watch-assets     Reload meshes and textures as they change on disk, uploading only what changed\n"
+         << "  --scene FILE       Draw the JSON scene in FILE in the GL viewer instead of the built-in one\n"
+         << "  --poster WxH       Render one WxH image in tiles across worker processes and exit\n"
+         << "  --poster-out P     File for --poster (default: poster.png; qoi with --capture-format qoi)\n"
+         << "  --tile N           Tile edge length for --poster (default: 2048)\n"
+         << "  --tile-workers N   Render processes for --poster (default: cores)\n"
+         << "  --compare WxH      Render the scene at WxH with GL, the rasterizer and the ray tracer and compare\n"
+         << "  --compare-max PCT  Largest share of differing pixels --compare accepts (default: 0.1)\n"
+         << "  --bench SUITE      Run a microbenchmark suite instead of the viewer (encode, jobs, mesh, raster, submit, trace, vertex)\n"
+         << "  --help             Show this message\n";
+}
+
+template <typename T>
+T parse_value(const string &flag, const string &value) {
+    istringstream iss(value);
+    T rv;
+    if (!(iss >> rv) || !iss.eof()) {
+        throw runtime_error("Invalid value \"" + value + "\" for " + flag);
+    }
+    return rv;
+}
+}
+
+Options parse_options(int argc, char *argv[]) {
+    Options rv;
+
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        auto next = [&]() -> string {
+            if (i + 1 >= argc) {
+                throw runtime_error("Missing value for " + arg);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--threads") {
+            rv.threads = parse_value<unsigned>(arg, next());
+        } else if (arg == "--on-demand") {
+            rv.on_demand = true;
+        } else if (arg == "--idle-timeout") {
+            rv.idle_timeout = parse_value<double>(arg, next());
+        } else if (arg == "--swap-interval") {
+            rv.swap_interval = parse_value<int>(arg, next());
+        } else if (arg == "--fps-limit") {
+            rv.fps_limit = parse_value<double>(arg, next());
+        } else if (arg == "--pacing-stats") {
+            rv.pacing_stats = true;
+        } else if (arg == "--gpu-budget") {
+            rv.gpu_budget = parse_value<double>(arg, next());
+        } else if (arg == "--min-scale") {
+            rv.min_scale = parse_value<double>(arg, next());
+        } else if (arg == "--aa") {
+            string mode = next();
+            if (mode == "none") {
+                rv.aa = AntiAliasing::none;
+            } else if (mode == "msaa") {
+                rv.aa = AntiAliasing::msaa;
+            } else if (mode == "fxaa") {
+                rv.aa = AntiAliasing::fxaa;
+            } else {
+                throw runtime_error("Unknown anti-aliasing mode \"" + mode + "\"");
+            }
+        } else if (arg == "--msaa") {
+            rv.msaa_samples = parse_value<int>(arg, next());
+        } else if (arg == "--capture") {
+            rv.capture = true;
+        } else if (arg == "--capture-ring") {
+            rv.capture_ring = parse_value<int>(arg, next());
+        } else if (arg == "--capture-out") {
+            rv.capture = true;
+            rv.capture_out = next();
+        } else if (arg == "--capture-format") {
+            string format = next();
+            if (format == "png") {
+                rv.capture_format = ImageFormat::png;
+            } else if (format == "qoi") {
+                rv.capture_format = ImageFormat::qoi;
+            } else if (format == "y4m") {
+                rv.capture_format = ImageFormat::y4m;
+            } else {
+                throw runtime_error("Unknown capture format \"" + format + "\"");
+            }
+        } else if (arg == "--capture-fps") {
+            rv.capture_fps = parse_value<int>(arg, next());
+        } else if (arg == "--encode-jobs") {
+            rv.encode_jobs = parse_value<int>(arg, next());
+        } else if (arg == "--share-frames") {
+            rv.capture = true;
+            rv.share_frames = true;
+        } else if (arg == "--share-exec") {
+            rv.capture = true;
+            rv.share_frames = true;
+            rv.share_exec = next();
+        } else if (arg == "--attach-frames") {
+            rv.attach_frames = next();
+        } else if (arg == "--serve") {
+            rv.serve = next();
+        } else if (arg == "--renderer") {
+            string renderer = next();
+            if (renderer == "gl") {
+                rv.renderer = Renderer::gl;
+            } else if (renderer == "vulkan") {
+                rv.renderer = Renderer::vulkan;
+            } else if (renderer == "cpu") {
+                rv.renderer = Renderer::cpu;
+            } else if (renderer == "trace") {
+                rv.renderer = Renderer::trace;
+            } else {
+                throw runtime_error("Unknown renderer \"" + renderer + "\"");
+            }
+        } else if (arg == "--pipeline-cache") {
+            rv.pipeline_cache = next();
+        } else if (arg == "--batch") {
+            rv.batch = next();
+        } else if (arg == "--batch-contexts") {
+            rv.batch_contexts = parse_value<int>(arg, next());
+        } else if (arg == "--asset-cache") {
+            rv.asset_cache = next();
+        } else if (arg == "--verify-assets") {
+            rv.verify_assets = true;
+        } else if (arg == "--pack-assets") {
+            rv.pack_assets = next();
+        } else if (arg == "--compress-meshes") {
+            rv.compress_meshes = true;
+        } else if (arg == "--asset-store") {
+            rv.asset_store = next();
+        } else if (arg == "--watch-assets") {
+            rv.watch_assets = true;
+        } else if (arg == "--scene") {
+            rv.scene = next();
+        } else if (arg == "--poster") {
+            rv.poster = next();
+        } else if (arg == "--poster-out") {
+            rv.poster_out = next();
+        } else if (arg == "--tile") {
+            rv.tile_size = parse_value<int>(arg, next());
+        } else if (arg == "--tile-workers") {
+            rv.tile_workers = parse_value<unsigned>(arg, next());
+        } else if (arg == "--compare") {
+            rv.compare = next();
+        } else if (arg == "--compare-max") {
+            rv.compare_max = parse_value<double>(arg, next());
+        } else if (arg == "--bench") {
+            rv.bench.push_back(next());
+        } else if (arg == "--help" || arg == "-h") {
+            usage(argv[0]);
+            exit(EXIT_SUCCESS);
+        } else {
+            usage(argv[0]);
+            throw runtime_error("Unknown option \"" + arg + "\"");
+        }
+    }
+
+    if (rv.share_frames && !rv.capture_out.empty()) {
+        throw runtime_error("--capture-out belongs to the --share-frames consumer");
+    }
+    if (!rv.poster.empty() && rv.capture_format == ImageFormat::y4m) {
+        throw runtime_error("--poster writes png or qoi, not y4m");
+    }
+    if (rv.renderer == Renderer::vulkan) {
+#ifndef SANDY_VULKAN
+        throw runtime_error("This build has no Vulkan support");
+#endif
+        if (rv.capture || !rv.batch.empty() || rv.gpu_budget > 0 || !rv.compare.empty()) {
+            throw runtime_error("--capture, --share-frames, --batch, --gpu-budget and --compare need --renderer gl");
+        }
+        if (rv.aa == AntiAliasing::fxaa) {
+            throw runtime_error("--renderer vulkan has no FXAA, use --aa msaa");
+        }
+    }
+
+    return rv;
+}
+
+void parse_size(const string &text, int &width, int &height) {
+    char x;
+    istringstream iss(text);
+    if (!(iss >> width >> x >> height) || x != 'x' || !iss.eof() || width <= 0 || height <= 0) {
+        throw runtime_error("Invalid size \"" + text + "\", expected WIDTHxHEIGHT");
+    }
+}
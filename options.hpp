@@ -0,0 +1,70 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+enum class AntiAliasing {
+    none,
+    msaa,
+    fxaa,
+};
+
+enum class Renderer {
+    gl,
+    vulkan,
+    cpu,
+    trace,
+};
+
+enum class ImageFormat {
+    png,
+    qoi,
+    y4m,
+};
+
+struct Options {
+    unsigned threads = 0;
+    bool on_demand = false;
+    double idle_timeout = 0.5;
+    int swap_interval = -1;
+    double fps_limit = 0;
+    bool pacing_stats = false;
+    double gpu_budget = 0;
+    double min_scale = 0.5;
+    AntiAliasing aa = AntiAliasing::msaa;
+    int msaa_samples = 4;
+    bool capture = false;
+    int capture_ring = 3;
+    std::string capture_out;
+    ImageFormat capture_format = ImageFormat::png;
+    int capture_fps = 60;
+    int encode_jobs = 0;
+    bool share_frames = false;
+    std::string share_exec;
+    std::string attach_frames;
+    std::string serve;
+    Renderer renderer = Renderer::gl;
+    std::string pipeline_cache;
+    std::string batch;
+    int batch_contexts = 1;
+    std::string asset_cache;
+    bool verify_assets = false;
+    std::string pack_assets;
+    bool compress_meshes = false;
+    std::string asset_store;
+    bool watch_assets = false;
+    std::string scene;
+    std::string poster;
+    std::string poster_out = "poster.png";
+    int tile_size = 2048;
+    unsigned tile_workers = 0;
+    std::string compare;
+    // Percent of pixels.
+    double compare_max = 0.1;
+    std::vector<std::string> bench;
+};
+
+Options parse_options(int argc, char *argv[]);
+
+// WIDTHxHEIGHT, as --poster and --compare take it.
+void parse_size(const std::string &text, int &width, int &height);
@@ -0,0 +1,109 @@
+#include "pacing.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <thread>
+
+using namespace std;
+
+namespace {
+const chrono::microseconds min_spin_margin{200};
+const chrono::microseconds max_spin_margin{4000};
+}
+
+FramePacer::FramePacer(double target_fps, bool record_stats)
+        : spin_margin(chrono::milliseconds(1)), record_stats(record_stats) {
+    set_target_fps(target_fps);
+}
+
+void FramePacer::set_target_fps(double fps) {
+    if (fps > 0) {
+        period = chrono::duration_cast<clock::duration>(chrono::duration<double>(1.0 / fps));
+    } else {
+        period = clock::duration::zero();
+    }
+    resync();
+}
+
+double FramePacer::target_fps() const {
+    if (period == clock::duration::zero()) {
+        return 0;
+    }
+    return 1.0 / chrono::duration<double>(period).count();
+}
+
+void FramePacer::end_frame() {
+    if (period != clock::duration::zero()) {
+        auto now = clock::now();
+        if (next_deadline == clock::time_point{} || now > next_deadline + period) {
+            // Too far behind to catch up without a burst of short frames.
+            next_deadline = now + period;
+        } else {
+            sleep_until(next_deadline);
+            next_deadline += period;
+        }
+    }
+
+    auto now = clock::now();
+    if (record_stats && has_last_frame) {
+        intervals_ms.push_back(chrono::duration<double, milli>(now - last_frame).count());
+    }
+    last_frame = now;
+    has_last_frame = true;
+}
+
+void FramePacer::resync() {
+    next_deadline = clock::time_point{};
+    has_last_frame = false;
+}
+
+void FramePacer::sleep_until(clock::time_point deadline) {
+    auto now = clock::now();
+    if (deadline - now > spin_margin) {
+        auto wake = deadline - spin_margin;
+        this_thread::sleep_until(wake);
+
+        // Grow the margin quickly on oversleep, shrink it slowly otherwise.
+        auto late = clock::now() - wake;
+        if (late * 2 > spin_margin) {
+            spin_margin = late * 2;
+        } else {
+            spin_margin -= spin_margin / 16;
+        }
+        spin_margin = max<clock::duration>(min_spin_margin, min<clock::duration>(spin_margin, max_spin_margin));
+    }
+
+    while (clock::now() < deadline) {
+        this_thread::yield();
+    }
+}
+
+FrameStats FramePacer::stats() const {
+    FrameStats rv;
+    rv.frames = intervals_ms.size();
+    if (intervals_ms.empty()) {
+        return rv;
+    }
+
+    auto sorted = intervals_ms;
+    sort(begin(sorted), end(sorted));
+
+    double sum = accumulate(begin(sorted), end(sorted), 0.0);
+    rv.mean_ms = sum / sorted.size();
+
+    double sq = 0;
+    for (auto ms : sorted) {
+        sq += (ms - rv.mean_ms) * (ms - rv.mean_ms);
+    }
+    rv.stddev_ms = sqrt(sq / sorted.size());
+
+    rv.min_ms = sorted.front();
+    rv.max_ms = sorted.back();
+    rv.p99_ms = sorted[min(sorted.size() - 1, size_t(sorted.size() * 0.99))];
+    return rv;
+}
+
+void FramePacer::clear_stats() {
+    intervals_ms.clear();
+}
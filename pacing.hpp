@@ -0,0 +1,52 @@
+#pragma once
+
+#include <chrono>
+#include <vector>
+
+struct FrameStats {
+    int frames = 0;
+    double mean_ms = 0;
+    double stddev_ms = 0;
+    double min_ms = 0;
+    double p99_ms = 0;
+    double max_ms = 0;
+};
+
+// Holds frames to a fixed cadence and measures how well it does.
+//
+// Frame slots are laid out at multiples of the target period rather than
+// "period after the last frame", so one late frame does not shift every
+// frame after it. Waiting sleeps for most of the gap and spins the rest,
+// with the spin margin tracking how late the OS actually wakes us.
+class FramePacer {
+public:
+    using clock = std::chrono::steady_clock;
+
+    // Frame intervals are only kept for stats() with record_stats, as
+    // nothing else would ever clear them.
+    explicit FramePacer(double target_fps = 0, bool record_stats = false);
+
+    // 0 disables the limiter; frame intervals are still recorded.
+    void set_target_fps(double fps);
+    double target_fps() const;
+
+    // Call once per presented frame. Blocks until the next frame slot.
+    void end_frame();
+
+    // Forget the cadence, e.g. after the loop has been idle.
+    void resync();
+
+    FrameStats stats() const;
+    void clear_stats();
+
+private:
+    void sleep_until(clock::time_point deadline);
+
+    clock::duration period{0};
+    clock::duration spin_margin;
+    clock::time_point next_deadline;
+    clock::time_point last_frame;
+    bool has_last_frame = false;
+    bool record_stats;
+    std::vector<double> intervals_ms;
+};
@@ -0,0 +1,44 @@
+#include "post.hpp"
+#include "shader.hpp"
+
+FxaaPass create_fxaa_pass(const AssetCache *cache) {
+    FxaaPass rv;
+    rv.program = load_program("data/post_vertex.glsl", "data/fxaa_frag.glsl", cache);
+    rv.sourceTexelUniform = glGetUniformLocation(rv.program, "SourceTexel");
+    rv.sourceExtentUniform = glGetUniformLocation(rv.program, "SourceExtent");
+
+    glUseProgram(rv.program);
+    glUniform1i(glGetUniformLocation(rv.program, "Source"), 0);
+    glUseProgram(0);
+
+    // Core profile refuses to draw without a VAO, even an empty one.
+    glGenVertexArrays(1, &rv.vao);
+    return rv;
+}
+
+void destroy_fxaa_pass(FxaaPass &pass) {
+    glDeleteVertexArrays(1, &pass.vao);
+    glDeleteProgram(pass.program);
+    pass = FxaaPass{};
+}
+
+void draw_fxaa(const FxaaPass &pass, const RenderTarget &src, int src_w, int src_h, int dst_w, int dst_h,
+               GLuint dst_fbo) {
+    glBindFramebuffer(GL_FRAMEBUFFER, dst_fbo);
+    glViewport(0, 0, dst_w, dst_h);
+    glDisable(GL_DEPTH_TEST);
+
+    glUseProgram(pass.program);
+    glUniform2f(pass.sourceTexelUniform, 1.f / src.width, 1.f / src.height);
+    glUniform2f(pass.sourceExtentUniform, float(src_w) / src.width, float(src_h) / src.height);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, src.color);
+    glBindVertexArray(pass.vao);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glUseProgram(0);
+
+    glEnable(GL_DEPTH_TEST);
+}
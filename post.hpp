@@ -0,0 +1,24 @@
+#pragma once
+
+#include "render_target.hpp"
+
+#include <glad/glad.h>
+
+struct AssetCache;
+
+// Screen-space FXAA, the cheap alternative to a multisampled scene target.
+struct FxaaPass {
+    GLuint program = 0;
+    GLuint vao = 0;
+    GLint sourceTexelUniform = -1;
+    GLint sourceExtentUniform = -1;
+};
+
+FxaaPass create_fxaa_pass(const AssetCache *cache = nullptr);
+void destroy_fxaa_pass(FxaaPass &pass);
+
+// Filters the (0, 0, src_w, src_h) corner of a single-sampled target onto the
+// (0, 0, dst_w, dst_h) corner of dst_fbo, the window by default. Leaves no
+// program bound.
+void draw_fxaa(const FxaaPass &pass, const RenderTarget &src, int src_w, int src_h, int dst_w, int dst_h,
+               GLuint dst_fbo = 0);
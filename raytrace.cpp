@@ -0,0 +1,415 @@
+#include "raytrace.hpp"
+#include "cpu_shading.hpp"
+#include "jobs.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+using namespace glm;
+
+namespace {
+// Four lanes with GCC/Clang vector extensions, which become SSE or NEON
+// without writing either out.
+typedef float f4 __attribute__((vector_size(16)));
+typedef int32_t i4 __attribute__((vector_size(16)));
+
+const int packet = 4;
+const int max_leaf = 4;
+const int max_depth = 48;
+const int sah_bins = 12;
+// Hits this far outside a triangle's edges still count, so rays through a
+// shared edge always find one side or the other.
+const float edge_epsilon = 1e-6f;
+
+f4 splat(float x) {
+    return f4{x, x, x, x};
+}
+
+f4 select(i4 mask, f4 a, f4 b) {
+    i4 ia, ib;
+    memcpy(&ia, &a, sizeof(ia));
+    memcpy(&ib, &b, sizeof(ib));
+    i4 rv = (ia & mask) | (ib & ~mask);
+    f4 out;
+    memcpy(&out, &rv, sizeof(out));
+    return out;
+}
+
+f4 min4(f4 a, f4 b) {
+    return select(a < b, a, b);
+}
+
+f4 max4(f4 a, f4 b) {
+    return select(a > b, a, b);
+}
+
+bool any(i4 mask) {
+    return (mask[0] | mask[1] | mask[2] | mask[3]) != 0;
+}
+
+struct Packet {
+    f4 o[3];
+    f4 d[3];
+    f4 inv_d[3];
+    i4 active;
+};
+
+struct PacketHits {
+    f4 t;
+    f4 u;
+    f4 v;
+    i4 draw;
+    i4 triangle;
+};
+
+struct Aabb {
+    vec3 min = vec3(INFINITY);
+    vec3 max = vec3(-INFINITY);
+
+    void grow(vec3 p) {
+        min = glm::min(min, p);
+        max = glm::max(max, p);
+    }
+
+    void grow(const Aabb &b) {
+        min = glm::min(min, b.min);
+        max = glm::max(max, b.max);
+    }
+
+    float area() const {
+        vec3 e = max - min;
+        return e.x < 0 ? 0.f : 2.f * (e.x * e.y + e.y * e.z + e.z * e.x);
+    }
+};
+
+struct Primitive {
+    Aabb bounds;
+    vec3 centroid;
+    uint32_t index;
+};
+
+vec3 corner(const IndexedMesh &mesh, uint32_t triangle, int k) {
+    uint32_t i = mesh.indices[triangle * 3 + k];
+    return vec3(mesh.px[i], mesh.py[i], mesh.pz[i]);
+}
+
+void make_leaf(Bvh::Node &node, size_t first, size_t count) {
+    node.first = uint32_t(first);
+    node.count = uint32_t(count);
+    node.axis = 0;
+}
+
+void build_node(Bvh &bvh, vector<Primitive> &prims, uint32_t node, size_t first, size_t last, int depth) {
+    Aabb bounds, centroids;
+    for (size_t i = first; i < last; ++i) {
+        bounds.grow(prims[i].bounds);
+        centroids.grow(prims[i].centroid);
+    }
+    for (int a = 0; a < 3; ++a) {
+        bvh.nodes[node].min[a] = bounds.min[a];
+        bvh.nodes[node].max[a] = bounds.max[a];
+    }
+
+    size_t count = last - first;
+    vec3 extent = centroids.max - centroids.min;
+    int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+    if (count <= max_leaf || depth >= max_depth || extent[axis] <= 0) {
+        make_leaf(bvh.nodes[node], first, count);
+        return;
+    }
+
+    // Binned SAH along the widest centroid axis.
+    Aabb bin_bounds[sah_bins];
+    size_t bin_count[sah_bins] = {};
+    float scale = sah_bins / extent[axis];
+    auto bin_of = [&](const Primitive &p) {
+        return min(int((p.centroid[axis] - centroids.min[axis]) * scale), sah_bins - 1);
+    };
+    for (size_t i = first; i < last; ++i) {
+        int b = bin_of(prims[i]);
+        bin_bounds[b].grow(prims[i].bounds);
+        ++bin_count[b];
+    }
+
+    float right_cost[sah_bins];
+    Aabb acc;
+    size_t n = 0;
+    for (int b = sah_bins - 1; b > 0; --b) {
+        acc.grow(bin_bounds[b]);
+        n += bin_count[b];
+        right_cost[b] = acc.area() * n;
+    }
+    int best = -1;
+    float best_cost = INFINITY;
+    acc = Aabb();
+    n = 0;
+    for (int b = 0; b + 1 < sah_bins; ++b) {
+        acc.grow(bin_bounds[b]);
+        n += bin_count[b];
+        float cost = acc.area() * n + right_cost[b + 1];
+        if (n > 0 && n < count && cost < best_cost) {
+            best_cost = cost;
+            best = b;
+        }
+    }
+
+    size_t mid;
+    if (best >= 0) {
+        auto split = partition(prims.begin() + first, prims.begin() + last,
+                               [&](const Primitive &p) { return bin_of(p) <= best; });
+        mid = split - prims.begin();
+    } else {
+        mid = first + count / 2;
+        nth_element(prims.begin() + first, prims.begin() + mid, prims.begin() + last,
+                    [&](const Primitive &a, const Primitive &b) { return a.centroid[axis] < b.centroid[axis]; });
+    }
+
+    uint32_t left = bvh.nodes.size();
+    bvh.nodes.emplace_back();
+    build_node(bvh, prims, left, first, mid, depth + 1);
+    uint32_t right = bvh.nodes.size();
+    bvh.nodes.emplace_back();
+    build_node(bvh, prims, right, mid, last, depth + 1);
+
+    bvh.nodes[node].first = right;
+    bvh.nodes[node].count = 0;
+    bvh.nodes[node].axis = uint32_t(axis);
+}
+
+i4 hits_box(const Bvh::Node &node, const Packet &p, f4 t_max) {
+    f4 t_near = splat(0.f);
+    f4 t_far = t_max;
+    for (int a = 0; a < 3; ++a) {
+        f4 t0 = (splat(node.min[a]) - p.o[a]) * p.inv_d[a];
+        f4 t1 = (splat(node.max[a]) - p.o[a]) * p.inv_d[a];
+        t_near = max4(t_near, min4(t0, t1));
+        t_far = min4(t_far, max4(t0, t1));
+    }
+    return (t_near <= t_far) & p.active;
+}
+
+// Moller-Trumbore for four rays against one triangle.
+void intersect(const Bvh::Triangle &tri, const Packet &p, int draw, PacketHits &hits) {
+    f4 e1[3] = {splat(tri.e1[0]), splat(tri.e1[1]), splat(tri.e1[2])};
+    f4 e2[3] = {splat(tri.e2[0]), splat(tri.e2[1]), splat(tri.e2[2])};
+
+    f4 pv[3] = {p.d[1] * e2[2] - p.d[2] * e2[1], p.d[2] * e2[0] - p.d[0] * e2[2], p.d[0] * e2[1] - p.d[1] * e2[0]};
+    f4 det = e1[0] * pv[0] + e1[1] * pv[1] + e1[2] * pv[2];
+    f4 inv_det = splat(1.f) / det;
+
+    f4 tv[3] = {p.o[0] - splat(tri.v0[0]), p.o[1] - splat(tri.v0[1]), p.o[2] - splat(tri.v0[2])};
+    f4 u = (tv[0] * pv[0] + tv[1] * pv[1] + tv[2] * pv[2]) * inv_det;
+    f4 qv[3] = {tv[1] * e1[2] - tv[2] * e1[1], tv[2] * e1[0] - tv[0] * e1[2], tv[0] * e1[1] - tv[1] * e1[0]};
+    f4 v = (p.d[0] * qv[0] + p.d[1] * qv[1] + p.d[2] * qv[2]) * inv_det;
+    f4 t = (e2[0] * qv[0] + e2[1] * qv[1] + e2[2] * qv[2]) * inv_det;
+
+    f4 eps = splat(-edge_epsilon);
+    i4 hit = p.active & (det != splat(0.f)) & (u >= eps) & (v >= eps) & (u + v <= splat(1.f + edge_epsilon)) &
+             (t >= splat(0.f)) & (t < hits.t);
+    if (!any(hit)) {
+        return;
+    }
+    hits.t = select(hit, t, hits.t);
+    hits.u = select(hit, u, hits.u);
+    hits.v = select(hit, v, hits.v);
+    hits.draw = (hit & draw) | (~hit & hits.draw);
+    hits.triangle = (hit & int32_t(tri.index)) | (~hit & hits.triangle);
+}
+
+void trace(const Bvh &bvh, const Packet &p, int draw, PacketHits &hits) {
+    if (bvh.nodes.empty()) {
+        return;
+    }
+    uint32_t stack[max_depth + 2];
+    int top = 0;
+    uint32_t node = 0;
+    for (;;) {
+        const Bvh::Node &n = bvh.nodes[node];
+        if (any(hits_box(n, p, hits.t))) {
+            if (n.count) {
+                for (uint32_t i = n.first; i < n.first + n.count; ++i) {
+                    intersect(bvh.triangles[i], p, draw, hits);
+                }
+            } else {
+                // The packet is coherent enough for its first ray to pick
+                // the order.
+                uint32_t near = node + 1;
+                uint32_t far = n.first;
+                if (p.d[n.axis][0] < 0) {
+                    swap(near, far);
+                }
+                stack[top++] = far;
+                node = near;
+                continue;
+            }
+        }
+        if (top == 0) {
+            break;
+        }
+        node = stack[--top];
+    }
+}
+
+vec3 unproject(const mat4 &world_from_ndc, float x, float y, float z) {
+    vec4 p = world_from_ndc * vec4(x, y, z, 1.f);
+    return vec3(p) / p.w;
+}
+}
+
+Bvh build_bvh(const IndexedMesh &mesh) {
+    Bvh rv;
+    size_t count = mesh.triangles();
+    vector<Primitive> prims(count);
+    for (size_t t = 0; t < count; ++t) {
+        Primitive &p = prims[t];
+        for (int k = 0; k < 3; ++k) {
+            p.bounds.grow(corner(mesh, t, k));
+        }
+        p.centroid = (p.bounds.min + p.bounds.max) * 0.5f;
+        p.index = uint32_t(t);
+    }
+    if (count == 0) {
+        return rv;
+    }
+    if (count >= 1u << 30) {
+        throw runtime_error("Mesh has too many triangles for the ray tracer");
+    }
+
+    rv.nodes.reserve(count * 2);
+    rv.nodes.emplace_back();
+    build_node(rv, prims, 0, 0, count, 0);
+
+    rv.triangles.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t t = prims[i].index;
+        vec3 v0 = corner(mesh, t, 0);
+        vec3 e1 = corner(mesh, t, 1) - v0;
+        vec3 e2 = corner(mesh, t, 2) - v0;
+        Bvh::Triangle &dst = rv.triangles[i];
+        for (int a = 0; a < 3; ++a) {
+            dst.v0[a] = v0[a];
+            dst.e1[a] = e1[a];
+            dst.e2[a] = e2[a];
+        }
+        dst.index = t;
+    }
+    return rv;
+}
+
+RayTracer::RayTracer(JobSystem &jobs, const CpuScene &scene, int tile_size)
+        : jobs(jobs), scene(scene), tile_size(tile_size) {
+    draws.resize(2);
+    draws[0].mesh = &scene.mesh;
+    draws[0].texture = &scene.meshImage;
+    draws[1].mesh = &scene.flame;
+    draws[1].texture = &scene.flameImage;
+    jobs.parallel_for(0, 2, 1, [&](int lo, int hi) {
+        for (int d = lo; d < hi; ++d) {
+            draws[d].bvh = build_bvh(*draws[d].mesh);
+        }
+    });
+}
+
+void RayTracer::render(const SceneParams &params, int width, int height, vector<unsigned char> &pixels) {
+    this->width = width;
+    this->height = height;
+    tiles_x = (width + tile_size - 1) / tile_size;
+    int tiles_y = (height + tile_size - 1) / tile_size;
+
+    world_from_ndc = inverse(params.cam_proj * params.cam_view);
+    mat4 models[] = {params.model, flame_model(params)};
+    for (int d = 0; d < 2; ++d) {
+        draws[d].object_from_world = inverse(models[d]);
+        draws[d].normal_matrix = transpose(inverse(params.cam_view * models[d]));
+    }
+
+    pixels.resize(size_t(width) * height * 4);
+    unsigned char *out = pixels.data();
+    jobs.parallel_for(0, tiles_x * tiles_y, 1, [&](int lo, int hi) {
+        for (int tile = lo; tile < hi; ++tile) {
+            trace_tile(tile, params, out);
+        }
+    });
+    rays = (long long)width * height;
+}
+
+void RayTracer::trace_tile(int tile, const SceneParams &params, unsigned char *pixels) {
+    int tile_x0 = (tile % tiles_x) * tile_size;
+    int tile_y0 = (tile / tiles_x) * tile_size;
+    int tile_x1 = min(tile_x0 + tile_size, width);
+    int tile_y1 = min(tile_y0 + tile_size, height);
+
+    for (int y0 = tile_y0; y0 < tile_y1; y0 += 2) {
+        for (int x0 = tile_x0; x0 < tile_x1; x0 += 2) {
+            // World-space rays from the near plane to the far plane, so t in
+            // [0, 1] is the depth range the rasterizer keeps.
+            vec3 origin[packet], dir[packet];
+            int px[packet], py[packet];
+            i4 active;
+            for (int k = 0; k < packet; ++k) {
+                px[k] = x0 + (k & 1);
+                py[k] = y0 + (k >> 1);
+                active[k] = px[k] < tile_x1 && py[k] < tile_y1 ? -1 : 0;
+                float nx = (px[k] + 0.5f) / width * 2.f - 1.f;
+                float ny = (py[k] + 0.5f) / height * 2.f - 1.f;
+                origin[k] = unproject(world_from_ndc, nx, ny, -1.f);
+                dir[k] = unproject(world_from_ndc, nx, ny, 1.f) - origin[k];
+            }
+
+            PacketHits hits;
+            hits.t = splat(1.f);
+            hits.u = hits.v = splat(0.f);
+            hits.draw = hits.triangle = i4{-1, -1, -1, -1};
+
+            // Each draw in its own object space; t carries over because the
+            // model transform is affine and dir is not renormalized.
+            for (int d = 0; d < int(draws.size()); ++d) {
+                const mat4 &m = draws[d].object_from_world;
+                Packet p;
+                p.active = active;
+                for (int k = 0; k < packet; ++k) {
+                    vec3 o = vec3(m * vec4(origin[k], 1.f));
+                    vec3 v = vec3(m * vec4(dir[k], 0.f));
+                    for (int a = 0; a < 3; ++a) {
+                        p.o[a][k] = o[a];
+                        p.d[a][k] = v[a];
+                        // Keep 0 * inf out of the slab test.
+                        float safe = std::abs(v[a]) > 1e-30f ? v[a] : std::copysign(1e-30f, v[a]);
+                        p.inv_d[a][k] = 1.f / safe;
+                    }
+                }
+                trace(draws[d].bvh, p, d, hits);
+            }
+
+            for (int k = 0; k < packet; ++k) {
+                if (!active[k]) {
+                    continue;
+                }
+                unsigned char *dst = pixels + (size_t(py[k]) * width + px[k]) * 4;
+                if (hits.draw[k] < 0) {
+                    store_clear_color(dst);
+                    continue;
+                }
+
+                const Draw &draw = draws[hits.draw[k]];
+                const IndexedMesh &mesh = *draw.mesh;
+                const uint32_t *index = &mesh.indices[size_t(hits.triangle[k]) * 3];
+                float b1 = hits.u[k];
+                float b2 = hits.v[k];
+                float b0 = 1.f - b1 - b2;
+                auto interpolate = [&](const vector<float> &c) {
+                    return c[index[0]] * b0 + c[index[1]] * b1 + c[index[2]] * b2;
+                };
+                vec2 uv(interpolate(mesh.u), interpolate(mesh.v));
+                // The normal matrix is affine with w = 1 (data/vertex.glsl),
+                // so it commutes with interpolation.
+                vec4 n = draw.normal_matrix * vec4(interpolate(mesh.nx), interpolate(mesh.ny), interpolate(mesh.nz), 1.f);
+                vec2 frag_coord = vec2(px[k] + 0.5f, py[k] + 0.5f) + params.frag_offset;
+                store_color(dst, shade_fragment(*draw.texture, scene.dither, uv, vec3(n), params.light_pos, frag_coord));
+            }
+        }
+    }
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "swrast.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+class JobSystem;
+
+// Bounding volume hierarchy over one mesh's triangles in object space,
+// built with a binned surface area heuristic. Nodes are in depth-first
+// order, so an inner node's left child is the next node.
+struct Bvh {
+    struct Node {
+        float min[3];
+        float max[3];
+        // Leaves hold count triangles from first; inner nodes have count 0
+        // and first is the right child. A leaf cut off by depth or by
+        // coincident centroids can hold any number of triangles.
+        uint32_t first;
+        uint32_t count : 30;
+        // The split axis, to visit the nearer child first.
+        uint32_t axis : 2;
+    };
+    static_assert(sizeof(Node) == 32, "Bvh::Node should stay half a cache line");
+
+    // Laid out for the intersection test: a corner and the two edges from
+    // it, and which triangle of the IndexedMesh this is.
+    struct Triangle {
+        float v0[3];
+        float e1[3];
+        float e2[3];
+        uint32_t index;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<Triangle> triangles;
+};
+
+Bvh build_bvh(const IndexedMesh &mesh);
+
+// data/vertex.glsl and data/frag.glsl by ray casting instead of
+// rasterization: one primary ray per pixel centre, traced through each
+// draw's BVH in 2x2 packets, the nearest hit shaded exactly as the
+// rasterizer shades a fragment. No subpixel snapping or edge rules, so it
+// makes an independent reference for the other backends.
+class RayTracer {
+public:
+    // Builds the BVHs of scene, which must outlive the tracer.
+    RayTracer(JobSystem &jobs, const CpuScene &scene, int tile_size = 32);
+
+    // RGBA8, bottom row first, as glReadPixels would return it.
+    void render(const SceneParams &params, int width, int height, std::vector<unsigned char> &pixels);
+
+    // Of the last render.
+    long long rays_traced() const {
+        return rays;
+    }
+
+private:
+    struct Draw {
+        const IndexedMesh *mesh;
+        const ImageView *texture;
+        Bvh bvh;
+        glm::mat4 object_from_world;
+        glm::mat4 normal_matrix;
+    };
+
+    void trace_tile(int tile, const SceneParams &params, unsigned char *pixels);
+
+    JobSystem &jobs;
+    const CpuScene &scene;
+    int tile_size;
+    int width = 0;
+    int height = 0;
+    int tiles_x = 0;
+
+    std::vector<Draw> draws;
+    glm::mat4 world_from_ndc;
+    long long rays = 0;
+};
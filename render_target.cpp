@@ -0,0 +1,87 @@
+#include "render_target.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+RenderTarget create_render_target(int width, int height, int samples) {
+    RenderTarget rv;
+    rv.width = width;
+    rv.height = height;
+
+    if (samples > 0) {
+        GLint max_samples = 0;
+        glGetIntegerv(GL_MAX_SAMPLES, &max_samples);
+        samples = min(samples, int(max_samples));
+    }
+    rv.samples = samples;
+
+    GLenum color_target = samples > 0 ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D;
+    glGenTextures(1, &rv.color);
+    glBindTexture(color_target, rv.color);
+    if (samples > 0) {
+        glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, samples, GL_RGBA8, width, height, GL_TRUE);
+    } else {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    }
+    glBindTexture(color_target, 0);
+
+    glGenRenderbuffers(1, &rv.depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, rv.depth);
+    glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &rv.fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, rv.fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, color_target, rv.color, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rv.depth);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        destroy_render_target(rv);
+        throw runtime_error("Failed to create render target!");
+    }
+
+    return rv;
+}
+
+void destroy_render_target(RenderTarget &target) {
+    glDeleteFramebuffers(1, &target.fbo);
+    glDeleteRenderbuffers(1, &target.depth);
+    glDeleteTextures(1, &target.color);
+    target = RenderTarget{};
+}
+
+void resize_render_target(RenderTarget &target, int width, int height, int samples) {
+    if (target.fbo != 0 && target.width == width && target.height == height) {
+        // create_render_target clamps to GL_MAX_SAMPLES, so compare loosely.
+        if (target.samples == samples || (samples > 0 && target.samples > 0 && target.samples < samples)) {
+            return;
+        }
+    }
+    if (target.fbo != 0) {
+        destroy_render_target(target);
+    }
+    target = create_render_target(width, height, samples);
+}
+
+void resolve_render_target(const RenderTarget &src, const RenderTarget &dst, int width, int height) {
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, src.fbo);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, dst.fbo);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void blit_to_screen(const RenderTarget &target, int src_w, int src_h, int dst_w, int dst_h) {
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, target.fbo);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    GLenum filter = (src_w == dst_w && src_h == dst_h) ? GL_NEAREST : GL_LINEAR;
+    glBlitFramebuffer(0, 0, src_w, src_h, 0, 0, dst_w, dst_h, GL_COLOR_BUFFER_BIT, filter);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <glad/glad.h>
+
+// Offscreen color + depth target. Allocated at the largest size it will be
+// asked to hold; smaller renders use a viewport into the corner.
+//
+// With samples > 0 the color attachment is a GL_TEXTURE_2D_MULTISAMPLE and
+// must be resolved before it can be sampled or scaled.
+struct RenderTarget {
+    GLuint fbo = 0;
+    GLuint color = 0;
+    GLuint depth = 0;
+    int width = 0;
+    int height = 0;
+    int samples = 0;
+};
+
+RenderTarget create_render_target(int width, int height, int samples = 0);
+void destroy_render_target(RenderTarget &target);
+
+// Reallocates target unless it already has exactly this size and sample count.
+void resize_render_target(RenderTarget &target, int width, int height, int samples = 0);
+
+// Resolves the (0, 0, width, height) corner of a multisampled target into the
+// same corner of a single-sampled one.
+void resolve_render_target(const RenderTarget &src, const RenderTarget &dst, int width, int height);
+
+// Copies the (0, 0, src_w, src_h) corner of target onto the whole of the
+// default framebuffer, filtering when the sizes differ.
+void blit_to_screen(const RenderTarget &target, int src_w, int src_h, int dst_w, int dst_h);
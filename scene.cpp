@@ -0,0 +1,738 @@
+#include "scene.hpp"
+#include "asset_cache.hpp"
+#include "file_batch.hpp"
+#include "jobs.hpp"
+#include "shader.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <lodepng.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+using namespace glm;
+
+namespace {
+// Calls fn with each line's first word and an istream over the rest.
+template <typename Fn>
+void for_each_obj_line(const string &text, Fn fn) {
+    string word;
+    size_t begin = 0;
+    while (begin < text.size()) {
+        size_t end = text.find('\n', begin);
+        if (end == string::npos) {
+            end = text.size();
+        }
+        istringstream iss(text.substr(begin, end - begin));
+        word.clear();
+        if (iss >> word) {
+            fn(word, iss);
+        }
+        begin = end + 1;
+    }
+}
+
+const GLsizei obj_vertex_floats = 3 + 2 + 3;
+
+void set_mesh_attribs(GLint posAttrib, GLint uvAttrib, GLint normAttrib) {
+    auto stride = sizeof(GLfloat) * obj_vertex_floats;
+    glEnableVertexAttribArray(posAttrib);
+    glEnableVertexAttribArray(uvAttrib);
+    glEnableVertexAttribArray(normAttrib);
+    glVertexAttribPointer(posAttrib, 3, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<const GLvoid *>(0));
+    glVertexAttribPointer(uvAttrib, 2, GL_FLOAT, GL_FALSE, stride,
+                          reinterpret_cast<const GLvoid *>(sizeof(GLfloat) * 3));
+    glVertexAttribPointer(normAttrib, 3, GL_FLOAT, GL_FALSE, stride,
+                          reinterpret_cast<const GLvoid *>(sizeof(GLfloat) * (3 + 2)));
+}
+
+GLuint create_buffer(const GLvoid *data, GLsizeiptr size) {
+    GLuint vbo;
+    glGenBuffers(1, &vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, size, data, GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return vbo;
+}
+
+GLsizeiptr mesh_buffer_size(int num_tris) {
+    return GLsizeiptr(num_tris) * 3 * obj_vertex_floats * sizeof(GLfloat);
+}
+}
+
+ObjSource scan_obj(const string &fname) {
+    ifstream file(fname, ios::binary);
+    return scan_obj_text(string(istreambuf_iterator<char>(file), istreambuf_iterator<char>()));
+}
+
+ObjSource scan_obj_text(string text) {
+    ObjSource rv;
+    rv.text = move(text);
+
+    for_each_obj_line(rv.text, [&](const string &word, istringstream &iss) {
+        if (word == "v") {
+            vec3 v;
+            iss >> v.x >> v.y >> v.z;
+            rv.pos.push_back(v);
+        } else if (word == "vt") {
+            vec2 v;
+            iss >> v.x >> v.y;
+            rv.uv.push_back(v);
+        } else if (word == "vn") {
+            vec3 v;
+            iss >> v.x >> v.y >> v.z;
+            rv.norm.push_back(v);
+        } else if (word == "f") {
+            ++rv.num_tris;
+        } else if (word[0] == '#') {
+        } else {
+            clog << "Warning: Unknown OBJ directive \"" << word << "\"" << endl;
+        }
+    });
+    return rv;
+}
+
+void write_obj_vertices(const ObjSource &src, GLfloat *out) {
+    for_each_obj_line(src.text, [&](const string &word, istringstream &iss) {
+        if (word != "f") {
+            return;
+        }
+        string fs[3];
+        iss >> fs[0] >> fs[1] >> fs[2];
+        for (auto &f : fs) {
+            replace(begin(f), end(f), '/', ' ');
+            istringstream fiss(f);
+            int ipos;
+            int iuv;
+            int inorm;
+            fiss >> ipos >> iuv >> inorm;
+            --ipos;
+            --iuv;
+            --inorm;
+            GLfloat vals[] = {
+                    src.pos[ipos].x,
+                    src.pos[ipos].y,
+                    src.pos[ipos].z,
+                    src.uv[iuv].x,
+                    1.f - src.uv[iuv].y,
+                    src.norm[inorm].x,
+                    src.norm[inorm].y,
+                    src.norm[inorm].z,
+            };
+            out = copy(begin(vals), end(vals), out);
+        }
+    });
+}
+
+ObjData parse_obj(const string &fname) {
+    return build_obj_data(scan_obj(fname));
+}
+
+ObjData build_obj_data(const ObjSource &src) {
+    ObjData rv;
+    rv.data.resize(size_t(src.num_tris) * 3 * obj_vertex_floats);
+    rv.num_tris = src.num_tris;
+    write_obj_vertices(src, rv.data.data());
+    return rv;
+}
+
+VAO vao_from_obj(const MeshView &obj, GLint posAttrib, GLint uvAttrib, GLint normAttrib) {
+    return vao_from_buffer(create_buffer(obj.data, obj.floats * sizeof(GLfloat)), obj.num_tris, posAttrib, uvAttrib,
+                           normAttrib);
+}
+
+GLuint create_mesh_buffer(int num_tris) {
+    return create_buffer(nullptr, mesh_buffer_size(num_tris));
+}
+
+VAO vao_from_buffer(GLuint vbo, int num_tris, GLint posAttrib, GLint uvAttrib, GLint normAttrib) {
+    VAO vao;
+    vao.vbo = vbo;
+    vao.num_tris = num_tris;
+    glGenVertexArrays(1, &vao.handle);
+
+    glBindVertexArray(vao.handle);
+    glBindBuffer(GL_ARRAY_BUFFER, vao.vbo);
+    set_mesh_attribs(posAttrib, uvAttrib, normAttrib);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    clog << "Created vao " << vao.handle << " with " << vao.num_tris << " tris." << endl;
+    return vao;
+}
+
+GLfloat *map_mesh_buffer(GLuint vbo, int num_tris) {
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    void *rv = glMapBufferRange(GL_ARRAY_BUFFER, 0, mesh_buffer_size(num_tris),
+                                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    if (!rv) {
+        throw runtime_error("Unable to map a vertex buffer");
+    }
+    return static_cast<GLfloat *>(rv);
+}
+
+void unmap_mesh_buffer(GLuint vbo) {
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    GLboolean intact = glUnmapBuffer(GL_ARRAY_BUFFER);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    if (!intact) {
+        throw runtime_error("Vertex buffer contents were lost while mapped");
+    }
+}
+
+Image decode_png(const string &fname) {
+    Image rv;
+    unsigned error = lodepng::decode(rv.pixels, rv.width, rv.height, fname);
+
+    if (error != 0) {
+        clog << "Error: Unable to load texture \"" << fname << "\"" << endl;
+        return Image{};
+    }
+
+    return rv;
+}
+
+Image decode_png_bytes(const string &bytes, const string &fname) {
+    Image rv;
+    unsigned error = lodepng::decode(rv.pixels, rv.width, rv.height,
+                                     reinterpret_cast<const unsigned char *>(bytes.data()), bytes.size());
+
+    if (error != 0) {
+        clog << "Error: Unable to load texture \"" << fname << "\"" << endl;
+        return Image{};
+    }
+
+    return rv;
+}
+
+Texture load_texture(const ImageView &image) {
+    Texture rv;
+
+    if (!image.pixels) {
+        return rv;
+    }
+
+    rv.width = image.width;
+    rv.height = image.height;
+
+    glGenTextures(1, &rv.handle);
+    glBindTexture(GL_TEXTURE_2D, rv.handle);
+
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image.width, image.height, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                 image.pixels);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    return rv;
+}
+
+// Smallest tile that every pattern repeats in, so the map can wrap instead of
+// being sized to the screen.
+int dither_period(const vector<DitherArr> &arrs) {
+    auto gcd = [](int a, int b) {
+        while (b != 0) {
+            int t = a % b;
+            a = b;
+            b = t;
+        }
+        return a;
+    };
+    int rv = 1;
+    auto fit = [&](size_t n) {
+        // Checked before it can overflow; n can be anything a file says.
+        if (n > size_t(max_dither_period)) {
+            return false;
+        }
+        rv = rv / gcd(rv, int(n)) * int(n);
+        return rv <= max_dither_period;
+    };
+    for (auto &dm : arrs) {
+        if (!fit(dm.size())) {
+            return 0;
+        }
+        for (auto &row : dm) {
+            if (!fit(row.size())) {
+                return 0;
+            }
+        }
+    }
+    return rv;
+}
+
+vector<DitherArr> scene_dither_patterns() {
+    return {
+            DitherArr{{0.0}},
+            DitherArr{
+                    {0.5, 1.0, 0.5, 0.0, 0.0, 0.0},
+                    {1.0, 1.0, 1.0, 0.0, 0.0, 0.0},
+                    {0.5, 1.0, 0.5, 0.0, 0.0, 0.0},
+                    {0.0, 0.0, 0.0, 0.0, 0.0, 0.0},
+                    {0.0, 0.0, 0.0, 0.0, 0.0, 0.0},
+                    {0.0, 0.0, 0.0, 0.0, 0.0, 0.0},
+            },
+            DitherArr{
+                    {0.5, 1.0, 0.5, 0.0, 0.0, 0.0},
+                    {1.0, 1.0, 1.0, 0.0, 0.0, 0.0},
+                    {0.5, 1.0, 0.5, 0.0, 0.0, 0.0},
+                    {0.0, 0.0, 0.0, 0.0, 0.0, 0.0},
+                    {0.0, 0.0, 0.0, 0.0, 0.0, 0.0},
+                    {0.0, 0.0, 0.0, 0.0, 0.0, 0.0},
+            },
+            DitherArr{
+                    {0.5, 1.0, 0.5, 0.5, 0.0, 0.5},
+                    {1.0, 1.0, 1.0, 0.0, 0.0, 0.0},
+                    {0.5, 1.0, 0.5, 0.5, 0.0, 0.5},
+                    {0.5, 0.0, 0.5, 0.5, 1.0, 0.5},
+                    {0.0, 0.0, 0.0, 1.0, 1.0, 1.0},
+                    {0.5, 0.0, 0.5, 0.5, 1.0, 0.5},
+            },
+            DitherArr{
+                    {0.5, 1.0, 0.5, 0.5, 0.0, 0.5},
+                    {1.0, 1.0, 1.0, 0.0, 0.0, 0.0},
+                    {0.5, 1.0, 0.5, 0.5, 0.0, 0.5},
+                    {0.5, 0.0, 0.5, 0.5, 1.0, 0.5},
+                    {0.0, 0.0, 0.0, 1.0, 1.0, 1.0},
+                    {0.5, 0.0, 0.5, 0.5, 1.0, 0.5},
+            },
+            DitherArr{
+                    {1.0, 1.0, 1.0, 1.0, 1.0, 1.0},
+                    {1.0, 1.0, 1.0, 1.0, 1.0, 1.0},
+                    {1.0, 1.0, 1.0, 1.0, 1.0, 1.0},
+                    {0.5, 0.0, 0.5, 1.0, 1.0, 1.0},
+                    {0.0, 0.0, 0.0, 1.0, 1.0, 1.0},
+                    {0.5, 0.0, 0.5, 1.0, 1.0, 1.0},
+            },
+            DitherArr{
+                    {1.0, 1.0, 1.0, 1.0, 1.0, 1.0},
+                    {1.0, 1.0, 1.0, 1.0, 1.0, 1.0},
+                    {1.0, 1.0, 1.0, 1.0, 1.0, 1.0},
+                    {0.5, 0.0, 0.5, 1.0, 1.0, 1.0},
+                    {0.0, 0.0, 0.0, 1.0, 1.0, 1.0},
+                    {0.5, 0.0, 0.5, 1.0, 1.0, 1.0},
+            },
+            DitherArr{{1.0}},
+    };
+}
+
+DitherVolume build_dither_volume(JobSystem &jobs, const vector<DitherArr> &arrs) {
+    DitherVolume rv;
+    rv.width = dither_period(arrs);
+    if (rv.width == 0) {
+        throw runtime_error("Dither patterns do not tile within " + to_string(max_dither_period) + " texels");
+    }
+    rv.height = rv.width;
+    rv.depth = arrs.size();
+    rv.texels.resize(rv.width * rv.height * rv.depth);
+
+    int width = rv.width;
+    int height = rv.height;
+    int depth = rv.depth;
+    auto &image = rv.texels;
+    jobs.parallel_for(0, depth * height, 64, [&](int lo, int hi) {
+        for (int dr = lo; dr < hi; ++dr) {
+            int d = dr / height;
+            int r = dr % height;
+            for (int c = 0; c < width; ++c) {
+                int i = d * width * height + r * width + c;
+                auto& dm = arrs[depth-d-1];
+                auto& row = dm[r % dm.size()];
+                auto& pix = row[c % row.size()];
+                image[i] = clamp(int(pix * 255), 0, 255);
+            }
+        }
+    });
+
+    return rv;
+}
+
+Texture3D upload_dither_volume(const DitherVolume &volume) {
+    Texture3D rv;
+    rv.width = volume.width;
+    rv.height = volume.height;
+    rv.depth = volume.depth;
+
+    glGenTextures(1, &rv.handle);
+    glBindTexture(GL_TEXTURE_3D, rv.handle);
+
+    glTexParameterf(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameterf(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameterf(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexParameterf(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameterf(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    // Rows are width bytes, not padded to the default 4-byte alignment.
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_RED, rv.width, rv.height, rv.depth, 0, GL_RED, GL_UNSIGNED_BYTE,
+                 volume.texels.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    glBindTexture(GL_TEXTURE_3D, 0);
+
+    return rv;
+}
+
+namespace {
+// The DrawUniforms block of data/vertex.glsl and data/frag.glsl, std140.
+struct DrawUniforms {
+    mat4 cam_proj;
+    mat4 cam_view;
+    mat4 model;
+    vec3 light_pos;
+    float light_radius;
+    vec2 frag_offset;
+    vec2 dither_size;
+};
+static_assert(sizeof(DrawUniforms) == 224, "DrawUniforms must match the std140 layout");
+
+const GLuint draw_uniforms_binding = 0;
+
+DrawUniforms draw_uniforms(const Scene &scene, const SceneParams &params, const mat4 &model) {
+    DrawUniforms rv;
+    rv.cam_proj = params.cam_proj;
+    rv.cam_view = params.cam_view;
+    rv.model = model;
+    rv.light_pos = params.light_pos;
+    rv.light_radius = params.light_radius;
+    rv.frag_offset = params.frag_offset;
+    rv.dither_size = vec2(scene.ditherMap.width, scene.ditherMap.height);
+    return rv;
+}
+
+const SceneAsset builtin_assets[] = {SceneAsset::mesh, SceneAsset::flame, SceneAsset::meshTexture,
+                                     SceneAsset::flameTexture};
+
+// Reads paths in one batch and has the job system call parse on each file,
+// by index, as it lands.
+JobHandle start_reading(JobSystem &jobs, vector<string> paths, function<void(size_t, string &)> parse) {
+    return jobs.run([&jobs, paths, parse] { jobs.wait_all(read_files(jobs, paths, parse)); });
+}
+
+// Leaves the program in use for finish_scene.
+GLuint compile_scene_shader(const AssetCache *cache) {
+    GLuint rv = load_program("data/vertex.glsl", "data/frag.glsl", cache);
+    glUseProgram(rv);
+
+    glUniform1i(glGetUniformLocation(rv, "Texture"), 0);
+    glUniform1i(glGetUniformLocation(rv, "DitherMap"), 1);
+    glUniformBlockBinding(rv, glGetUniformBlockIndex(rv, "DrawUniforms"), draw_uniforms_binding);
+    return rv;
+}
+
+// The dither map and uniform ring, once the instances are known.
+void finish_scene(Scene &scene, JobSystem &jobs, const AssetCache *cache, const vector<DitherArr> &dither) {
+    scene.ditherMap = upload_dither_volume(cache ? cached_dither(*cache, "ditherMap")
+                                                 : build_dither_volume(jobs, dither));
+
+    GLint alignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    scene.uniformStride = (sizeof(DrawUniforms) + alignment - 1) / alignment * alignment;
+    GLsizeiptr draws = max<size_t>(scene.instances.size(), 1);
+    scene.uniforms = create_stream_buffer(GL_UNIFORM_BUFFER, scene.uniformStride * draws);
+    glUseProgram(0);
+}
+
+// An untextured box in parse_obj's layout, for a mesh that is still loading.
+ObjData placeholder_box(vec3 lo, vec3 hi) {
+    const vec2 corners[] = {{0.f, 0.f}, {1.f, 0.f}, {1.f, 1.f}, {0.f, 0.f}, {1.f, 1.f}, {0.f, 1.f}};
+    ObjData rv;
+    for (int axis = 0; axis < 3; ++axis) {
+        int u = (axis + 1) % 3;
+        int v = (axis + 2) % 3;
+        for (int side = 0; side < 2; ++side) {
+            vec3 normal(0.f);
+            normal[axis] = side ? 1.f : -1.f;
+            for (auto &c : corners) {
+                vec3 pos;
+                pos[axis] = side ? hi[axis] : lo[axis];
+                pos[u] = mix(lo[u], hi[u], c.x);
+                pos[v] = mix(lo[v], hi[v], c.y);
+                GLfloat vals[] = {pos.x, pos.y, pos.z, c.x, c.y, normal.x, normal.y, normal.z};
+                rv.data.insert(end(rv.data), begin(vals), end(vals));
+            }
+            rv.num_tris += 2;
+        }
+    }
+    return rv;
+}
+
+// Two passes, the second straight into the vertex buffers: no copy of a
+// vertex stream is ever held outside the driver.
+void upload_obj_sources(JobSystem &jobs, const vector<ObjSource> &sources, const vector<VAO> &meshes) {
+    vector<GLfloat *> data(meshes.size(), nullptr);
+    vector<JobHandle> writes;
+    JobDrain drain(jobs, writes);
+    for (size_t i = 0; i < meshes.size(); ++i) {
+        if (meshes[i].num_tris > 0) {
+            data[i] = map_mesh_buffer(meshes[i].vbo, meshes[i].num_tris);
+            writes.push_back(jobs.run([&, i] { write_obj_vertices(sources[i], data[i]); }));
+        }
+    }
+    jobs.wait_all(writes);
+    for (size_t i = 0; i < meshes.size(); ++i) {
+        if (data[i]) {
+            unmap_mesh_buffer(meshes[i].vbo);
+        }
+    }
+}
+}
+
+SceneAssets parse_scene_assets(JobSystem &jobs) {
+    vector<string> paths;
+    for (auto asset : builtin_assets) {
+        paths.push_back(scene_asset_path(asset));
+    }
+    SceneAssets rv;
+    vector<JobHandle> parsing = {start_reading(jobs, paths, [&](size_t i, string &bytes) {
+        SceneAsset asset = builtin_assets[i];
+        switch (asset) {
+        case SceneAsset::mesh:
+            rv.mesh = build_obj_data(scan_obj_text(move(bytes)));
+            break;
+        case SceneAsset::flame:
+            rv.flame = build_obj_data(scan_obj_text(move(bytes)));
+            break;
+        case SceneAsset::meshTexture:
+            rv.meshImage = decode_png_bytes(bytes, scene_asset_path(asset));
+            break;
+        case SceneAsset::flameTexture:
+            rv.flameImage = decode_png_bytes(bytes, scene_asset_path(asset));
+            break;
+        }
+    })};
+    JobDrain drain(jobs, parsing);
+    rv.ditherMap = build_dither_volume(jobs, scene_dither_patterns());
+    jobs.wait_all(parsing);
+    return rv;
+}
+
+Scene load_scene(JobSystem &jobs, const AssetCache *cache) {
+    SceneDescription description = default_scene_description();
+    if (!cache) {
+        return load_scene(jobs, description);
+    }
+
+    Scene rv;
+    rv.shader = compile_scene_shader(cache);
+    GLint posAttrib = glGetAttribLocation(rv.shader, "VertexPosition");
+    GLint uvAttrib = glGetAttribLocation(rv.shader, "VertexTexcoord");
+    GLint normAttrib = glGetAttribLocation(rv.shader, "VertexNormal");
+    // In default_scene_description's order.
+    vector<GLfloat> decoded;
+    for (auto name : {"mesh", "flame"}) {
+        rv.meshes.push_back(vao_from_obj(cached_mesh(*cache, name, decoded), posAttrib, uvAttrib, normAttrib));
+    }
+    for (auto name : {"meshImage", "flameImage"}) {
+        rv.textures.push_back(load_texture(cached_image(*cache, name)));
+    }
+    rv.instances = description.instances;
+
+    finish_scene(rv, jobs, cache, description.dither);
+    return rv;
+}
+
+Scene load_scene(JobSystem &jobs, const SceneDescription &description) {
+    // Read in one batch, then scan and decode on the workers, while this
+    // thread compiles shaders.
+    vector<string> paths;
+    for (auto &mesh : description.meshes) {
+        paths.push_back(mesh.path);
+    }
+    paths.insert(end(paths), begin(description.textures), end(description.textures));
+    size_t numMeshes = description.meshes.size();
+    vector<ObjSource> sources(numMeshes);
+    vector<Image> images(description.textures.size());
+    vector<JobHandle> reading = {start_reading(jobs, paths, [&](size_t i, string &bytes) {
+        if (i < numMeshes) {
+            sources[i] = scan_obj_text(move(bytes));
+        } else {
+            images[i - numMeshes] = decode_png_bytes(bytes, paths[i]);
+        }
+    })};
+    JobDrain drain(jobs, reading);
+
+    Scene rv;
+    rv.shader = compile_scene_shader(nullptr);
+
+    jobs.wait_all(reading);
+
+    GLint posAttrib = glGetAttribLocation(rv.shader, "VertexPosition");
+    GLint uvAttrib = glGetAttribLocation(rv.shader, "VertexTexcoord");
+    GLint normAttrib = glGetAttribLocation(rv.shader, "VertexNormal");
+    for (auto &src : sources) {
+        rv.meshes.push_back(vao_from_buffer(create_mesh_buffer(src.num_tris), src.num_tris, posAttrib, uvAttrib,
+                                            normAttrib));
+    }
+    upload_obj_sources(jobs, sources, rv.meshes);
+    for (auto &image : images) {
+        rv.textures.push_back(load_texture(image));
+    }
+    rv.instances = description.instances;
+
+    finish_scene(rv, jobs, nullptr, description.dither);
+    return rv;
+}
+
+Scene load_placeholder_scene(JobSystem &jobs, const SceneDescription &description) {
+    Scene rv;
+    rv.shader = compile_scene_shader(nullptr);
+
+    GLint posAttrib = glGetAttribLocation(rv.shader, "VertexPosition");
+    GLint uvAttrib = glGetAttribLocation(rv.shader, "VertexTexcoord");
+    GLint normAttrib = glGetAttribLocation(rv.shader, "VertexNormal");
+    for (auto &mesh : description.meshes) {
+        rv.meshes.push_back(vao_from_obj(placeholder_box(mesh.lo, mesh.hi), posAttrib, uvAttrib, normAttrib));
+    }
+
+    Image grey;
+    grey.pixels = {200, 200, 200, 255};
+    grey.width = 1;
+    grey.height = 1;
+    // One each, as replace_scene_texture deletes what it replaces.
+    for (size_t i = 0; i < description.textures.size(); ++i) {
+        rv.textures.push_back(load_texture(grey));
+    }
+    rv.instances = description.instances;
+
+    finish_scene(rv, jobs, nullptr, description.dither);
+    return rv;
+}
+
+void destroy_scene(Scene &scene) {
+    for (auto &texture : scene.textures) {
+        glDeleteTextures(1, &texture.handle);
+    }
+    glDeleteTextures(1, &scene.ditherMap.handle);
+    for (auto &mesh : scene.meshes) {
+        glDeleteBuffers(1, &mesh.vbo);
+        glDeleteVertexArrays(1, &mesh.handle);
+    }
+    glDeleteProgram(scene.shader);
+    destroy_stream_buffer(scene.uniforms);
+    scene = Scene{};
+}
+
+SceneDescription default_scene_description() {
+    SceneDescription rv;
+    // The boxes are roughly the bounds of data/kawaii.obj and data/flame.obj.
+    rv.meshes = {
+            {scene_asset_path(SceneAsset::mesh), vec3(-2.f, -4.f, -1.f), vec3(2.f, 5.4f, 1.f)},
+            {scene_asset_path(SceneAsset::flame), vec3(-0.22f), vec3(0.22f)},
+    };
+    rv.textures = {scene_asset_path(SceneAsset::meshTexture), scene_asset_path(SceneAsset::flameTexture)};
+    SceneInstance flame;
+    flame.mesh = 1;
+    flame.texture = 1;
+    flame.light = true;
+    rv.instances = {SceneInstance{}, flame};
+    return rv;
+}
+
+SceneParams default_scene_params(float aspect) {
+    return scene_params(default_scene_description(), aspect);
+}
+
+SceneParams scene_params(const SceneDescription &description, float aspect) {
+    SceneParams rv;
+    rv.cam_proj = perspective(radians(description.fovy), aspect, 0.01f, 100.f);
+    rv.cam_view = lookAt(description.eye, description.target, vec3(0.f, 1.f, 0.f));
+    rv.model = mat4(1.f);
+    rv.light_pos = description.light_pos;
+    rv.light_radius = description.light_radius;
+    return rv;
+}
+
+const char *scene_asset_path(SceneAsset asset) {
+    switch (asset) {
+    case SceneAsset::mesh:
+        return "data/kawaii.obj";
+    case SceneAsset::flame:
+        return "data/flame.obj";
+    case SceneAsset::meshTexture:
+        return "data/kawaii.png";
+    case SceneAsset::flameTexture:
+        return "data/flame.png";
+    }
+    return "";
+}
+
+void replace_scene_mesh(Scene &scene, int index, GLuint vbo, int num_tris) {
+    VAO &vao = scene.meshes.at(index);
+    glDeleteVertexArrays(1, &vao.handle);
+    glDeleteBuffers(1, &vao.vbo);
+    vao = vao_from_buffer(vbo, num_tris, glGetAttribLocation(scene.shader, "VertexPosition"),
+                          glGetAttribLocation(scene.shader, "VertexTexcoord"),
+                          glGetAttribLocation(scene.shader, "VertexNormal"));
+}
+
+void replace_scene_texture(Scene &scene, int index, const Texture &texture) {
+    Texture &slot = scene.textures.at(index);
+    glDeleteTextures(1, &slot.handle);
+    slot = texture;
+}
+
+void patch_scene_mesh(Scene &scene, int index, const vector<BufferRange> &ranges, const unsigned char *data) {
+    glBindBuffer(GL_ARRAY_BUFFER, scene.meshes.at(index).vbo);
+    for (auto &r : ranges) {
+        glBufferSubData(GL_ARRAY_BUFFER, r.offset, r.size, data);
+        data += r.size;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void patch_scene_texture(Scene &scene, int index, int first_row, int rows, const unsigned char *pixels) {
+    Texture &slot = scene.textures.at(index);
+    glBindTexture(GL_TEXTURE_2D, slot.handle);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, first_row, slot.width, rows, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+mat4 flame_model(const SceneParams &params) {
+    return scale(translate(mat4(1.f), params.light_pos), vec3(params.light_radius / 5.f));
+}
+
+void draw_scene(Scene &scene, const SceneParams &params) {
+    glUseProgram(scene.shader);
+
+    glClearColor(1.0f, 0.0f, 1.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    mat4 light = flame_model(params);
+    auto data = static_cast<unsigned char *>(map_stream_slot(scene.uniforms));
+    for (size_t i = 0; i < scene.instances.size(); ++i) {
+        auto &inst = scene.instances[i];
+        DrawUniforms draw = draw_uniforms(scene, params, (inst.light ? light : params.model) * inst.model);
+        memcpy(data + i * scene.uniformStride, &draw, sizeof(DrawUniforms));
+    }
+    GLintptr offset = unmap_stream_slot(scene.uniforms);
+
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_3D, scene.ditherMap.handle);
+
+    glActiveTexture(GL_TEXTURE0);
+    for (size_t i = 0; i < scene.instances.size(); ++i) {
+        auto &inst = scene.instances[i];
+        const VAO &mesh = scene.meshes[inst.mesh];
+        glBindBufferRange(GL_UNIFORM_BUFFER, draw_uniforms_binding, scene.uniforms.buffer,
+                          offset + i * scene.uniformStride, sizeof(DrawUniforms));
+        glBindTexture(GL_TEXTURE_2D, scene.textures[inst.texture].handle);
+        glBindVertexArray(mesh.handle);
+        glDrawArrays(GL_TRIANGLES, 0, mesh.num_tris * 3);
+    }
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_3D, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, draw_uniforms_binding, 0);
+    fence_stream_slot(scene.uniforms);
+}
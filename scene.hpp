@@ -0,0 +1,251 @@
+#pragma once
+
+#include "stream_buffer.hpp"
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+class JobSystem;
+struct AssetCache;
+
+struct VAO {
+    GLuint handle = 0;
+    GLuint vbo = 0;
+    int num_tris = 0;
+};
+
+struct ObjData {
+    std::vector<GLfloat> data;
+    int num_tris = 0;
+};
+
+// The first pass over an OBJ: the file, its attribute lists and the face
+// count, enough to size a vertex buffer before a vertex is written.
+struct ObjSource {
+    std::string text;
+    std::vector<glm::vec3> pos;
+    std::vector<glm::vec2> uv;
+    std::vector<glm::vec3> norm;
+    int num_tris = 0;
+};
+
+ObjSource scan_obj(const std::string &fname);
+// The same over a file already read.
+ObjSource scan_obj_text(std::string text);
+
+// The second pass: num_tris * 3 vertices of interleaved position, texcoord,
+// normal to out.
+void write_obj_vertices(const ObjSource &src, GLfloat *out);
+
+// Both passes into memory of its own, ready for vao_from_obj.
+ObjData parse_obj(const std::string &fname);
+ObjData build_obj_data(const ObjSource &src);
+
+// Borrowed mesh data, from a parse or straight out of an asset cache.
+struct MeshView {
+    const GLfloat *data = nullptr;
+    size_t floats = 0;
+    int num_tris = 0;
+
+    MeshView() = default;
+    MeshView(const ObjData &obj) : data(obj.data.data()), floats(obj.data.size()), num_tris(obj.num_tris) {
+    }
+};
+
+VAO vao_from_obj(const MeshView &obj, GLint posAttrib, GLint uvAttrib, GLint normAttrib);
+
+// A vertex buffer for num_tris triangles that has yet to be written.
+GLuint create_mesh_buffer(int num_tris);
+// A VAO laid out like vao_from_obj's over vbo, which it takes over. VAOs are
+// not shared between contexts, so this runs on the one that draws.
+VAO vao_from_buffer(GLuint vbo, int num_tris, GLint posAttrib, GLint uvAttrib, GLint normAttrib);
+// Write-only. Any thread may fill the mapping, but map and unmap belong to
+// a thread with a context. Both throw if the driver loses the buffer.
+GLfloat *map_mesh_buffer(GLuint vbo, int num_tris);
+void unmap_mesh_buffer(GLuint vbo);
+
+struct Texture {
+    GLuint handle = 0;
+    int width = 0;
+    int height = 0;
+};
+
+struct Image {
+    std::vector<unsigned char> pixels;
+    unsigned width = 0;
+    unsigned height = 0;
+};
+
+Image decode_png(const std::string &fname);
+// From a file already read; fname only names it in errors.
+Image decode_png_bytes(const std::string &bytes, const std::string &fname);
+
+// Borrowed RGBA8 pixels, from a decode or straight out of an asset cache.
+struct ImageView {
+    const unsigned char *pixels = nullptr;
+    unsigned width = 0;
+    unsigned height = 0;
+
+    ImageView() = default;
+    ImageView(const Image &image)
+            : pixels(image.pixels.empty() ? nullptr : image.pixels.data()), width(image.width), height(image.height) {
+    }
+};
+
+Texture load_texture(const ImageView &image);
+
+struct Texture3D {
+    GLuint handle = 0;
+    int width = 0;
+    int height = 0;
+    int depth = 0;
+};
+
+using DitherArr = std::vector<std::vector<double>>;
+
+// The map holds period x period texels a pattern, so it stays small.
+const int max_dither_period = 64;
+
+// Zero if the patterns only repeat together past max_dither_period.
+int dither_period(const std::vector<DitherArr> &arrs);
+
+// R8 texels, width x height per layer, layer 0 the last pattern. Patterns
+// tile it exactly, so it wraps.
+struct DitherVolume {
+    std::vector<unsigned char> texels;
+    int width = 0;
+    int height = 0;
+    int depth = 0;
+};
+
+// The shading levels of data/frag.glsl, darkest first.
+std::vector<DitherArr> scene_dither_patterns();
+DitherVolume build_dither_volume(JobSystem &jobs, const std::vector<DitherArr> &arrs);
+Texture3D upload_dither_volume(const DitherVolume &volume);
+
+// One draw of a mesh with a texture, both by index into the scene's lists.
+struct SceneInstance {
+    int mesh = 0;
+    int texture = 0;
+    glm::mat4 model = glm::mat4(1.f);
+    // Placed on top of flame_model, so it marks the light, rather than on
+    // top of SceneParams::model.
+    bool light = false;
+};
+
+// A mesh to load, and the box that stands in for it until it has.
+struct SceneMesh {
+    std::string path;
+    glm::vec3 lo = glm::vec3(-0.5f);
+    glm::vec3 hi = glm::vec3(0.5f);
+};
+
+// What the viewer draws and where it starts. Every file is listed once,
+// however many instances share it.
+struct SceneDescription {
+    std::vector<SceneMesh> meshes;
+    std::vector<std::string> textures;
+    std::vector<SceneInstance> instances;
+    glm::vec3 eye = glm::vec3(0.f, 2.f, 6.f);
+    glm::vec3 target = glm::vec3(0.f, 2.f, 0.f);
+    // Vertical field of view in degrees, as scene files give it; radians
+    // only where a projection is built. The default is the view the
+    // built-in scene has always had, from 90 read as radians.
+    float fovy = 116.62f;
+    glm::vec3 light_pos = glm::vec3(5, 3, 1);
+    float light_radius = 5.f;
+    std::vector<DitherArr> dither = scene_dither_patterns();
+};
+
+// The kawaii mesh, with the flame marking the light.
+SceneDescription default_scene_description();
+
+// The shader, meshes, textures and dither map the sandbox draws, uploaded
+// once and reused for every frame.
+struct Scene {
+    GLuint shader = 0;
+    // Indexed like the description's lists.
+    std::vector<VAO> meshes;
+    std::vector<Texture> textures;
+    std::vector<SceneInstance> instances;
+    Texture3D ditherMap;
+
+    // The DrawUniforms block of data/vertex.glsl and data/frag.glsl for
+    // each draw, uniformStride apart.
+    StreamBuffer uniforms;
+    GLsizeiptr uniformStride = 0;
+};
+
+// Everything that changes from one frame to the next.
+struct SceneParams {
+    glm::mat4 cam_proj;
+    glm::mat4 cam_view;
+    glm::mat4 model;
+    glm::vec3 light_pos;
+    float light_radius = 0;
+    // Where this render's (0, 0) sits in the full image, so a tile continues
+    // the dither pattern of its neighbours.
+    glm::vec2 frag_offset = glm::vec2(0.f);
+};
+
+// The CPU-side assets of the scene, before upload.
+struct SceneAssets {
+    ObjData mesh;
+    ObjData flame;
+    Image meshImage;
+    Image flameImage;
+    DitherVolume ditherMap;
+};
+
+SceneAssets parse_scene_assets(JobSystem &jobs);
+
+// The built-in scene. Parses and decodes assets on the job system while the
+// shaders compile, or takes them and the shaders ready-made from cache.
+Scene load_scene(JobSystem &jobs, const AssetCache *cache = nullptr);
+// The same for any description, reading every file in one batch.
+Scene load_scene(JobSystem &jobs, const SceneDescription &description);
+
+// Only the shader and dither map are real; the meshes are boxes and the
+// textures flat grey until replaced with replace_scene_mesh and
+// replace_scene_texture. Cheap enough to draw a first frame right away,
+// however large the scene.
+Scene load_placeholder_scene(JobSystem &jobs, const SceneDescription &description = default_scene_description());
+void destroy_scene(Scene &scene);
+
+// The viewer's starting camera and light.
+SceneParams default_scene_params(float aspect = 4.f / 3.f);
+SceneParams scene_params(const SceneDescription &description, float aspect = 4.f / 3.f);
+
+// The flame marks the light: its mesh moved to light_pos and scaled with
+// light_radius.
+glm::mat4 flame_model(const SceneParams &params);
+
+// The files of the built-in scene, which asset caches hold.
+enum class SceneAsset { mesh, flame, meshTexture, flameTexture };
+
+// The OBJ or PNG under data/ that asset is loaded from.
+const char *scene_asset_path(SceneAsset asset);
+
+// Swap in a mesh or texture loaded after load_scene, by index, and delete
+// what it replaces. The buffer and texture may come from a shared context
+// once it is done with them.
+void replace_scene_mesh(Scene &scene, int index, GLuint vbo, int num_tris);
+void replace_scene_texture(Scene &scene, int index, const Texture &texture);
+
+// Bytes of a mesh's vertex buffer to overwrite.
+struct BufferRange {
+    GLintptr offset;
+    GLsizeiptr size;
+};
+
+// Overwrite part of an asset in place, for a reload that kept its triangle
+// count or image size. data holds the new bytes of every range end to end;
+// pixels holds rows rows from first_row up.
+void patch_scene_mesh(Scene &scene, int index, const std::vector<BufferRange> &ranges, const unsigned char *data);
+void patch_scene_texture(Scene &scene, int index, int first_row, int rows, const unsigned char *pixels);
+
+// Clears the bound framebuffer and draws the scene into the current viewport.
+void draw_scene(Scene &scene, const SceneParams &params);
@@ -0,0 +1,154 @@
+#include "scene_file.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <json/json.h>
+
+#include <fstream>
+#include <map>
+#include <stdexcept>
+
+using namespace std;
+using namespace glm;
+
+namespace {
+vec3 parse_vec3(const Json::Value &v, vec3 fallback) {
+    if (!v.isArray() || v.size() != 3) {
+        return fallback;
+    }
+    return vec3(v[0].asFloat(), v[1].asFloat(), v[2].asFloat());
+}
+
+DitherArr parse_dither(const Json::Value &v, const string &fname) {
+    DitherArr rv;
+    for (auto &row : v) {
+        rv.emplace_back();
+        for (auto &x : row) {
+            rv.back().push_back(x.asDouble());
+        }
+        if (rv.back().empty()) {
+            throw runtime_error(fname + ": empty row in \"dither\"");
+        }
+    }
+    if (rv.empty()) {
+        throw runtime_error(fname + ": empty pattern in \"dither\"");
+    }
+    if (dither_period({rv}) == 0) {
+        throw runtime_error(fname + ": a \"dither\" pattern does not repeat within " +
+                            to_string(max_dither_period) + " texels");
+    }
+    return rv;
+}
+
+// Names to indices into the description's lists, which only grow once
+// something uses a name, and never by a path they already hold.
+class SceneBuilder {
+public:
+    SceneBuilder(const Json::Value &root, const string &fname, SceneDescription &out)
+            : root(root), fname(fname), out(out) {
+    }
+
+    int mesh(const string &name) {
+        auto &v = root["meshes"][name];
+        if (v.isString()) {
+            return add_mesh(v.asString(), vec3(-0.5f), vec3(0.5f));
+        }
+        if (!v.isObject() || !v["path"].isString()) {
+            throw runtime_error(fname + ": no mesh \"" + name + "\"");
+        }
+        auto &bounds = v["bounds"];
+        return add_mesh(v["path"].asString(), parse_vec3(bounds[0], vec3(-0.5f)), parse_vec3(bounds[1], vec3(0.5f)));
+    }
+
+    int material(const string &name) {
+        auto &v = root["materials"][name];
+        if (!v.isObject() || !v["texture"].isString()) {
+            throw runtime_error(fname + ": no material \"" + name + "\" with a texture");
+        }
+        string path = v["texture"].asString();
+        auto found = textures.find(path);
+        if (found != textures.end()) {
+            return found->second;
+        }
+        out.textures.push_back(path);
+        return textures[path] = out.textures.size() - 1;
+    }
+
+private:
+    int add_mesh(const string &path, vec3 lo, vec3 hi) {
+        auto found = meshes.find(path);
+        if (found != meshes.end()) {
+            return found->second;
+        }
+        out.meshes.push_back({path, lo, hi});
+        return meshes[path] = out.meshes.size() - 1;
+    }
+
+    const Json::Value &root;
+    const string &fname;
+    SceneDescription &out;
+    map<string, int> meshes;
+    map<string, int> textures;
+};
+}
+
+SceneDescription load_scene_file(const string &fname) {
+    ifstream file(fname);
+    if (!file) {
+        throw runtime_error("Unable to open \"" + fname + "\"");
+    }
+
+    Json::Value root;
+    Json::CharReaderBuilder builder;
+    string errors;
+    if (!Json::parseFromStream(builder, file, &root, &errors)) {
+        throw runtime_error(fname + ": " + errors);
+    }
+
+    SceneDescription rv;
+    SceneBuilder scene(root, fname, rv);
+    for (auto &v : root["instances"]) {
+        SceneInstance inst;
+        inst.mesh = scene.mesh(v["mesh"].asString());
+        inst.texture = scene.material(v["material"].asString());
+        inst.model = translate(mat4(1.f), parse_vec3(v["position"], vec3(0.f)));
+        inst.model = rotate(inst.model, radians(v.get("rotate_y", 0.0).asFloat()), vec3(0.f, 1.f, 0.f));
+        inst.model = scale(inst.model, vec3(v.get("scale", 1.0).asFloat()));
+        rv.instances.push_back(inst);
+    }
+
+    auto &light = root["light"];
+    rv.light_pos = parse_vec3(light["position"], rv.light_pos);
+    rv.light_radius = light.get("radius", rv.light_radius).asFloat();
+    if (light.isMember("mesh")) {
+        SceneInstance inst;
+        inst.mesh = scene.mesh(light["mesh"].asString());
+        inst.texture = scene.material(light["material"].asString());
+        inst.light = true;
+        rv.instances.push_back(inst);
+    }
+
+    auto &camera = root["camera"];
+    rv.eye = parse_vec3(camera["eye"], rv.eye);
+    rv.target = parse_vec3(camera["target"], rv.target);
+    if (camera.isMember("fov")) {
+        rv.fovy = camera["fov"].asFloat();
+        if (!(rv.fovy > 0 && rv.fovy < 180)) {
+            throw runtime_error(fname + ": \"fov\" must be between 0 and 180 degrees");
+        }
+    }
+
+    if (root.isMember("dither")) {
+        rv.dither.clear();
+        for (auto &v : root["dither"]) {
+            rv.dither.push_back(parse_dither(v, fname));
+        }
+        if (rv.dither.empty()) {
+            throw runtime_error(fname + ": \"dither\" has no patterns");
+        }
+        if (dither_period(rv.dither) == 0) {
+            throw runtime_error(fname + ": \"dither\" patterns do not tile together within " +
+                                to_string(max_dither_period) + " texels");
+        }
+    }
+    return rv;
+}
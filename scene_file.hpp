@@ -0,0 +1,26 @@
+#pragma once
+
+#include "scene.hpp"
+
+#include <string>
+
+// Reads a scene description from JSON, so content changes without a
+// rebuild:
+//
+//   {
+//     "meshes": {"kawaii": "data/kawaii.obj",
+//                "flame": {"path": "data/flame.obj", "bounds": [[-0.2, -0.2, -0.2], [0.2, 0.2, 0.2]]}},
+//     "materials": {"kawaii": {"texture": "data/kawaii.png"}, "flame": {"texture": "data/flame.png"}},
+//     "instances": [{"mesh": "kawaii", "material": "kawaii", "position": [0, 0, 0], "rotate_y": 0, "scale": 1}],
+//     "light": {"position": [5, 3, 1], "radius": 5, "mesh": "flame", "material": "flame"},
+//     "camera": {"eye": [0, 2, 6], "target": [0, 2, 0], "fov": 60},
+//     "dither": [[[0.0]], [[0.5, 1.0], [1.0, 0.5]], [[1.0]]]
+//   }
+//
+// Meshes and materials are only loaded once an instance or the light uses
+// them, and each file once however many names and instances share it.
+// bounds size the box drawn while a mesh loads. A material is a texture; the
+// one shader does the rest. fov is in degrees, rotate_y too, and dither
+// lists the shading levels darkest first. A camera, light or dither left
+// out is the built-in scene's.
+SceneDescription load_scene_file(const std::string &fname);
@@ -0,0 +1,382 @@
+#include "server.hpp"
+#include "asset_cache.hpp"
+#include "backend.hpp"
+#include "offscreen.hpp"
+#include "options.hpp"
+#include "raytrace.hpp"
+#include "swrast.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+
+using namespace std;
+using namespace glm;
+
+namespace {
+volatile sig_atomic_t stop_requested = 0;
+
+void on_stop_signal(int) {
+    stop_requested = 1;
+}
+
+bool read_full(int fd, void *data, size_t size) {
+    auto p = static_cast<char *>(data);
+    while (size > 0) {
+        ssize_t n = read(fd, p, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool write_full(int fd, const void *data, size_t size) {
+    auto p = static_cast<const char *>(data);
+    while (size > 0) {
+        ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+sockaddr_un socket_address(const string &path) {
+    sockaddr_un rv;
+    memset(&rv, 0, sizeof(rv));
+    rv.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(rv.sun_path)) {
+        throw runtime_error("Socket path \"" + path + "\" is too long");
+    }
+    strcpy(rv.sun_path, path.c_str());
+    return rv;
+}
+
+using RenderFn = function<void(const SceneParams &params, int width, int height, vector<unsigned char> &pixels)>;
+
+// One client, on a non-blocking socket. A request is read into request as
+// bytes arrive, and only once it is whole is it rendered; its reply is then
+// sent as the socket takes it before the next request is read.
+struct Connection {
+    int fd = -1;
+    RenderRequest request;
+    size_t received = 0;
+    RenderReply reply;
+    vector<unsigned char> pixels;
+    size_t sent = 0;
+    bool replying = false;
+    bool close_after_reply = false;
+};
+
+// Returns false once the client is gone.
+bool read_request(Connection &conn) {
+    auto p = reinterpret_cast<char *>(&conn.request);
+    while (conn.received < sizeof(conn.request)) {
+        ssize_t n = read(conn.fd, p + conn.received, sizeof(conn.request) - conn.received);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return true;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        conn.received += n;
+    }
+    return true;
+}
+
+void answer_request(Connection &conn, const RenderFn &render) {
+    const RenderRequest &request = conn.request;
+    conn.reply = RenderReply{};
+    conn.pixels.clear();
+    conn.sent = 0;
+    conn.received = 0;
+    conn.replying = true;
+
+    RenderReply &reply = conn.reply;
+    if (request.magic != render_request_magic || request.width == 0 || request.height == 0) {
+        reply.status = RenderStatus::bad_request;
+        // The stream can't be trusted to be in sync after a bad request.
+        conn.close_after_reply = true;
+        return;
+    }
+    if (request.width > unsigned(max_render_size) || request.height > unsigned(max_render_size)) {
+        reply.status = RenderStatus::too_large;
+        return;
+    }
+
+    auto start = chrono::steady_clock::now();
+    try {
+        render(scene_params(request), request.width, request.height, conn.pixels);
+    } catch (const exception &e) {
+        // One bad render, e.g. out of memory, must not end every client's
+        // connection.
+        clog << "Warning: Render of " << request.width << "x" << request.height << " failed: " << e.what() << endl;
+        reply.status = RenderStatus::failed;
+        vector<unsigned char>().swap(conn.pixels);
+        return;
+    }
+    reply.render_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    reply.width = request.width;
+    reply.height = request.height;
+    reply.size = conn.pixels.size();
+}
+
+// Returns false once the client is gone.
+bool send_reply(Connection &conn) {
+    size_t total = sizeof(conn.reply) + conn.pixels.size();
+    while (conn.sent < total) {
+        const char *p;
+        size_t size;
+        if (conn.sent < sizeof(conn.reply)) {
+            p = reinterpret_cast<const char *>(&conn.reply) + conn.sent;
+            size = sizeof(conn.reply) - conn.sent;
+        } else {
+            p = reinterpret_cast<const char *>(conn.pixels.data()) + conn.sent - sizeof(conn.reply);
+            size = total - conn.sent;
+        }
+        ssize_t n = send(conn.fd, p, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return true;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        conn.sent += n;
+    }
+    conn.replying = false;
+    return !conn.close_after_reply;
+}
+
+// Advances one client as far as its socket allows; returns false once it
+// should be dropped.
+bool serve_client(Connection &conn, short revents, const RenderFn &render, long long &served) {
+    if (conn.replying && (revents & POLLOUT)) {
+        if (!send_reply(conn)) {
+            return false;
+        }
+    } else if (!conn.replying && (revents & POLLIN)) {
+        if (!read_request(conn)) {
+            return false;
+        }
+        if (conn.received == sizeof(conn.request)) {
+            answer_request(conn, render);
+            served += conn.reply.status == RenderStatus::ok;
+            // Most replies fit the socket buffer straight away.
+            return send_reply(conn);
+        }
+    } else if (revents & (POLLHUP | POLLERR)) {
+        return false;
+    }
+    return true;
+}
+
+int serve(const string &path, const RenderFn &render) {
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener < 0) {
+        throw runtime_error(string("socket: ") + strerror(errno));
+    }
+    sockaddr_un addr = socket_address(path);
+    // Only a stale socket is cleared, never whatever else has the name.
+    struct stat st;
+    if (lstat(path.c_str(), &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            close(listener);
+            throw runtime_error("\"" + path + "\" exists and is not a socket");
+        }
+        unlink(path.c_str());
+    }
+    if (bind(listener, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || listen(listener, 16) != 0) {
+        close(listener);
+        throw runtime_error("Unable to listen on \"" + path + "\": " + strerror(errno));
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_stop_signal;
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+
+    // Sockets never block, so a client that stops halfway through a request
+    // or stops reading its reply holds up nobody else.
+    vector<unique_ptr<Connection>> clients;
+    vector<pollfd> fds;
+    long long served = 0;
+
+    clog << "Serving renders on " << path << endl;
+    while (!stop_requested) {
+        fds.assign(1, {listener, POLLIN, 0});
+        for (auto &conn : clients) {
+            fds.push_back({conn->fd, short(conn->replying ? POLLOUT : POLLIN), 0});
+        }
+        // A timeout, so a signal between the check and poll() still stops us.
+        if (poll(fds.data(), fds.size(), 250) <= 0) {
+            continue;
+        }
+
+        // fds[i + 1] is clients[i] until anything is erased.
+        size_t kept = 0;
+        for (size_t i = 0; i < clients.size(); ++i) {
+            if (serve_client(*clients[i], fds[i + 1].revents, render, served)) {
+                if (kept != i) {
+                    clients[kept] = move(clients[i]);
+                }
+                ++kept;
+            } else {
+                close(clients[i]->fd);
+            }
+        }
+        clients.resize(kept);
+
+        if (fds[0].revents & POLLIN) {
+            int client = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+            if (client >= 0) {
+                clients.push_back(make_unique<Connection>());
+                clients.back()->fd = client;
+            }
+        }
+    }
+
+    for (auto &conn : clients) {
+        close(conn->fd);
+    }
+    close(listener);
+    unlink(path.c_str());
+    clog << "Served " << served << " requests" << endl;
+    return EXIT_SUCCESS;
+}
+}
+
+RenderRequest make_render_request(const SceneParams &params, int width, int height) {
+    RenderRequest rv;
+    rv.width = width;
+    rv.height = height;
+    memcpy(rv.cam_proj, value_ptr(params.cam_proj), sizeof(rv.cam_proj));
+    memcpy(rv.cam_view, value_ptr(params.cam_view), sizeof(rv.cam_view));
+    memcpy(rv.model, value_ptr(params.model), sizeof(rv.model));
+    memcpy(rv.light_pos, value_ptr(params.light_pos), sizeof(rv.light_pos));
+    rv.light_radius = params.light_radius;
+    memcpy(rv.frag_offset, value_ptr(params.frag_offset), sizeof(rv.frag_offset));
+    return rv;
+}
+
+SceneParams scene_params(const RenderRequest &request) {
+    SceneParams rv;
+    rv.cam_proj = make_mat4(request.cam_proj);
+    rv.cam_view = make_mat4(request.cam_view);
+    rv.model = make_mat4(request.model);
+    rv.light_pos = make_vec3(request.light_pos);
+    rv.light_radius = request.light_radius;
+    rv.frag_offset = make_vec2(request.frag_offset);
+    return rv;
+}
+
+int run_render_server(const string &path, Scene &scene, const Options &options, const AssetCache *cache) {
+    OffscreenRenderer renderer = create_offscreen_renderer(options.aa, options.msaa_samples, cache);
+    int rv = serve(path, [&](const SceneParams &params, int width, int height, vector<unsigned char> &pixels) {
+        render_offscreen(renderer, scene, params, width, height, pixels);
+    });
+    destroy_offscreen_renderer(renderer);
+    return rv;
+}
+
+int run_cpu_render_server(const string &path, const Options &options, JobSystem &jobs) {
+    SceneAssets assets;
+    AssetCache cache;
+    CpuScene scene;
+    if (!options.asset_cache.empty()) {
+        cache = map_asset_cache(options.asset_cache);
+        vector<GLfloat> decoded;
+        scene.mesh = index_mesh(cached_mesh(cache, "mesh", decoded));
+        scene.flame = index_mesh(cached_mesh(cache, "flame", decoded));
+        scene.meshImage = cached_image(cache, "meshImage");
+        scene.flameImage = cached_image(cache, "flameImage");
+        scene.dither = cached_dither(cache, "ditherMap");
+    } else {
+        assets = parse_scene_assets(jobs);
+        scene = make_cpu_scene(assets);
+    }
+
+    int rv;
+    if (options.renderer == Renderer::trace) {
+        RayTracer tracer(jobs, scene);
+        rv = serve(path, [&](const SceneParams &params, int width, int height, vector<unsigned char> &pixels) {
+            tracer.render(params, width, height, pixels);
+        });
+    } else {
+        SoftwareRasterizer rasterizer(jobs);
+        rv = serve(path, [&](const SceneParams &params, int width, int height, vector<unsigned char> &pixels) {
+            rasterizer.render(scene, params, width, height, pixels);
+        });
+    }
+    unmap_asset_cache(cache);
+    return rv;
+}
+
+int run_vulkan_render_server(const string &path, const Options &options, JobSystem &jobs) {
+    AssetCache cache;
+    if (!options.asset_cache.empty()) {
+        cache = map_asset_cache(options.asset_cache);
+    }
+    unique_ptr<OffscreenBackend> renderer = create_vulkan_offscreen(options, jobs, cache.base ? &cache : nullptr);
+    int rv = serve(path, [&](const SceneParams &params, int width, int height, vector<unsigned char> &pixels) {
+        renderer->render(params, width, height, pixels);
+    });
+    renderer.reset();
+    unmap_asset_cache(cache);
+    return rv;
+}
+
+int connect_render_server(const string &path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        throw runtime_error(string("socket: ") + strerror(errno));
+    }
+    sockaddr_un addr = socket_address(path);
+    if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+        close(fd);
+        throw runtime_error("Unable to connect to \"" + path + "\": " + strerror(errno));
+    }
+    return fd;
+}
+
+RenderReply request_render(int fd, const RenderRequest &request, vector<unsigned char> &pixels) {
+    RenderReply reply;
+    if (!write_full(fd, &request, sizeof(request)) || !read_full(fd, &reply, sizeof(reply))) {
+        throw runtime_error("Render server connection lost");
+    }
+    pixels.resize(reply.size);
+    if (reply.size > 0 && !read_full(fd, pixels.data(), pixels.size())) {
+        throw runtime_error("Render server connection lost");
+    }
+    return reply;
+}
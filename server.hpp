@@ -0,0 +1,69 @@
+#pragma once
+
+#include "scene.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class JobSystem;
+struct Options;
+
+// Wire format of the render server. Both sides run on the same machine, so
+// structs go over the socket as they are, in native byte order.
+//
+// A client sends RenderRequests and reads back a RenderReply for each,
+// followed by reply.size bytes of RGBA8 pixels, bottom row first. Requests
+// on one connection are answered in order.
+
+const uint32_t render_request_magic = 0x51524453; // "SDRQ"
+const int max_render_size = 16384;
+
+struct RenderRequest {
+    uint32_t magic = render_request_magic;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    // Column-major, as glm stores them.
+    float cam_proj[16];
+    float cam_view[16];
+    float model[16];
+    float light_pos[3];
+    float light_radius = 0;
+    float frag_offset[2] = {0, 0};
+};
+
+enum class RenderStatus : uint32_t {
+    ok,
+    bad_request,
+    too_large,
+    // The render threw; the server logs why and carries on.
+    failed,
+};
+
+struct RenderReply {
+    RenderStatus status = RenderStatus::ok;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t reserved = 0;
+    uint64_t size = 0;
+    // Draw plus readback, as measured by the server.
+    double render_ms = 0;
+};
+
+RenderRequest make_render_request(const SceneParams &params, int width, int height);
+SceneParams scene_params(const RenderRequest &request);
+
+// Serves renders of an already loaded scene on a Unix socket at path until
+// SIGINT or SIGTERM. Needs a current GL context.
+int run_render_server(const std::string &path, Scene &scene, const Options &options,
+                      const AssetCache *cache = nullptr);
+// The same with the software rasterizer or ray tracer (options.renderer),
+// for nodes without a GPU.
+int run_cpu_render_server(const std::string &path, const Options &options, JobSystem &jobs);
+// The same with Vulkan, which needs no window either.
+int run_vulkan_render_server(const std::string &path, const Options &options, JobSystem &jobs);
+
+// Client side. Throws on connection errors; a refused request comes back as
+// a reply with a status other than ok and no pixels.
+int connect_render_server(const std::string &path);
+RenderReply request_render(int fd, const RenderRequest &request, std::vector<unsigned char> &pixels);
@@ -0,0 +1,223 @@
+#include "shader.hpp"
+#include "asset_cache.hpp"
+#include "asset_store.hpp"
+#include "glext.hpp"
+
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+// GL_ARB_get_program_binary, core in GL 4.1 and beyond what the loader
+// covers.
+const GLenum program_binary_retrievable_hint = 0x8257;
+const GLenum program_binary_length = 0x8741;
+using ProgramParameteriFn = void(APIENTRY *)(GLuint program, GLenum pname, GLint value);
+using GetProgramBinaryFn = void(APIENTRY *)(GLuint program, GLsizei size, GLsizei *length, GLenum *format,
+                                            void *binary);
+using ProgramBinaryFn = void(APIENTRY *)(GLuint program, GLenum format, const void *binary, GLsizei length);
+
+struct ProgramBinaryApi {
+    ProgramParameteriFn parameter = nullptr;
+    GetProgramBinaryFn get = nullptr;
+    ProgramBinaryFn load = nullptr;
+};
+
+ProgramBinaryApi program_binary_api() {
+    ProgramBinaryApi rv;
+    if (has_gl_extension("GL_ARB_get_program_binary")) {
+        rv.parameter = reinterpret_cast<ProgramParameteriFn>(glfwGetProcAddress("glProgramParameteri"));
+        rv.get = reinterpret_cast<GetProgramBinaryFn>(glfwGetProcAddress("glGetProgramBinary"));
+        rv.load = reinterpret_cast<ProgramBinaryFn>(glfwGetProcAddress("glProgramBinary"));
+    }
+    return rv;
+}
+
+// Binaries only fit the driver that made them, so it is part of the key.
+uint64_t program_key(const vector<string> &vertex, const vector<string> &frag) {
+    uint64_t rv = fnv1a(nullptr, 0);
+    for (auto stage : {&vertex, &frag}) {
+        for (auto &line : *stage) {
+            rv = fnv1a(line.data(), line.size(), rv);
+        }
+        rv = fnv1a("", 1, rv);
+    }
+    for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+        auto text = reinterpret_cast<const char *>(glGetString(name));
+        rv = fnv1a(text, text ? strlen(text) + 1 : 0, rv);
+    }
+    return rv;
+}
+
+// Stored as the binary's format followed by its bytes. Zero if the store
+// has none, or the driver no longer takes it.
+GLuint load_program_binary(const ProgramBinaryApi &api, const string &store, const string &name) {
+    StoredFile file = map_stored_file(store, name);
+    GLuint rv = 0;
+    if (file.size > sizeof(GLenum)) {
+        GLenum format;
+        memcpy(&format, file.data, sizeof(format));
+        rv = glCreateProgram();
+        api.load(rv, format, file.data + sizeof(format), GLsizei(file.size - sizeof(format)));
+        GLint result;
+        glGetProgramiv(rv, GL_LINK_STATUS, &result);
+        if (result == GL_FALSE) {
+            glDeleteProgram(rv);
+            rv = 0;
+        }
+    }
+    unmap_stored_file(file);
+    return rv;
+}
+
+void store_program_binary(const ProgramBinaryApi &api, const string &store, const string &name, GLuint program) {
+    GLint length = 0;
+    glGetProgramiv(program, program_binary_length, &length);
+    if (length <= 0) {
+        return;
+    }
+    GLenum format;
+    vector<unsigned char> bytes(sizeof(format) + length);
+    api.get(program, length, nullptr, &format, bytes.data() + sizeof(format));
+    memcpy(bytes.data(), &format, sizeof(format));
+    try {
+        write_stored_file(store, name, bytes.data(), bytes.size());
+    } catch (const exception &e) {
+        clog << "Warning: " << e.what() << endl;
+    }
+}
+
+// In load_file's form.
+vector<string> source_lines(const AssetCache *cache, const string &fname) {
+    if (!cache) {
+        return load_file(fname);
+    }
+    istringstream text(cached_text(*cache, fname.c_str()));
+    string line;
+    vector<string> rv;
+    while (getline(text, line)) {
+        line += "\n";
+        rv.push_back(line);
+    }
+    return rv;
+}
+}
+
+vector<string> load_file(const string &fname) {
+    ifstream file(fname);
+    string line;
+    vector<string> rv;
+    while (getline(file, line)) {
+        line += "\n";
+        rv.push_back(line);
+    }
+    return rv;
+}
+
+GLuint compile_shader(GLenum type, const vector<string> &file) {
+    GLuint rv = glCreateShader(type);
+    if (rv == 0) {
+        throw runtime_error("Failed to create shader!");
+    }
+
+    vector<const GLchar *> code;
+    code.reserve(file.size());
+    transform(begin(file), end(file), back_inserter(code), [](const auto &line) { return line.data(); });
+
+    glShaderSource(rv, code.size(), &code[0], nullptr);
+
+    glCompileShader(rv);
+
+    GLint result;
+    glGetShaderiv(rv, GL_COMPILE_STATUS, &result);
+    if (result == GL_FALSE) {
+        cerr << "Shader compilation failed!" << endl;
+
+        GLint logLen;
+        glGetShaderiv(rv, GL_INFO_LOG_LENGTH, &logLen);
+
+        if (logLen > 0) {
+            auto log = make_unique<GLchar[]>(logLen);
+            glGetShaderInfoLog(rv, logLen, nullptr, log.get());
+
+            cerr << "Shader compilation log:\n" << log.get() << endl;
+        }
+    }
+
+    return rv;
+}
+
+GLuint link_program(GLuint vertex_shader, GLuint frag_shader, bool retrievable) {
+    GLuint rv = glCreateProgram();
+    if (rv == 0) {
+        throw runtime_error("Failed to create shader program!");
+    }
+
+    ProgramParameteriFn parameter = retrievable ? program_binary_api().parameter : nullptr;
+    if (parameter) {
+        parameter(rv, program_binary_retrievable_hint, GL_TRUE);
+    }
+
+    glAttachShader(rv, vertex_shader);
+    glAttachShader(rv, frag_shader);
+    glLinkProgram(rv);
+
+    GLint result;
+    glGetProgramiv(rv, GL_LINK_STATUS, &result);
+    if (result == GL_FALSE) {
+        cerr << "Shader link failed!" << endl;
+
+        GLint logLen;
+        glGetProgramiv(rv, GL_INFO_LOG_LENGTH, &logLen);
+
+        if (logLen > 0) {
+            auto log = make_unique<GLchar[]>(logLen);
+            glGetProgramInfoLog(rv, logLen, nullptr, log.get());
+
+            cerr << "Shader compilation log:\n" << log.get() << endl;
+        }
+    }
+
+    return rv;
+}
+
+GLuint load_program(const string &vertex_fname, const string &frag_fname, const AssetCache *cache) {
+    vector<string> vertex = source_lines(cache, vertex_fname);
+    vector<string> frag = source_lines(cache, frag_fname);
+
+    string store = cache ? cache->program_store : string();
+    ProgramBinaryApi api = store.empty() ? ProgramBinaryApi{} : program_binary_api();
+    bool binaries = api.parameter && api.get && api.load;
+    string name;
+    if (binaries) {
+        name = asset_store_key(program_key(vertex, frag)) + ".program";
+        GLuint rv = load_program_binary(api, store, name);
+        if (rv) {
+            return rv;
+        }
+    }
+
+    GLuint vertex_shader = compile_shader(GL_VERTEX_SHADER, vertex);
+    GLuint frag_shader = compile_shader(GL_FRAGMENT_SHADER, frag);
+    GLuint rv = link_program(vertex_shader, frag_shader, binaries);
+    glDeleteShader(vertex_shader);
+    glDeleteShader(frag_shader);
+
+    GLint linked;
+    glGetProgramiv(rv, GL_LINK_STATUS, &linked);
+    // Also replaces a binary the driver rejected, or a file too short to
+    // be one, so later starts do not fail on it again.
+    if (binaries && linked == GL_TRUE) {
+        store_program_binary(api, store, name, rv);
+    }
+    return rv;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <string>
+#include <vector>
+
+struct AssetCache;
+
+std::vector<std::string> load_file(const std::string &fname);
+GLuint compile_shader(GLenum type, const std::vector<std::string> &file);
+// retrievable asks the driver to keep the program's binary around for
+// glGetProgramBinary, where it can.
+GLuint link_program(GLuint vertex_shader, GLuint frag_shader, bool retrievable = false);
+
+// Compiles and links a vertex + fragment shader pair from files, or from
+// the copies packed into cache under the same names. With a program store
+// on cache, a binary linked earlier by the same driver from the same
+// sources is loaded instead, and a fresh link is stored for next time.
+GLuint load_program(const std::string &vertex_fname, const std::string &frag_fname,
+                    const AssetCache *cache = nullptr);
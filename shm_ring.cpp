@@ -0,0 +1,173 @@
+#include "shm_ring.hpp"
+
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <ctime>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+namespace {
+const char magic[8] = {'S', 'A', 'N', 'D', 'Y', 'F', 'R', '1'};
+const uint32_t version = 1;
+
+size_t page_align(size_t size) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    return (size + page - 1) / page * page;
+}
+
+// Not FUTEX_PRIVATE_FLAG: the word lives in memory shared between processes.
+void futex_wake(atomic<uint32_t> *word) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+void futex_wait(atomic<uint32_t> *word, uint32_t expected, int timeout_ms) {
+    timespec ts;
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAIT, expected, &ts, nullptr, 0);
+}
+
+[[noreturn]] void fail(const string &what) {
+    throw runtime_error(what + ": " + strerror(errno));
+}
+}
+
+static_assert(sizeof(atomic<uint32_t>) == sizeof(uint32_t), "futex words must be plain 32-bit integers");
+
+SharedFrameRing create_shared_frame_ring(int slot_count, size_t slot_capacity) {
+    if (slot_count < 1 || slot_count > max_shared_slots) {
+        throw runtime_error("Shared frame ring needs 1 to " + to_string(max_shared_slots) + " slots");
+    }
+
+    SharedFrameRing rv;
+    rv.fd = syscall(SYS_memfd_create, "sandy-frames", MFD_CLOEXEC);
+    if (rv.fd < 0) {
+        fail("memfd_create");
+    }
+
+    size_t slot_offset = page_align(sizeof(SharedFrameHeader));
+    size_t slot_stride = page_align(slot_capacity);
+    rv.map_size = slot_offset + slot_stride * slot_count;
+    if (ftruncate(rv.fd, rv.map_size) != 0) {
+        close(rv.fd);
+        fail("ftruncate");
+    }
+
+    void *map = mmap(nullptr, rv.map_size, PROT_READ | PROT_WRITE, MAP_SHARED, rv.fd, 0);
+    if (map == MAP_FAILED) {
+        close(rv.fd);
+        fail("mmap");
+    }
+
+    rv.header = new(map) SharedFrameHeader();
+    rv.base = static_cast<unsigned char *>(map);
+    memcpy(rv.header->magic, magic, sizeof(magic));
+    rv.header->version = version;
+    rv.header->slot_count = slot_count;
+    rv.header->slot_offset = slot_offset;
+    rv.header->slot_stride = slot_stride;
+    rv.header->slot_capacity = slot_capacity;
+    return rv;
+}
+
+SharedFrameRing open_shared_frame_ring(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        fail("fstat");
+    }
+
+    SharedFrameRing rv;
+    rv.fd = fd;
+    rv.map_size = st.st_size;
+    if (rv.map_size < sizeof(SharedFrameHeader)) {
+        throw runtime_error("Not a shared frame ring");
+    }
+
+    void *map = mmap(nullptr, rv.map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        fail("mmap");
+    }
+    rv.header = static_cast<SharedFrameHeader *>(map);
+    rv.base = static_cast<unsigned char *>(map);
+
+    auto &h = *rv.header;
+    if (memcmp(h.magic, magic, sizeof(magic)) != 0 || h.version != version || h.slot_count < 1 ||
+        h.slot_count > max_shared_slots || h.slot_capacity > h.slot_stride ||
+        h.slot_offset + h.slot_stride * h.slot_count > rv.map_size) {
+        munmap(map, rv.map_size);
+        throw runtime_error("Not a shared frame ring");
+    }
+    return rv;
+}
+
+void close_shared_frame_ring(SharedFrameRing &ring) {
+    if (ring.base) {
+        munmap(ring.base, ring.map_size);
+    }
+    if (ring.fd >= 0) {
+        close(ring.fd);
+    }
+    ring = SharedFrameRing{};
+}
+
+unsigned char *shared_slot_pixels(const SharedFrameRing &ring, uint32_t seq) {
+    auto &h = *ring.header;
+    return ring.base + h.slot_offset + h.slot_stride * (seq % h.slot_count);
+}
+
+bool shared_slot_free(const SharedFrameRing &ring, uint32_t seq) {
+    auto &h = *ring.header;
+    return seq - h.read_seq.load(memory_order_acquire) < h.slot_count;
+}
+
+void publish_shared_frame(SharedFrameRing &ring, const SharedFrameSlot &meta) {
+    auto &h = *ring.header;
+    uint32_t seq = h.write_seq.load(memory_order_relaxed);
+    h.slots[seq % h.slot_count] = meta;
+    h.write_seq.store(seq + 1, memory_order_release);
+    futex_wake(&h.write_seq);
+}
+
+void close_shared_frames(SharedFrameRing &ring) {
+    auto &h = *ring.header;
+    h.closed.store(1, memory_order_release);
+    // A consumer that checked closed just before this sleeps until its
+    // timeout; everyone else wakes now.
+    futex_wake(&h.write_seq);
+}
+
+const SharedFrameSlot *wait_shared_frame(SharedFrameRing &ring, int timeout_ms) {
+    auto &h = *ring.header;
+    uint32_t read = h.read_seq.load(memory_order_relaxed);
+    uint32_t written = h.write_seq.load(memory_order_acquire);
+
+    if (written == read && !h.closed.load(memory_order_acquire)) {
+        futex_wait(&h.write_seq, read, timeout_ms);
+        written = h.write_seq.load(memory_order_acquire);
+    }
+
+    if (written == read) {
+        return nullptr;
+    }
+    return &h.slots[read % h.slot_count];
+}
+
+void release_shared_frame(SharedFrameRing &ring) {
+    auto &h = *ring.header;
+    h.read_seq.fetch_add(1, memory_order_release);
+}
+
+bool shared_frames_closed(const SharedFrameRing &ring) {
+    auto &h = *ring.header;
+    return h.closed.load(memory_order_acquire) && h.write_seq.load(memory_order_acquire) == h.read_seq.load();
+}
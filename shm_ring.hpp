@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Frames shared with another process through a memfd. The file starts with a
+// SharedFrameHeader page, followed by slot_count page-aligned pixel slots.
+//
+// It is a single-producer single-consumer ring: the producer fills slot
+// write_seq % slot_count, then bumps write_seq and futex-wakes it; the
+// consumer works on slot read_seq % slot_count in place, then bumps
+// read_seq. The producer never waits: it drops frames while the ring is full.
+
+const int max_shared_slots = 16;
+
+struct SharedFrameSlot {
+    uint32_t width;
+    uint32_t height;
+    // RGBA8, bottom row first, width * 4 bytes per row.
+    uint64_t size;
+    int64_t index;
+    double time;
+};
+
+struct SharedFrameHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t slot_count;
+    uint64_t slot_offset;
+    uint64_t slot_stride;
+    uint64_t slot_capacity;
+    std::atomic<uint32_t> write_seq;
+    std::atomic<uint32_t> read_seq;
+    std::atomic<uint32_t> closed;
+    SharedFrameSlot slots[max_shared_slots];
+};
+
+struct SharedFrameRing {
+    int fd = -1;
+    size_t map_size = 0;
+    SharedFrameHeader *header = nullptr;
+    unsigned char *base = nullptr;
+};
+
+// Producer side. Each slot holds up to slot_capacity bytes of pixels.
+SharedFrameRing create_shared_frame_ring(int slot_count, size_t slot_capacity);
+// Consumer side, e.g. from /proc/<pid>/fd/<fd> or an inherited descriptor.
+SharedFrameRing open_shared_frame_ring(int fd);
+void close_shared_frame_ring(SharedFrameRing &ring);
+
+unsigned char *shared_slot_pixels(const SharedFrameRing &ring, uint32_t seq);
+
+// Producer: true if the slot for sequence number seq is free to overwrite.
+bool shared_slot_free(const SharedFrameRing &ring, uint32_t seq);
+// Producer: makes the next slot visible to the consumer and wakes it.
+void publish_shared_frame(SharedFrameRing &ring, const SharedFrameSlot &meta);
+// Producer: tells the consumer no more frames are coming.
+void close_shared_frames(SharedFrameRing &ring);
+
+// Consumer: waits up to timeout_ms for an unread frame. Returns its slot,
+// or nullptr on timeout or once the producer has closed the ring.
+const SharedFrameSlot *wait_shared_frame(SharedFrameRing &ring, int timeout_ms);
+// Consumer: hands the slot returned by wait_shared_frame back to the producer.
+void release_shared_frame(SharedFrameRing &ring);
+// Consumer: true once the producer has closed the ring and it is drained.
+bool shared_frames_closed(const SharedFrameRing &ring);
@@ -0,0 +1,151 @@
+#include "sidecar.hpp"
+#include "encode.hpp"
+#include "options.hpp"
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+const char *const shared_frames_env = "SANDY_FRAMES_FD";
+
+pid_t spawn_frame_sidecar(const string &command, const SharedFrameRing &ring) {
+    // The job system's threads are running, so the child may only make
+    // async-signal-safe calls: build its environment up front.
+    string var = string(shared_frames_env) + "=" + to_string(ring.fd);
+    vector<char *> env;
+    for (char **e = environ; *e; ++e) {
+        if (strncmp(*e, var.c_str(), strlen(shared_frames_env) + 1) != 0) {
+            env.push_back(*e);
+        }
+    }
+    env.push_back(&var[0]);
+    env.push_back(nullptr);
+    const char *argv[] = {"sh", "-c", command.c_str(), nullptr};
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        throw runtime_error(string("fork: ") + strerror(errno));
+    }
+
+    if (pid == 0) {
+        int flags = fcntl(ring.fd, F_GETFD);
+        fcntl(ring.fd, F_SETFD, flags & ~FD_CLOEXEC);
+        execve("/bin/sh", const_cast<char *const *>(argv), env.data());
+        _exit(127);
+    }
+
+    clog << "Started frame sidecar " << pid << ": " << command << endl;
+    return pid;
+}
+
+void wait_frame_sidecar(pid_t pid) {
+    int status = 0;
+    if (waitpid(pid, &status, 0) < 0) {
+        return;
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        clog << "Warning: Frame sidecar " << pid << " exited abnormally (status " << status << ")" << endl;
+    }
+}
+
+int run_frame_sidecar(const string &path, const Options &options, JobSystem &jobs) {
+    int fd;
+    if (path == "-") {
+        auto env = getenv(shared_frames_env);
+        if (!env) {
+            throw runtime_error(string(shared_frames_env) + " is not set");
+        }
+        fd = atoi(env);
+    } else {
+        fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+        if (fd < 0) {
+            throw runtime_error("Unable to open \"" + path + "\": " + strerror(errno));
+        }
+    }
+
+    SharedFrameRing ring = open_shared_frame_ring(fd);
+    clog << "Attached to " << ring.header->slot_count << " shared frame slots" << endl;
+
+    unique_ptr<FrameEncoder> encoder;
+    if (!options.capture_out.empty()) {
+        EncoderSettings settings;
+        settings.format = options.capture_format;
+        settings.output = options.capture_out;
+        settings.fps = options.capture_fps;
+        settings.max_in_flight = options.encode_jobs;
+        encoder = make_unique<FrameEncoder>(jobs, settings);
+    }
+
+    long long frames = 0;
+    long long interval_frames = 0;
+    size_t interval_bytes = 0;
+    auto last_report = chrono::steady_clock::now();
+
+    while (!shared_frames_closed(ring)) {
+        auto slot = wait_shared_frame(ring, 100);
+        // The producer is trusted no further than the mapping: a slot
+        // whose size is not its pixels, or overruns it, is dropped.
+        SharedFrameSlot meta;
+        if (slot) {
+            meta = *slot;
+        }
+        if (slot && (meta.size != uint64_t(meta.width) * meta.height * 4 ||
+                     meta.size > ring.header->slot_capacity)) {
+            clog << "Warning: Dropping a shared frame of " << meta.size << " bytes for " << meta.width << "x"
+                 << meta.height << endl;
+            release_shared_frame(ring);
+            slot = nullptr;
+        }
+        if (slot) {
+            // The encoder outlives the slot, so it gets its own copy; without
+            // one the pixels are only ever touched in place.
+            if (encoder) {
+                CapturedFrame frame;
+                frame.width = meta.width;
+                frame.height = meta.height;
+                frame.index = meta.index;
+                frame.time = meta.time;
+                auto pixels = shared_slot_pixels(ring, ring.header->read_seq.load());
+                frame.pixels.assign(pixels, pixels + meta.size);
+                release_shared_frame(ring);
+                encoder->encode(move(frame));
+            } else {
+                interval_bytes += meta.size;
+                release_shared_frame(ring);
+            }
+            ++frames;
+            ++interval_frames;
+        }
+
+        auto now = chrono::steady_clock::now();
+        double elapsed = chrono::duration<double>(now - last_report).count();
+        if (options.pacing_stats && elapsed >= 1.0) {
+            clog << "Received " << interval_frames / elapsed << " frames/s";
+            if (!encoder) {
+                clog << ", " << interval_bytes / (elapsed * 1e6) << " MB/s";
+            }
+            clog << endl;
+            interval_frames = 0;
+            interval_bytes = 0;
+            last_report = now;
+        }
+    }
+
+    if (encoder) {
+        encoder->finish();
+    }
+    clog << "Received " << frames << " frames" << endl;
+    close_shared_frame_ring(ring);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "shm_ring.hpp"
+
+#include <sys/types.h>
+
+#include <string>
+
+class JobSystem;
+struct Options;
+
+// Environment variable carrying the ring's descriptor into a spawned sidecar.
+extern const char *const shared_frames_env;
+
+// Starts `/bin/sh -c command` with the ring's descriptor inherited and its
+// number in SANDY_FRAMES_FD.
+pid_t spawn_frame_sidecar(const std::string &command, const SharedFrameRing &ring);
+// Waits for a spawned sidecar to exit, logging an unclean exit.
+void wait_frame_sidecar(pid_t pid);
+
+// Consumer mode: attaches to a ring published by another instance, given as
+// a path such as /proc/<pid>/fd/<fd> or "-" for SANDY_FRAMES_FD. Frames are
+// encoded when --capture-out is set and counted either way; returns once
+// the producer closes the ring.
+int run_frame_sidecar(const std::string &path, const Options &options, JobSystem &jobs);
@@ -0,0 +1,110 @@
+#include "stream_buffer.hpp"
+#include "glext.hpp"
+
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+// GL_ARB_buffer_storage, core in GL 4.4 and beyond what the loader covers.
+const GLbitfield map_persistent_bit = 0x0040;
+const GLbitfield map_coherent_bit = 0x0080;
+using BufferStorageFn = void(APIENTRY *)(GLenum target, GLsizeiptr size, const void *data, GLbitfield flags);
+
+BufferStorageFn buffer_storage() {
+    if (!has_gl_extension("GL_ARB_buffer_storage")) {
+        return nullptr;
+    }
+    return reinterpret_cast<BufferStorageFn>(glfwGetProcAddress("glBufferStorage"));
+}
+}
+
+StreamBuffer create_stream_buffer(GLenum target, GLsizeiptr slot_size, int slots) {
+    StreamBuffer rv;
+    rv.target = target;
+    rv.slot_size = slot_size;
+    glGenBuffers(1, &rv.buffer);
+    glBindBuffer(target, rv.buffer);
+
+    BufferStorageFn storage = buffer_storage();
+    if (storage) {
+        slots = max(slots, 1);
+        GLbitfield flags = GL_MAP_WRITE_BIT | map_persistent_bit | map_coherent_bit;
+        storage(target, slot_size * slots, nullptr, flags);
+        rv.mapped = static_cast<unsigned char *>(glMapBufferRange(target, 0, slot_size * slots, flags));
+        if (rv.mapped) {
+            rv.fences.assign(slots, nullptr);
+        } else {
+            // Immutable storage can't be orphaned; start over with a mutable
+            // buffer.
+            glDeleteBuffers(1, &rv.buffer);
+            glGenBuffers(1, &rv.buffer);
+            glBindBuffer(target, rv.buffer);
+        }
+    }
+    if (!rv.mapped) {
+        rv.fences.assign(1, nullptr);
+        glBufferData(target, slot_size, nullptr, GL_STREAM_DRAW);
+    }
+    glBindBuffer(target, 0);
+    return rv;
+}
+
+void destroy_stream_buffer(StreamBuffer &stream) {
+    for (auto fence : stream.fences) {
+        if (fence) {
+            glDeleteSync(fence);
+        }
+    }
+    if (stream.mapped) {
+        glBindBuffer(stream.target, stream.buffer);
+        glUnmapBuffer(stream.target);
+        glBindBuffer(stream.target, 0);
+    }
+    glDeleteBuffers(1, &stream.buffer);
+    stream = StreamBuffer{};
+}
+
+void *map_stream_slot(StreamBuffer &stream) {
+    if (!stream.mapped) {
+        glBindBuffer(stream.target, stream.buffer);
+        glBufferData(stream.target, stream.slot_size, nullptr, GL_STREAM_DRAW);
+        void *rv = glMapBufferRange(stream.target, 0, stream.slot_size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (!rv) {
+            throw runtime_error("Unable to map a stream buffer");
+        }
+        return rv;
+    }
+
+    stream.slot = (stream.slot + 1) % stream.fences.size();
+    GLsync &fence = stream.fences[stream.slot];
+    if (fence) {
+        if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+            ++stream.stalls;
+            while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 100000000) == GL_TIMEOUT_EXPIRED) {
+            }
+        }
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+    return stream.mapped + stream.slot * stream.slot_size;
+}
+
+GLintptr unmap_stream_slot(StreamBuffer &stream) {
+    if (!stream.mapped) {
+        glUnmapBuffer(stream.target);
+        glBindBuffer(stream.target, 0);
+        return 0;
+    }
+    return stream.slot * stream.slot_size;
+}
+
+void fence_stream_slot(StreamBuffer &stream) {
+    // Orphaning leaves the synchronisation to the driver.
+    if (stream.mapped) {
+        stream.fences[stream.slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+}
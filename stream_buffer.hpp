@@ -0,0 +1,37 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <vector>
+
+// A buffer the CPU rewrites every frame, for uniforms and other per-draw
+// data. It is split into slots used round robin, so the CPU never writes
+// where the GPU may still be reading.
+//
+// With GL_ARB_buffer_storage the whole buffer is mapped once, persistent
+// and coherent, and each slot gets a fence saying when it can be reused.
+// Writing is then a plain memcpy, with no map, unmap or uniform calls.
+// Without the extension there is one slot, orphaned and mapped every frame.
+struct StreamBuffer {
+    GLuint buffer = 0;
+    GLenum target = GL_UNIFORM_BUFFER;
+    GLsizeiptr slot_size = 0;
+    // One per slot, set once the GPU has been given the slot's draws.
+    std::vector<GLsync> fences;
+    int slot = 0;
+    // The whole buffer when persistently mapped, otherwise null.
+    unsigned char *mapped = nullptr;
+    // Times a slot was still in use and the CPU had to wait for it.
+    long long stalls = 0;
+};
+
+StreamBuffer create_stream_buffer(GLenum target, GLsizeiptr slot_size, int slots = 3);
+void destroy_stream_buffer(StreamBuffer &stream);
+
+// Moves to the next slot and returns where to write its slot_size bytes.
+void *map_stream_slot(StreamBuffer &stream);
+// Ends the writes. Returns the slot's offset in buffer for glBindBufferRange
+// and the like.
+GLintptr unmap_stream_slot(StreamBuffer &stream);
+// After the last command that reads the slot.
+void fence_stream_slot(StreamBuffer &stream);
@@ -0,0 +1,297 @@
+#include "swrast.hpp"
+#include "cpu_shading.hpp"
+#include "jobs.hpp"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace glm;
+
+namespace {
+using Triangle = SoftwareRasterizer::Triangle;
+
+const float subpixels = 16.f;
+
+// Returns false for degenerate triangles.
+bool setup_triangle(const ClipVertex *v, int width, int height, int draw, Triangle &t) {
+    for (int i = 0; i < 3; ++i) {
+        float inv_w = 1.f / v[i].clip.w;
+        t.x[i] = std::round((v[i].clip.x * inv_w * 0.5f + 0.5f) * width * subpixels) / subpixels;
+        t.y[i] = std::round((v[i].clip.y * inv_w * 0.5f + 0.5f) * height * subpixels) / subpixels;
+        t.z[i] = v[i].clip.z * inv_w * 0.5f + 0.5f;
+        t.inv_w[i] = inv_w;
+        t.uv[i] = v[i].uv * inv_w;
+        t.normal[i] = v[i].normal * inv_w;
+    }
+
+    for (int i = 0; i < 3; ++i) {
+        int j = (i + 1) % 3;
+        int k = (i + 2) % 3;
+        t.a[i] = double(t.y[j]) - t.y[k];
+        t.b[i] = double(t.x[k]) - t.x[j];
+        t.c[i] = -(t.a[i] * t.x[j] + t.b[i] * t.y[j]);
+    }
+    double area = t.a[0] * t.x[0] + (t.b[0] * t.y[0] + t.c[0]);
+    if (area == 0 || !std::isfinite(area)) {
+        return false;
+    }
+    // No face culling in the scene, so flip clockwise triangles around.
+    if (area < 0) {
+        for (int i = 0; i < 3; ++i) {
+            t.a[i] = -t.a[i];
+            t.b[i] = -t.b[i];
+            t.c[i] = -t.c[i];
+        }
+        area = -area;
+    }
+    for (int i = 0; i < 3; ++i) {
+        t.top_left[i] = t.a[i] > 0 || (t.a[i] == 0 && t.b[i] < 0);
+    }
+    t.inv_area = float(1.0 / area);
+
+    float min_x = min({t.x[0], t.x[1], t.x[2]});
+    float max_x = max({t.x[0], t.x[1], t.x[2]});
+    float min_y = min({t.y[0], t.y[1], t.y[2]});
+    float max_y = max({t.y[0], t.y[1], t.y[2]});
+    // Pixels whose centres can be covered.
+    t.min_x = max(int(std::ceil(min_x - 0.5f)), 0);
+    t.min_y = max(int(std::ceil(min_y - 0.5f)), 0);
+    t.max_x = min(int(std::floor(max_x - 0.5f)), width - 1);
+    t.max_y = min(int(std::floor(max_y - 0.5f)), height - 1);
+    t.draw = draw;
+    return t.min_x <= t.max_x && t.min_y <= t.max_y;
+}
+
+bool covers(const Triangle &t, int i, double e) {
+    return e > 0 || (e == 0 && t.top_left[i]);
+}
+}
+
+CpuScene make_cpu_scene(const SceneAssets &assets) {
+    CpuScene rv;
+    rv.mesh = index_mesh(assets.mesh);
+    rv.flame = index_mesh(assets.flame);
+    rv.meshImage = assets.meshImage;
+    rv.flameImage = assets.flameImage;
+    rv.dither = assets.ditherMap;
+    return rv;
+}
+
+SoftwareRasterizer::SoftwareRasterizer(JobSystem &jobs, int tile_size) : jobs(jobs), tile_size(tile_size) {
+}
+
+void SoftwareRasterizer::render(const CpuScene &scene, const SceneParams &params, int width, int height,
+                                vector<unsigned char> &pixels) {
+    this->width = width;
+    this->height = height;
+    tiles_x = (width + tile_size - 1) / tile_size;
+    tiles_y = (height + tile_size - 1) / tile_size;
+
+    mat4 models[] = {params.model, flame_model(params)};
+    const IndexedMesh *meshes[] = {&scene.mesh, &scene.flame};
+    const ImageView *textures[] = {&scene.meshImage, &scene.flameImage};
+
+    draws.clear();
+    transformed.resize(2);
+    size_t num_triangles = 0;
+    for (int d = 0; d < 2; ++d) {
+        draws.push_back({meshes[d], textures[d], num_triangles, meshes[d]->triangles()});
+        num_triangles += meshes[d]->triangles();
+    }
+
+    // Vertex stage, once per unique vertex; triangles fetch the results by
+    // index during setup.
+    for (int d = 0; d < 2; ++d) {
+        const IndexedMesh &mesh = *meshes[d];
+        mat4 mvp = params.cam_proj * params.cam_view * models[d];
+        mat4 normal_matrix = transpose(inverse(params.cam_view * models[d]));
+        TransformedVertices &out = transformed[d];
+        prepare_transformed(out, mesh);
+        jobs.parallel_for(0, int(mesh.vertices), 4096, [&](int lo, int hi) {
+            transform_vertices(mesh, mvp, normal_matrix, out, lo, hi);
+        });
+    }
+
+    // Setup and binning, in contiguous chunks so tiles can replay them in
+    // submission order.
+    size_t workers = jobs.num_workers() + 1;
+    size_t num_chunks = max<size_t>(1, min(workers * 4, num_triangles / 1024));
+    chunks.resize(num_chunks);
+    chunk_starts.resize(num_chunks + 1);
+    for (size_t c = 0; c <= num_chunks; ++c) {
+        chunk_starts[c] = num_triangles * c / num_chunks;
+    }
+    jobs.parallel_for(0, int(num_chunks), 1, [&](int lo, int hi) {
+        for (int c = lo; c < hi; ++c) {
+            setup_chunk(chunks[c], chunk_starts[c], chunk_starts[c + 1]);
+        }
+    });
+    binned = 0;
+    for (auto &chunk : chunks) {
+        binned += chunk.triangles.size();
+    }
+
+    depth.assign(size_t(width) * height, 1.f);
+    pixels.resize(size_t(width) * height * 4);
+    unsigned char *out = pixels.data();
+    jobs.parallel_for(0, tiles_x * tiles_y, 1, [&](int lo, int hi) {
+        for (int tile = lo; tile < hi; ++tile) {
+            rasterize_tile(tile, scene, params, out);
+        }
+    });
+}
+
+void SoftwareRasterizer::setup_chunk(Chunk &chunk, size_t first, size_t last) {
+    chunk.triangles.clear();
+    chunk.bins.resize(tiles_x * tiles_y);
+    for (auto &bin : chunk.bins) {
+        bin.clear();
+    }
+
+    auto bin_triangle = [&](const Triangle &t) {
+        uint32_t index = chunk.triangles.size();
+        chunk.triangles.push_back(t);
+        for (int ty = t.min_y / tile_size; ty <= t.max_y / tile_size; ++ty) {
+            for (int tx = t.min_x / tile_size; tx <= t.max_x / tile_size; ++tx) {
+                chunk.bins[ty * tiles_x + tx].push_back(index);
+            }
+        }
+    };
+
+    size_t draw = 0;
+    for (size_t tri = first; tri < last; ++tri) {
+        while (tri >= draws[draw].first_triangle + draws[draw].triangles) {
+            ++draw;
+        }
+        const IndexedMesh &mesh = *draws[draw].mesh;
+        const TransformedVertices &post = transformed[draw];
+        const uint32_t *index = &mesh.indices[(tri - draws[draw].first_triangle) * 3];
+
+        unsigned codes[3] = {post.outcodes[index[0]], post.outcodes[index[1]], post.outcodes[index[2]]};
+        if (codes[0] & codes[1] & codes[2]) {
+            continue;
+        }
+        ClipVertex poly[max_clipped_vertices] = {fetch_vertex(post, mesh, index[0]),
+                                                 fetch_vertex(post, mesh, index[1]),
+                                                 fetch_vertex(post, mesh, index[2])};
+
+        Triangle t;
+        unsigned clip_mask = codes[0] | codes[1] | codes[2];
+        if (!clip_mask) {
+            if (setup_triangle(poly, width, height, draw, t)) {
+                bin_triangle(t);
+            }
+            continue;
+        }
+
+        int n = clip_polygon(poly, 3, clip_mask);
+        for (int i = 1; i + 1 < n; ++i) {
+            ClipVertex fan[3] = {poly[0], poly[i], poly[i + 1]};
+            if (setup_triangle(fan, width, height, draw, t)) {
+                bin_triangle(t);
+            }
+        }
+    }
+}
+
+void SoftwareRasterizer::rasterize_tile(int tile, const CpuScene &scene, const SceneParams &params,
+                                        unsigned char *pixels) {
+    int tile_x0 = (tile % tiles_x) * tile_size;
+    int tile_y0 = (tile / tiles_x) * tile_size;
+    int tile_x1 = min(tile_x0 + tile_size, width) - 1;
+    int tile_y1 = min(tile_y0 + tile_size, height) - 1;
+
+    auto fragment = [&](const Triangle &t, int px, int py, double e0, double e1, double e2) {
+        float l0 = float(e0) * t.inv_area;
+        float l1 = float(e1) * t.inv_area;
+        float l2 = float(e2) * t.inv_area;
+        float z = l0 * t.z[0] + l1 * t.z[1] + l2 * t.z[2];
+        float &d = depth[size_t(py) * width + px];
+        if (!(z < d) || z < 0.f) {
+            return;
+        }
+        d = z;
+
+        float w = 1.f / (l0 * t.inv_w[0] + l1 * t.inv_w[1] + l2 * t.inv_w[2]);
+        vec2 uv = (t.uv[0] * l0 + t.uv[1] * l1 + t.uv[2] * l2) * w;
+        vec3 normal = (t.normal[0] * l0 + t.normal[1] * l1 + t.normal[2] * l2) * w;
+        vec2 frag_coord = vec2(px + 0.5f, py + 0.5f) + params.frag_offset;
+        const ImageView &texture = *draws[t.draw].texture;
+        store_color(pixels + (size_t(py) * width + px) * 4,
+                    shade_fragment(texture, scene.dither, uv, normal, params.light_pos, frag_coord));
+    };
+
+    for (int y = tile_y0; y <= tile_y1; ++y) {
+        unsigned char *row = pixels + (size_t(y) * width + tile_x0) * 4;
+        for (int x = tile_x0; x <= tile_x1; ++x, row += 4) {
+            store_clear_color(row);
+        }
+    }
+
+    for (auto &chunk : chunks) {
+        for (uint32_t index : chunk.bins[tile]) {
+            const Triangle &t = chunk.triangles[index];
+            int x0 = max(t.min_x, tile_x0);
+            int x1 = min(t.max_x, tile_x1);
+            int y0 = max(t.min_y, tile_y0);
+            int y1 = min(t.max_y, tile_y1);
+
+            for (int py = y0; py <= y1; ++py) {
+                double cy = py + 0.5;
+                double row[3];
+                for (int i = 0; i < 3; ++i) {
+                    row[i] = t.b[i] * cy + t.c[i];
+                }
+                int px = x0;
+#ifdef __SSE2__
+                // Two pixels per register; double keeps the edge test exact.
+                __m128d zero = _mm_setzero_pd();
+                __m128d a[3], r[3], tl[3];
+                for (int i = 0; i < 3; ++i) {
+                    a[i] = _mm_set1_pd(t.a[i]);
+                    r[i] = _mm_set1_pd(row[i]);
+                    tl[i] = _mm_castsi128_pd(_mm_set1_epi32(t.top_left[i] ? -1 : 0));
+                }
+                for (; px + 1 <= x1; px += 2) {
+                    __m128d cx = _mm_set_pd(px + 1.5, px + 0.5);
+                    __m128d e[3];
+                    __m128d inside = _mm_castsi128_pd(_mm_set1_epi32(-1));
+                    for (int i = 0; i < 3; ++i) {
+                        e[i] = _mm_add_pd(_mm_mul_pd(a[i], cx), r[i]);
+                        __m128d edge = _mm_or_pd(_mm_cmpgt_pd(e[i], zero),
+                                                 _mm_and_pd(_mm_cmpeq_pd(e[i], zero), tl[i]));
+                        inside = _mm_and_pd(inside, edge);
+                    }
+                    int mask = _mm_movemask_pd(inside);
+                    if (!mask) {
+                        continue;
+                    }
+                    alignas(16) double e0[2], e1[2], e2[2];
+                    _mm_store_pd(e0, e[0]);
+                    _mm_store_pd(e1, e[1]);
+                    _mm_store_pd(e2, e[2]);
+                    for (int k = 0; k < 2; ++k) {
+                        if (mask & (1 << k)) {
+                            fragment(t, px + k, py, e0[k], e1[k], e2[k]);
+                        }
+                    }
+                }
+#endif
+                for (; px <= x1; ++px) {
+                    double cx = px + 0.5;
+                    double e0 = t.a[0] * cx + row[0];
+                    double e1 = t.a[1] * cx + row[1];
+                    double e2 = t.a[2] * cx + row[2];
+                    if (covers(t, 0, e0) && covers(t, 1, e1) && covers(t, 2, e2)) {
+                        fragment(t, px, py, e0, e1, e2);
+                    }
+                }
+            }
+        }
+    }
+}
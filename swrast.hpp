@@ -0,0 +1,94 @@
+#pragma once
+
+#include "scene.hpp"
+#include "vertex_pipeline.hpp"
+
+#include <cstdint>
+#include <vector>
+
+class JobSystem;
+
+// CPU-side copies of what load_scene uploads, for the software backends.
+// Meshes are welded copies; the image views borrow from whatever they were
+// made from.
+struct CpuScene {
+    IndexedMesh mesh;
+    IndexedMesh flame;
+    ImageView meshImage;
+    ImageView flameImage;
+    DitherVolume dither;
+};
+
+CpuScene make_cpu_scene(const SceneAssets &assets);
+
+// data/vertex.glsl and data/frag.glsl without a GPU: unique vertices are
+// transformed in parallel, triangles are clipped, set up and binned into
+// screen tiles by contiguous chunks, and each tile is rasterized by one job
+// walking the chunks in order, so draw order and depth ties resolve as on
+// the GPU. Coverage is tested several pixels at a time.
+class SoftwareRasterizer {
+public:
+    explicit SoftwareRasterizer(JobSystem &jobs, int tile_size = 64);
+
+    // RGBA8, bottom row first, as glReadPixels would return it.
+    void render(const CpuScene &scene, const SceneParams &params, int width, int height,
+                std::vector<unsigned char> &pixels);
+
+    // Of the last render.
+    long long triangles_binned() const {
+        return binned;
+    }
+
+    struct Triangle {
+        // Window coordinates, depth in [0, 1] and 1/w per vertex.
+        float x[3];
+        float y[3];
+        float z[3];
+        float inv_w[3];
+        // Attributes divided by w, for perspective-correct interpolation.
+        glm::vec2 uv[3];
+        glm::vec3 normal[3];
+        // Edge i is opposite vertex i: a * x + b * y + c, >= 0 inside. With
+        // vertices snapped to 1/16 pixel this is exact in double precision,
+        // so triangles sharing an edge never both cover or both miss a pixel.
+        double a[3];
+        double b[3];
+        double c[3];
+        bool top_left[3];
+        float inv_area;
+        int min_x, min_y, max_x, max_y;
+        int draw;
+    };
+
+private:
+    struct Draw {
+        const IndexedMesh *mesh;
+        const ImageView *texture;
+        size_t first_triangle;
+        size_t triangles;
+    };
+
+    struct Chunk {
+        std::vector<Triangle> triangles;
+        // Triangle indices per tile.
+        std::vector<std::vector<uint32_t>> bins;
+    };
+
+    void setup_chunk(Chunk &chunk, size_t first, size_t last);
+    void rasterize_tile(int tile, const CpuScene &scene, const SceneParams &params, unsigned char *pixels);
+
+    JobSystem &jobs;
+    int tile_size;
+    int width = 0;
+    int height = 0;
+    int tiles_x = 0;
+    int tiles_y = 0;
+
+    std::vector<Draw> draws;
+    // One per draw.
+    std::vector<TransformedVertices> transformed;
+    std::vector<size_t> chunk_starts;
+    std::vector<Chunk> chunks;
+    std::vector<float> depth;
+    long long binned = 0;
+};
@@ -0,0 +1,278 @@
+#include "tiled.hpp"
+#include "asset_cache.hpp"
+#include "encode.hpp"
+#include "jobs.hpp"
+#include "options.hpp"
+#include "scene.hpp"
+#include "server.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace glm;
+
+namespace {
+struct Tile {
+    int x;
+    int y;
+    int width;
+    int height;
+};
+
+struct Worker {
+    pid_t pid = 0;
+    string socket;
+    int fd = -1;
+    long long tiles = 0;
+};
+
+const char *aa_name(AntiAliasing aa) {
+    switch (aa) {
+        case AntiAliasing::none:
+            return "none";
+        case AntiAliasing::msaa:
+            return "msaa";
+        case AntiAliasing::fxaa:
+            return "fxaa";
+    }
+    return "none";
+}
+
+const char *renderer_name(Renderer renderer) {
+    switch (renderer) {
+        case Renderer::gl:
+            return "gl";
+        case Renderer::vulkan:
+            return "vulkan";
+        case Renderer::cpu:
+            return "cpu";
+        case Renderer::trace:
+            return "trace";
+    }
+    return "gl";
+}
+
+pid_t spawn_worker(const string &socket, const string &cache, const Options &options, AntiAliasing aa) {
+    // Everything the child needs is built before fork(); the job system's
+    // threads make anything else unsafe there.
+    vector<string> args = {
+            "shader_sandy", "--serve", socket, "--asset-cache", cache, "--threads", "1",
+            "--aa", aa_name(aa), "--msaa", to_string(options.msaa_samples),
+            "--renderer", renderer_name(options.renderer),
+    };
+    if (!options.pipeline_cache.empty()) {
+        args.push_back("--pipeline-cache");
+        args.push_back(options.pipeline_cache);
+    }
+    if (!options.asset_store.empty()) {
+        args.push_back("--asset-store");
+        args.push_back(options.asset_store);
+    }
+    vector<char *> argv;
+    for (auto &a : args) {
+        argv.push_back(&a[0]);
+    }
+    argv.push_back(nullptr);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        throw runtime_error(string("fork: ") + strerror(errno));
+    }
+    if (pid == 0) {
+        execv("/proc/self/exe", argv.data());
+        _exit(127);
+    }
+    return pid;
+}
+
+// Workers load the scene before they listen, so keep trying until they do.
+int connect_worker(const Worker &worker) {
+    auto deadline = chrono::steady_clock::now() + chrono::seconds(30);
+    while (true) {
+        try {
+            return connect_render_server(worker.socket);
+        } catch (const runtime_error &) {
+            if (waitpid(worker.pid, nullptr, WNOHANG) == worker.pid) {
+                throw runtime_error("Tile worker " + to_string(worker.pid) + " exited during startup");
+            }
+            if (chrono::steady_clock::now() > deadline) {
+                throw;
+            }
+            this_thread::sleep_for(chrono::milliseconds(50));
+        }
+    }
+}
+
+}
+
+mat4 tile_projection(const mat4 &proj, int full_width, int full_height, int x, int y, int width, int height) {
+    // Scale and shift clip space so the tile's NDC range becomes [-1, 1].
+    float sx = float(full_width) / width;
+    float sy = float(full_height) / height;
+    float cx = float(2 * x + width) / full_width - 1.f;
+    float cy = float(2 * y + height) / full_height - 1.f;
+    return scale(mat4(1.f), vec3(sx, sy, 1.f)) * translate(mat4(1.f), vec3(-cx, -cy, 0.f)) * proj;
+}
+
+int run_tiled_render(const Options &options, JobSystem &jobs) {
+    int width, height;
+    parse_size(options.poster, width, height);
+    int tile_size = min(max(options.tile_size, 16), max_render_size);
+    unsigned num_workers = options.tile_workers > 0 ? options.tile_workers : max(thread::hardware_concurrency(), 1u);
+
+    AntiAliasing aa = options.aa;
+    if (aa == AntiAliasing::fxaa && options.renderer == Renderer::gl) {
+        // FXAA can't see across tile edges and would leave seams.
+        clog << "Warning: FXAA is per tile, using MSAA for the poster" << endl;
+        aa = AntiAliasing::msaa;
+    }
+
+    vector<Tile> tiles;
+    for (int y = 0; y < height; y += tile_size) {
+        for (int x = 0; x < width; x += tile_size) {
+            tiles.push_back({x, y, min(tile_size, width - x), min(tile_size, height - y)});
+        }
+    }
+    num_workers = min<size_t>(num_workers, tiles.size());
+
+    auto start = chrono::steady_clock::now();
+    // Sockets and the asset cache go in a directory only we can get at, so
+    // nobody else can put a file where the workers will look.
+    char dir_template[] = "/tmp/sandy-XXXXXX";
+    if (!mkdtemp(dir_template)) {
+        throw runtime_error(string("Unable to create a temporary directory: ") + strerror(errno));
+    }
+    string dir = dir_template;
+    string cache = options.asset_cache.empty() ? dir + "/assets.cache" : options.asset_cache;
+    vector<Worker> workers;
+
+    auto shut_down = [&] {
+        for (auto &w : workers) {
+            if (w.fd >= 0) {
+                close(w.fd);
+            }
+            if (w.pid > 0) {
+                kill(w.pid, SIGTERM);
+                waitpid(w.pid, nullptr, 0);
+            }
+            unlink(w.socket.c_str());
+        }
+        if (options.asset_cache.empty()) {
+            unlink(cache.c_str());
+        }
+        rmdir(dir.c_str());
+    };
+
+    CapturedFrame image;
+    double render_seconds = 0;
+    try {
+        if (options.asset_cache.empty() || access(cache.c_str(), R_OK) != 0) {
+            write_asset_cache(cache, parse_scene_assets(jobs));
+        }
+
+        workers.resize(num_workers);
+        for (unsigned i = 0; i < num_workers; ++i) {
+            workers[i].socket = dir + "/tile" + to_string(i) + ".sock";
+            workers[i].pid = spawn_worker(workers[i].socket, cache, options, aa);
+        }
+
+        for (auto &w : workers) {
+            w.fd = connect_worker(w);
+        }
+        double startup_seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        clog << "Rendering " << width << "x" << height << " as " << tiles.size() << " tiles on " << num_workers
+             << " workers (" << startup_seconds << " s startup)" << endl;
+
+        image.width = width;
+        image.height = height;
+        image.pixels.resize(size_t(width) * height * 4);
+
+        SceneParams base = default_scene_params(float(width) / height);
+        atomic<size_t> next_tile{0};
+        vector<exception_ptr> errors(num_workers);
+        vector<thread> threads;
+
+        auto render_start = chrono::steady_clock::now();
+        for (unsigned i = 0; i < num_workers; ++i) {
+            threads.emplace_back([&, i] {
+                vector<unsigned char> pixels;
+                try {
+                    for (size_t t = next_tile++; t < tiles.size(); t = next_tile++) {
+                        auto &tile = tiles[t];
+                        SceneParams params = base;
+                        params.cam_proj = tile_projection(base.cam_proj, width, height, tile.x, tile.y, tile.width,
+                                                          tile.height);
+                        params.frag_offset = vec2(tile.x, tile.y);
+
+                        RenderReply reply = request_render(workers[i].fd,
+                                                           make_render_request(params, tile.width, tile.height),
+                                                           pixels);
+                        if (reply.status != RenderStatus::ok) {
+                            throw runtime_error("Tile worker refused a " + to_string(tile.width) + "x" +
+                                                to_string(tile.height) + " tile");
+                        }
+                        // Both are bottom row first, so tile row r is image row y + r.
+                        for (int r = 0; r < tile.height; ++r) {
+                            memcpy(&image.pixels[(size_t(tile.y + r) * width + tile.x) * 4],
+                                   &pixels[size_t(r) * tile.width * 4], size_t(tile.width) * 4);
+                        }
+                        ++workers[i].tiles;
+                    }
+                } catch (...) {
+                    errors[i] = current_exception();
+                    next_tile = tiles.size();
+                }
+            });
+        }
+        for (auto &t : threads) {
+            t.join();
+        }
+        render_seconds = chrono::duration<double>(chrono::steady_clock::now() - render_start).count();
+
+        for (auto &e : errors) {
+            if (e) {
+                rethrow_exception(e);
+            }
+        }
+    } catch (...) {
+        shut_down();
+        throw;
+    }
+    shut_down();
+
+    for (unsigned i = 0; i < num_workers; ++i) {
+        clog << "Worker " << i << ": " << workers[i].tiles << " tiles" << endl;
+    }
+    clog << "Rendered " << tiles.size() << " tiles in " << render_seconds << " s, "
+         << double(width) * height / (render_seconds * 1e6) << " Mpixel/s" << endl;
+
+    vector<unsigned char> bytes =
+            options.capture_format == ImageFormat::qoi ? encode_qoi(image) : encode_png(image);
+    ofstream file(options.poster_out, ios::binary);
+    file.write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+    if (!file) {
+        throw runtime_error("Unable to write \"" + options.poster_out + "\"");
+    }
+
+    double total_seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    clog << "Wrote " << options.poster_out << " in " << total_seconds << " s total" << endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+class JobSystem;
+struct Options;
+
+// Narrows proj to the pixel rectangle (x, y, width, height) of a
+// full_width x full_height image, so rendering that rectangle alone gives
+// exactly the pixels the full render would have there.
+glm::mat4 tile_projection(const glm::mat4 &proj, int full_width, int full_height, int x, int y, int width,
+                          int height);
+
+// Renders one --poster image too large for a single framebuffer. Assets are
+// parsed once into an asset cache; --tile-workers render servers map it and
+// each pull tiles until none are left. Tiles are stitched and encoded here.
+int run_tiled_render(const Options &options, JobSystem &jobs);
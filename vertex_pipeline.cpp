@@ -0,0 +1,238 @@
+#include "vertex_pipeline.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SANDY_AVX2_TARGET
+#include <immintrin.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+using namespace std;
+using namespace glm;
+
+namespace {
+const size_t lanes = 8;
+
+struct VertexKey {
+    uint32_t bits[8];
+
+    bool operator==(const VertexKey &other) const {
+        return memcmp(bits, other.bits, sizeof(bits)) == 0;
+    }
+};
+
+struct VertexKeyHash {
+    size_t operator()(const VertexKey &key) const {
+        // FNV-1a over the words.
+        uint64_t h = 14695981039346656037ull;
+        for (uint32_t word : key.bits) {
+            h = (h ^ word) * 1099511628211ull;
+        }
+        return size_t(h);
+    }
+};
+
+size_t padded(size_t n) {
+    return (n + lanes - 1) / lanes * lanes;
+}
+
+float plane_distance(const ClipVertex &v, int plane) {
+    switch (plane) {
+        case 0:
+            return v.clip.w + v.clip.z;
+        case 1:
+            return v.clip.w - v.clip.z;
+        case 2:
+            return guard_band * v.clip.w - v.clip.x;
+        case 3:
+            return guard_band * v.clip.w + v.clip.x;
+        case 4:
+            return guard_band * v.clip.w - v.clip.y;
+        default:
+            return guard_band * v.clip.w + v.clip.y;
+    }
+}
+
+ClipVertex lerp(const ClipVertex &a, const ClipVertex &b, float t) {
+    ClipVertex rv;
+    rv.clip = mix(a.clip, b.clip, t);
+    rv.uv = mix(a.uv, b.uv, t);
+    rv.normal = mix(a.normal, b.normal, t);
+    return rv;
+}
+
+// Products are summed left to right, as glm's mat4 * vec4 does, and the
+// AVX2 path below does the same without FMA, so both round identically.
+void transform_scalar(const IndexedMesh &mesh, const mat4 &m, const mat4 &n, TransformedVertices &out,
+                      size_t first, size_t last) {
+    for (size_t i = first; i < last; ++i) {
+        float px = mesh.px[i], py = mesh.py[i], pz = mesh.pz[i];
+        float x = m[0][0] * px + m[1][0] * py + m[2][0] * pz + m[3][0];
+        float y = m[0][1] * px + m[1][1] * py + m[2][1] * pz + m[3][1];
+        float z = m[0][2] * px + m[1][2] * py + m[2][2] * pz + m[3][2];
+        float w = m[0][3] * px + m[1][3] * py + m[2][3] * pz + m[3][3];
+        out.x[i] = x;
+        out.y[i] = y;
+        out.z[i] = z;
+        out.w[i] = w;
+
+        float nx = mesh.nx[i], ny = mesh.ny[i], nz = mesh.nz[i];
+        out.nx[i] = n[0][0] * nx + n[1][0] * ny + n[2][0] * nz + n[3][0];
+        out.ny[i] = n[0][1] * nx + n[1][1] * ny + n[2][1] * nz + n[3][1];
+        out.nz[i] = n[0][2] * nx + n[1][2] * ny + n[2][2] * nz + n[3][2];
+
+        float gw = guard_band * w;
+        unsigned code = 0;
+        code |= w + z < 0 ? clip_near : 0u;
+        code |= w - z < 0 ? clip_far : 0u;
+        code |= gw - x < 0 ? clip_right : 0u;
+        code |= gw + x < 0 ? clip_left : 0u;
+        code |= gw - y < 0 ? clip_top : 0u;
+        code |= gw + y < 0 ? clip_bottom : 0u;
+        out.outcodes[i] = uint8_t(code);
+    }
+}
+
+#ifdef SANDY_AVX2_TARGET
+__attribute__((target("avx2"))) inline __m256 row(const mat4 &m, int r, __m256 x, __m256 y, __m256 z) {
+    __m256 acc = _mm256_mul_ps(_mm256_set1_ps(m[0][r]), x);
+    acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_set1_ps(m[1][r]), y));
+    acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_set1_ps(m[2][r]), z));
+    return _mm256_add_ps(acc, _mm256_set1_ps(m[3][r]));
+}
+
+__attribute__((target("avx2"))) inline __m256i outside(__m256 distance, unsigned bit) {
+    __m256 mask = _mm256_cmp_ps(distance, _mm256_setzero_ps(), _CMP_LT_OQ);
+    return _mm256_and_si256(_mm256_castps_si256(mask), _mm256_set1_epi32(int(bit)));
+}
+
+__attribute__((target("avx2"))) void transform_avx2(const IndexedMesh &mesh, const mat4 &m, const mat4 &n,
+                                                    TransformedVertices &out, size_t first, size_t last) {
+    __m256 band = _mm256_set1_ps(guard_band);
+    for (size_t i = first; i < last; i += lanes) {
+        __m256 px = _mm256_loadu_ps(&mesh.px[i]);
+        __m256 py = _mm256_loadu_ps(&mesh.py[i]);
+        __m256 pz = _mm256_loadu_ps(&mesh.pz[i]);
+        __m256 x = row(m, 0, px, py, pz);
+        __m256 y = row(m, 1, px, py, pz);
+        __m256 z = row(m, 2, px, py, pz);
+        __m256 w = row(m, 3, px, py, pz);
+        _mm256_storeu_ps(&out.x[i], x);
+        _mm256_storeu_ps(&out.y[i], y);
+        _mm256_storeu_ps(&out.z[i], z);
+        _mm256_storeu_ps(&out.w[i], w);
+
+        __m256 nx = _mm256_loadu_ps(&mesh.nx[i]);
+        __m256 ny = _mm256_loadu_ps(&mesh.ny[i]);
+        __m256 nz = _mm256_loadu_ps(&mesh.nz[i]);
+        _mm256_storeu_ps(&out.nx[i], row(n, 0, nx, ny, nz));
+        _mm256_storeu_ps(&out.ny[i], row(n, 1, nx, ny, nz));
+        _mm256_storeu_ps(&out.nz[i], row(n, 2, nx, ny, nz));
+
+        __m256 gw = _mm256_mul_ps(band, w);
+        __m256i code = outside(_mm256_add_ps(w, z), clip_near);
+        code = _mm256_or_si256(code, outside(_mm256_sub_ps(w, z), clip_far));
+        code = _mm256_or_si256(code, outside(_mm256_sub_ps(gw, x), clip_right));
+        code = _mm256_or_si256(code, outside(_mm256_add_ps(gw, x), clip_left));
+        code = _mm256_or_si256(code, outside(_mm256_sub_ps(gw, y), clip_top));
+        code = _mm256_or_si256(code, outside(_mm256_add_ps(gw, y), clip_bottom));
+
+        // Every lane fits a byte: narrow 8 x i32 down to the low 8 bytes.
+        __m256i bytes = _mm256_shuffle_epi8(code, _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1,
+                                                                   -1, -1, -1, -1, 0, 4, 8, 12, -1, -1, -1, -1,
+                                                                   -1, -1, -1, -1, -1, -1, -1, -1));
+        uint32_t lo = uint32_t(_mm256_extract_epi32(bytes, 0));
+        uint32_t hi = uint32_t(_mm256_extract_epi32(bytes, 4));
+        memcpy(&out.outcodes[i], &lo, 4);
+        memcpy(&out.outcodes[i + 4], &hi, 4);
+    }
+}
+#endif
+}
+
+IndexedMesh index_mesh(const MeshView &mesh) {
+    IndexedMesh rv;
+    size_t count = mesh.floats / 8 / 3 * 3;
+    rv.indices.reserve(count);
+
+    unordered_map<VertexKey, uint32_t, VertexKeyHash> seen;
+    seen.reserve(count);
+    vector<size_t> firsts;
+    for (size_t i = 0; i < count; ++i) {
+        VertexKey key;
+        memcpy(key.bits, mesh.data + i * 8, sizeof(key.bits));
+        auto it = seen.emplace(key, uint32_t(firsts.size()));
+        if (it.second) {
+            firsts.push_back(i);
+        }
+        rv.indices.push_back(it.first->second);
+    }
+
+    rv.vertices = firsts.size();
+    vector<float> *components[] = {&rv.px, &rv.py, &rv.pz, &rv.u, &rv.v, &rv.nx, &rv.ny, &rv.nz};
+    for (int c = 0; c < 8; ++c) {
+        auto &dst = *components[c];
+        dst.assign(padded(rv.vertices), 0.f);
+        for (size_t i = 0; i < rv.vertices; ++i) {
+            dst[i] = mesh.data[firsts[i] * 8 + c];
+        }
+    }
+    return rv;
+}
+
+void prepare_transformed(TransformedVertices &out, const IndexedMesh &mesh) {
+    size_t n = padded(mesh.vertices);
+    for (auto *component : {&out.x, &out.y, &out.z, &out.w, &out.nx, &out.ny, &out.nz}) {
+        component->resize(n);
+    }
+    out.outcodes.resize(n);
+}
+
+void transform_vertices(const IndexedMesh &mesh, const mat4 &mvp, const mat4 &normal_matrix,
+                        TransformedVertices &out, size_t first, size_t last, bool simd) {
+#ifdef SANDY_AVX2_TARGET
+    if (simd && has_avx2_transform()) {
+        // The arrays are padded, so the last group may run past last.
+        transform_avx2(mesh, mvp, normal_matrix, out, first, last);
+        return;
+    }
+#endif
+    (void)simd;
+    transform_scalar(mesh, mvp, normal_matrix, out, first, last);
+}
+
+bool has_avx2_transform() {
+#ifdef SANDY_AVX2_TARGET
+    static const bool rv = __builtin_cpu_supports("avx2");
+    return rv;
+#else
+    return false;
+#endif
+}
+
+int clip_polygon(ClipVertex *poly, int n, unsigned mask) {
+    ClipVertex tmp[max_clipped_vertices];
+    for (int p = 0; p < num_clip_planes && n > 0; ++p) {
+        if (!(mask & (1u << p))) {
+            continue;
+        }
+        int m = 0;
+        for (int i = 0; i < n; ++i) {
+            const ClipVertex &cur = poly[i];
+            const ClipVertex &next = poly[(i + 1) % n];
+            float dc = plane_distance(cur, p);
+            float dn = plane_distance(next, p);
+            if (dc >= 0) {
+                tmp[m++] = cur;
+            }
+            if ((dc >= 0) != (dn >= 0)) {
+                tmp[m++] = lerp(cur, next, dc / (dc - dn));
+            }
+        }
+        copy(tmp, tmp + m, poly);
+        n = m;
+    }
+    return n;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "scene.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// The vertex half of the CPU backends: meshes are welded into indexed,
+// structure-of-arrays form once, then every frame each unique vertex is
+// transformed exactly once, eight at a time where the CPU has AVX2, and
+// triangles look their corners up by index in the results.
+
+// How far outside the viewport, in viewport sizes, vertices may lie before
+// x and y are clipped too; within it the rasterizer's bounding box does the
+// work and clipping only happens at the near and far planes.
+const float guard_band = 16.f;
+
+// Outcode bits, set when a vertex is outside that plane.
+enum ClipPlane : unsigned {
+    clip_near = 1u << 0,
+    clip_far = 1u << 1,
+    clip_right = 1u << 2,
+    clip_left = 1u << 3,
+    clip_top = 1u << 4,
+    clip_bottom = 1u << 5,
+};
+
+const int num_clip_planes = 6;
+// A triangle clipped against every plane.
+const int max_clipped_vertices = 3 + num_clip_planes;
+
+struct ClipVertex {
+    glm::vec4 clip;
+    glm::vec2 uv;
+    glm::vec3 normal;
+};
+
+// Unique vertices of a mesh, one array per component, each padded to a
+// multiple of eight so the transform never needs a scalar tail.
+struct IndexedMesh {
+    std::vector<float> px, py, pz;
+    std::vector<float> u, v;
+    std::vector<float> nx, ny, nz;
+    std::vector<uint32_t> indices;
+    size_t vertices = 0;
+
+    size_t triangles() const {
+        return indices.size() / 3;
+    }
+};
+
+// Welds bit-identical vertices of an unindexed mesh.
+IndexedMesh index_mesh(const MeshView &mesh);
+
+// The post-transform cache: clip-space position, view-space normal and
+// outcode of every vertex of an IndexedMesh, in the same order.
+struct TransformedVertices {
+    std::vector<float> x, y, z, w;
+    std::vector<float> nx, ny, nz;
+    std::vector<uint8_t> outcodes;
+};
+
+// Sizes out for mesh, so ranges of it can be transformed in parallel.
+void prepare_transformed(TransformedVertices &out, const IndexedMesh &mesh);
+
+// data/vertex.glsl over vertices [first, last); first must be a multiple of
+// eight. The normal matrix is applied with w = 1, as the shader does. Both
+// paths give bit-identical results; simd = false forces the scalar one.
+void transform_vertices(const IndexedMesh &mesh, const glm::mat4 &mvp, const glm::mat4 &normal_matrix,
+                        TransformedVertices &out, size_t first, size_t last, bool simd = true);
+
+// Whether transform_vertices has an AVX2 path on this CPU.
+bool has_avx2_transform();
+
+inline ClipVertex fetch_vertex(const TransformedVertices &post, const IndexedMesh &mesh, uint32_t i) {
+    ClipVertex rv;
+    rv.clip = glm::vec4(post.x[i], post.y[i], post.z[i], post.w[i]);
+    rv.uv = glm::vec2(mesh.u[i], mesh.v[i]);
+    rv.normal = glm::vec3(post.nx[i], post.ny[i], post.nz[i]);
+    return rv;
+}
+
+// Sutherland-Hodgman against the planes in mask. poly needs room for
+// max_clipped_vertices; returns how many are left.
+int clip_polygon(ClipVertex *poly, int n, unsigned mask);
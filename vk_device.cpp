@@ -0,0 +1,441 @@
+#include "vk_device.hpp"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+// The start of every pipeline cache, as the spec lays it out.
+struct PipelineCacheHeader {
+    uint32_t size;
+    uint32_t version;
+    uint32_t vendor_id;
+    uint32_t device_id;
+    uint8_t uuid[VK_UUID_SIZE];
+};
+
+// Data written by another driver or device is useless, and not every driver
+// is careful about rejecting it.
+vector<char> read_pipeline_cache(const string &path, const VkPhysicalDeviceProperties &properties) {
+    ifstream file(path, ios::binary);
+    if (!file) {
+        return {};
+    }
+    vector<char> data((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+
+    PipelineCacheHeader header;
+    if (data.size() < sizeof(header)) {
+        return {};
+    }
+    memcpy(&header, data.data(), sizeof(header));
+    if (header.version != VK_PIPELINE_CACHE_HEADER_VERSION_ONE || header.vendor_id != properties.vendorID ||
+        header.device_id != properties.deviceID ||
+        memcmp(header.uuid, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+        clog << "Warning: pipeline cache \"" << path << "\" is from another device, ignoring it" << endl;
+        return {};
+    }
+    return data;
+}
+
+// Tile workers share a cache file, so each writes its own temporary.
+void write_pipeline_cache(const VulkanDevice &device) {
+    size_t size = 0;
+    vk_check(vkGetPipelineCacheData(device.device, device.pipeline_cache, &size, nullptr), "vkGetPipelineCacheData");
+    vector<char> data(size);
+    vk_check(vkGetPipelineCacheData(device.device, device.pipeline_cache, &size, data.data()),
+             "vkGetPipelineCacheData");
+
+    string tmp = device.pipeline_cache_path + "." + to_string(getpid()) + ".tmp";
+    {
+        ofstream file(tmp, ios::binary | ios::trunc);
+        file.write(data.data(), size);
+        if (!file) {
+            clog << "Warning: unable to write \"" << tmp << "\"" << endl;
+            return;
+        }
+    }
+    if (rename(tmp.c_str(), device.pipeline_cache_path.c_str()) != 0) {
+        clog << "Warning: unable to replace \"" << device.pipeline_cache_path << "\"" << endl;
+        remove(tmp.c_str());
+    }
+}
+
+bool has_device_extension(VkPhysicalDevice physical, const char *name) {
+    uint32_t count = 0;
+    vkEnumerateDeviceExtensionProperties(physical, nullptr, &count, nullptr);
+    vector<VkExtensionProperties> extensions(count);
+    vkEnumerateDeviceExtensionProperties(physical, nullptr, &count, extensions.data());
+    return any_of(extensions.begin(), extensions.end(),
+                  [&](const VkExtensionProperties &e) { return strcmp(e.extensionName, name) == 0; });
+}
+
+// Returns the queue family to use, or -1 if the device won't do.
+int usable_queue_family(VkPhysicalDevice physical, VkSurfaceKHR surface) {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physical, &properties);
+    if (properties.apiVersion < VK_API_VERSION_1_1) {
+        return -1;
+    }
+    if (surface != VK_NULL_HANDLE && !has_device_extension(physical, VK_KHR_SWAPCHAIN_EXTENSION_NAME)) {
+        return -1;
+    }
+
+    uint32_t count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physical, &count, nullptr);
+    vector<VkQueueFamilyProperties> families(count);
+    vkGetPhysicalDeviceQueueFamilyProperties(physical, &count, families.data());
+    for (uint32_t i = 0; i < count; ++i) {
+        if (!(families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)) {
+            continue;
+        }
+        VkBool32 present = VK_TRUE;
+        if (surface != VK_NULL_HANDLE) {
+            vkGetPhysicalDeviceSurfaceSupportKHR(physical, i, surface, &present);
+        }
+        if (present) {
+            return int(i);
+        }
+    }
+    return -1;
+}
+
+int device_preference(VkPhysicalDeviceType type) {
+    switch (type) {
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+            return 3;
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+            return 2;
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+VkDeviceSize align_up(VkDeviceSize value, VkDeviceSize alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+}
+
+void vk_check(VkResult result, const char *what) {
+    if (result != VK_SUCCESS) {
+        throw runtime_error(string(what) + " failed with VkResult " + to_string(int(result)));
+    }
+}
+
+VkInstance create_vulkan_instance(const vector<const char *> &extensions) {
+    VkApplicationInfo app = {};
+    app.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+    app.pApplicationName = "Shader Sandy";
+    app.apiVersion = VK_API_VERSION_1_1;
+
+    VkInstanceCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+    info.pApplicationInfo = &app;
+    info.enabledExtensionCount = uint32_t(extensions.size());
+    info.ppEnabledExtensionNames = extensions.data();
+
+    VkInstance rv;
+    vk_check(vkCreateInstance(&info, nullptr, &rv), "vkCreateInstance");
+    return rv;
+}
+
+VulkanDevice create_vulkan_device(VkInstance instance, VkSurfaceKHR surface, const string &pipeline_cache) {
+    VulkanDevice rv;
+    rv.instance = instance;
+    rv.pipeline_cache_path = pipeline_cache;
+
+    uint32_t count = 0;
+    vkEnumeratePhysicalDevices(instance, &count, nullptr);
+    vector<VkPhysicalDevice> physicals(count);
+    vkEnumeratePhysicalDevices(instance, &count, physicals.data());
+
+    int best = -1;
+    for (VkPhysicalDevice physical : physicals) {
+        int family = usable_queue_family(physical, surface);
+        if (family < 0) {
+            continue;
+        }
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physical, &properties);
+        int preference = device_preference(properties.deviceType);
+        if (preference > best) {
+            best = preference;
+            rv.physical = physical;
+            rv.queue_family = uint32_t(family);
+            rv.properties = properties;
+        }
+    }
+    if (rv.physical == VK_NULL_HANDLE) {
+        throw runtime_error("No Vulkan 1.1 device can render here");
+    }
+    vkGetPhysicalDeviceMemoryProperties(rv.physical, &rv.memory);
+    clog << "Vulkan device: " << rv.properties.deviceName << endl;
+
+    float priority = 1.f;
+    VkDeviceQueueCreateInfo queue = {};
+    queue.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    queue.queueFamilyIndex = rv.queue_family;
+    queue.queueCount = 1;
+    queue.pQueuePriorities = &priority;
+
+    const char *swapchain = VK_KHR_SWAPCHAIN_EXTENSION_NAME;
+    VkDeviceCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    info.queueCreateInfoCount = 1;
+    info.pQueueCreateInfos = &queue;
+    info.enabledExtensionCount = surface != VK_NULL_HANDLE ? 1 : 0;
+    info.ppEnabledExtensionNames = &swapchain;
+    vk_check(vkCreateDevice(rv.physical, &info, nullptr, &rv.device), "vkCreateDevice");
+    vkGetDeviceQueue(rv.device, rv.queue_family, 0, &rv.queue);
+
+    VkCommandPoolCreateInfo pool = {};
+    pool.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    pool.queueFamilyIndex = rv.queue_family;
+    vk_check(vkCreateCommandPool(rv.device, &pool, nullptr, &rv.command_pool), "vkCreateCommandPool");
+
+    vector<char> initial;
+    if (!pipeline_cache.empty()) {
+        initial = read_pipeline_cache(pipeline_cache, rv.properties);
+    }
+    VkPipelineCacheCreateInfo cache = {};
+    cache.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    cache.initialDataSize = initial.size();
+    cache.pInitialData = initial.empty() ? nullptr : initial.data();
+    vk_check(vkCreatePipelineCache(rv.device, &cache, nullptr, &rv.pipeline_cache), "vkCreatePipelineCache");
+
+    return rv;
+}
+
+void destroy_vulkan_device(VulkanDevice &device) {
+    if (device.device == VK_NULL_HANDLE) {
+        return;
+    }
+    vkDeviceWaitIdle(device.device);
+    if (!device.pipeline_cache_path.empty()) {
+        write_pipeline_cache(device);
+    }
+    vkDestroyPipelineCache(device.device, device.pipeline_cache, nullptr);
+    vkDestroyCommandPool(device.device, device.command_pool, nullptr);
+    vkDestroyDevice(device.device, nullptr);
+    device.device = VK_NULL_HANDLE;
+}
+
+void submit_and_wait(const VulkanDevice &device, const function<void(VkCommandBuffer)> &record) {
+    VkCommandBufferAllocateInfo alloc = {};
+    alloc.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    alloc.commandPool = device.command_pool;
+    alloc.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    alloc.commandBufferCount = 1;
+    VkCommandBuffer cmd;
+    vk_check(vkAllocateCommandBuffers(device.device, &alloc, &cmd), "vkAllocateCommandBuffers");
+
+    VkFenceCreateInfo fenceInfo = {};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    VkFence fence;
+    vk_check(vkCreateFence(device.device, &fenceInfo, nullptr, &fence), "vkCreateFence");
+
+    try {
+        VkCommandBufferBeginInfo begin = {};
+        begin.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        begin.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        vk_check(vkBeginCommandBuffer(cmd, &begin), "vkBeginCommandBuffer");
+        record(cmd);
+        vk_check(vkEndCommandBuffer(cmd), "vkEndCommandBuffer");
+
+        VkSubmitInfo submit = {};
+        submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit.commandBufferCount = 1;
+        submit.pCommandBuffers = &cmd;
+        vk_check(vkQueueSubmit(device.queue, 1, &submit, fence), "vkQueueSubmit");
+        vk_check(vkWaitForFences(device.device, 1, &fence, VK_TRUE, UINT64_MAX), "vkWaitForFences");
+    } catch (...) {
+        vkDeviceWaitIdle(device.device);
+        vkDestroyFence(device.device, fence, nullptr);
+        vkFreeCommandBuffers(device.device, device.command_pool, 1, &cmd);
+        throw;
+    }
+    vkDestroyFence(device.device, fence, nullptr);
+    vkFreeCommandBuffers(device.device, device.command_pool, 1, &cmd);
+}
+
+MemoryPool::MemoryPool(const VulkanDevice &device, VkDeviceSize block_size) : device(device), block_size(block_size) {
+}
+
+MemoryPool::~MemoryPool() {
+    reset();
+}
+
+MemoryPool::Allocation MemoryPool::bind(VkBuffer buffer, VkMemoryPropertyFlags flags) {
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(device.device, buffer, &requirements);
+    Allocation rv = allocate(requirements, flags);
+    vk_check(vkBindBufferMemory(device.device, buffer, rv.memory, rv.offset), "vkBindBufferMemory");
+    return rv;
+}
+
+MemoryPool::Allocation MemoryPool::bind(VkImage image, VkMemoryPropertyFlags flags) {
+    VkMemoryRequirements requirements;
+    vkGetImageMemoryRequirements(device.device, image, &requirements);
+    Allocation rv = allocate(requirements, flags);
+    vk_check(vkBindImageMemory(device.device, image, rv.memory, rv.offset), "vkBindImageMemory");
+    return rv;
+}
+
+void MemoryPool::reset() {
+    for (auto &block : blocks) {
+        vkFreeMemory(device.device, block.memory, nullptr);
+    }
+    blocks.clear();
+}
+
+VkDeviceSize MemoryPool::allocated() const {
+    VkDeviceSize rv = 0;
+    for (auto &block : blocks) {
+        rv += block.size;
+    }
+    return rv;
+}
+
+MemoryPool::Allocation MemoryPool::allocate(const VkMemoryRequirements &requirements, VkMemoryPropertyFlags flags) {
+    uint32_t type = device.memory.memoryTypeCount;
+    for (uint32_t i = 0; i < device.memory.memoryTypeCount; ++i) {
+        if ((requirements.memoryTypeBits & (1u << i)) &&
+            (device.memory.memoryTypes[i].propertyFlags & flags) == flags) {
+            type = i;
+            break;
+        }
+    }
+    if (type == device.memory.memoryTypeCount) {
+        throw runtime_error("No Vulkan memory type fits the request");
+    }
+
+    // Aligning everything to the granularity keeps linear buffers and
+    // optimal images from sharing a page, whatever order they come in.
+    VkDeviceSize alignment = max(requirements.alignment, device.properties.limits.bufferImageGranularity);
+    for (auto &block : blocks) {
+        VkDeviceSize offset = align_up(block.used, alignment);
+        if (block.type == type && offset + requirements.size <= block.size) {
+            block.used = offset + requirements.size;
+            Allocation rv;
+            rv.memory = block.memory;
+            rv.offset = offset;
+            rv.mapped = block.mapped ? static_cast<char *>(block.mapped) + offset : nullptr;
+            return rv;
+        }
+    }
+
+    Block block;
+    block.type = type;
+    block.size = max(block_size, requirements.size);
+    block.used = requirements.size;
+    block.mapped = nullptr;
+
+    VkMemoryAllocateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    info.allocationSize = block.size;
+    info.memoryTypeIndex = type;
+    vk_check(vkAllocateMemory(device.device, &info, nullptr, &block.memory), "vkAllocateMemory");
+    if (device.memory.memoryTypes[type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        VkResult result = vkMapMemory(device.device, block.memory, 0, VK_WHOLE_SIZE, 0, &block.mapped);
+        if (result != VK_SUCCESS) {
+            vkFreeMemory(device.device, block.memory, nullptr);
+            vk_check(result, "vkMapMemory");
+        }
+    }
+    blocks.push_back(block);
+
+    Allocation rv;
+    rv.memory = block.memory;
+    rv.offset = 0;
+    rv.mapped = block.mapped;
+    return rv;
+}
+
+VulkanBuffer create_vulkan_buffer(const VulkanDevice &device, MemoryPool &pool, VkDeviceSize size,
+                                  VkBufferUsageFlags usage, VkMemoryPropertyFlags flags) {
+    VkBufferCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    info.size = size;
+    info.usage = usage;
+    info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VulkanBuffer rv;
+    vk_check(vkCreateBuffer(device.device, &info, nullptr, &rv.handle), "vkCreateBuffer");
+    try {
+        rv.memory = pool.bind(rv.handle, flags);
+    } catch (...) {
+        vkDestroyBuffer(device.device, rv.handle, nullptr);
+        throw;
+    }
+    return rv;
+}
+
+void destroy_vulkan_buffer(const VulkanDevice &device, VulkanBuffer &buffer) {
+    vkDestroyBuffer(device.device, buffer.handle, nullptr);
+    buffer = VulkanBuffer();
+}
+
+VulkanImage create_vulkan_image(const VulkanDevice &device, MemoryPool &pool, VkImageType type, VkFormat format,
+                                VkExtent3D extent, VkImageUsageFlags usage, VkSampleCountFlagBits samples) {
+    VkImageCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    info.imageType = type;
+    info.format = format;
+    info.extent = extent;
+    info.mipLevels = 1;
+    info.arrayLayers = 1;
+    info.samples = samples;
+    info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    info.usage = usage;
+    info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    VulkanImage rv;
+    rv.format = format;
+    rv.extent = extent;
+    vk_check(vkCreateImage(device.device, &info, nullptr, &rv.handle), "vkCreateImage");
+    try {
+        pool.bind(rv.handle, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        bool depth = format == VK_FORMAT_D32_SFLOAT || format == VK_FORMAT_X8_D24_UNORM_PACK32;
+        VkImageViewCreateInfo view = {};
+        view.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        view.image = rv.handle;
+        view.viewType = type == VK_IMAGE_TYPE_3D ? VK_IMAGE_VIEW_TYPE_3D : VK_IMAGE_VIEW_TYPE_2D;
+        view.format = format;
+        view.subresourceRange.aspectMask = depth ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+        view.subresourceRange.levelCount = 1;
+        view.subresourceRange.layerCount = 1;
+        vk_check(vkCreateImageView(device.device, &view, nullptr, &rv.view), "vkCreateImageView");
+    } catch (...) {
+        vkDestroyImage(device.device, rv.handle, nullptr);
+        throw;
+    }
+    return rv;
+}
+
+void destroy_vulkan_image(const VulkanDevice &device, VulkanImage &image) {
+    vkDestroyImageView(device.device, image.view, nullptr);
+    vkDestroyImage(device.device, image.handle, nullptr);
+    image = VulkanImage();
+}
+
+VkSampleCountFlagBits supported_samples(const VulkanDevice &device, int wanted) {
+    VkSampleCountFlags counts = device.properties.limits.framebufferColorSampleCounts &
+                                device.properties.limits.framebufferDepthSampleCounts;
+    int rv = 1;
+    while (rv * 2 <= wanted && (counts & VkSampleCountFlags(rv * 2))) {
+        rv *= 2;
+    }
+    return VkSampleCountFlagBits(rv);
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// Throws naming what on anything but VK_SUCCESS.
+void vk_check(VkResult result, const char *what);
+
+// One logical device with a single queue that does graphics, transfers and,
+// for a window, presentation.
+struct VulkanDevice {
+    VkInstance instance = VK_NULL_HANDLE;
+    VkPhysicalDevice physical = VK_NULL_HANDLE;
+    VkDevice device = VK_NULL_HANDLE;
+    uint32_t queue_family = 0;
+    VkQueue queue = VK_NULL_HANDLE;
+    VkCommandPool command_pool = VK_NULL_HANDLE;
+    VkPipelineCache pipeline_cache = VK_NULL_HANDLE;
+    VkPhysicalDeviceProperties properties;
+    VkPhysicalDeviceMemoryProperties memory;
+    std::string pipeline_cache_path;
+};
+
+// Vulkan 1.1 for negative viewport heights. extensions are the instance
+// extensions a window surface needs, if any.
+VkInstance create_vulkan_instance(const std::vector<const char *> &extensions);
+
+// Picks a device with a queue that can draw and, when surface is given,
+// present to it. Discrete GPUs are preferred, but a software device such as
+// lavapipe will do. Pipelines start from the cache file at pipeline_cache,
+// if there is one that this device wrote.
+VulkanDevice create_vulkan_device(VkInstance instance, VkSurfaceKHR surface, const std::string &pipeline_cache);
+
+// Writes the pipeline cache back first. Leaves the instance to the caller,
+// who may still have a surface on it.
+void destroy_vulkan_device(VulkanDevice &device);
+
+// Records commands with record into a one-time command buffer and blocks
+// until the queue has run them.
+void submit_and_wait(const VulkanDevice &device, const std::function<void(VkCommandBuffer)> &record);
+
+// Hands out memory for buffers and images from large blocks per memory
+// type, so the driver sees a handful of allocations instead of one per
+// resource. Blocks only grow; reset() gives them all back at once.
+class MemoryPool {
+public:
+    struct Allocation {
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceSize offset = 0;
+        // Persistently mapped for host-visible memory, otherwise null.
+        void *mapped = nullptr;
+    };
+
+    MemoryPool(const VulkanDevice &device, VkDeviceSize block_size = VkDeviceSize(64) << 20);
+    MemoryPool(const MemoryPool &) = delete;
+    MemoryPool &operator=(const MemoryPool &) = delete;
+    ~MemoryPool();
+
+    // Allocates and binds.
+    Allocation bind(VkBuffer buffer, VkMemoryPropertyFlags flags);
+    Allocation bind(VkImage image, VkMemoryPropertyFlags flags);
+
+    // Everything bound to the pool has to be destroyed first.
+    void reset();
+
+    VkDeviceSize allocated() const;
+
+private:
+    struct Block {
+        VkDeviceMemory memory;
+        uint32_t type;
+        VkDeviceSize size;
+        VkDeviceSize used;
+        void *mapped;
+    };
+
+    Allocation allocate(const VkMemoryRequirements &requirements, VkMemoryPropertyFlags flags);
+
+    const VulkanDevice &device;
+    VkDeviceSize block_size;
+    std::vector<Block> blocks;
+};
+
+// A buffer with its own place in a pool.
+struct VulkanBuffer {
+    VkBuffer handle = VK_NULL_HANDLE;
+    MemoryPool::Allocation memory;
+};
+
+VulkanBuffer create_vulkan_buffer(const VulkanDevice &device, MemoryPool &pool, VkDeviceSize size,
+                                  VkBufferUsageFlags usage, VkMemoryPropertyFlags flags);
+void destroy_vulkan_buffer(const VulkanDevice &device, VulkanBuffer &buffer);
+
+struct VulkanImage {
+    VkImage handle = VK_NULL_HANDLE;
+    VkImageView view = VK_NULL_HANDLE;
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    VkExtent3D extent = {0, 0, 0};
+};
+
+// Device-local, one mip level, optimal tiling.
+VulkanImage create_vulkan_image(const VulkanDevice &device, MemoryPool &pool, VkImageType type, VkFormat format,
+                                VkExtent3D extent, VkImageUsageFlags usage,
+                                VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT);
+void destroy_vulkan_image(const VulkanDevice &device, VulkanImage &image);
+
+// The most samples up to wanted that colour and depth targets both support.
+VkSampleCountFlagBits supported_samples(const VulkanDevice &device, int wanted);
@@ -0,0 +1,536 @@
+#include "vk_scene.hpp"
+#include "asset_cache.hpp"
+#include "jobs.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+using namespace glm;
+
+namespace {
+// SPIR-V from glslc -mfmt=num, generated at build time.
+const uint32_t vertex_spirv[] = {
+#include "vk_scene.vert.inc"
+};
+const uint32_t fragment_spirv[] = {
+#include "vk_scene.frag.inc"
+};
+
+// Interleaved position, texcoord and normal, as parse_obj lays them out.
+const uint32_t vertex_stride = 8 * sizeof(float);
+
+// What sampling a GL texture with no image gives.
+const unsigned char missing_texel[4] = {0, 0, 0, 255};
+
+VkShaderModule create_shader_module(const VulkanDevice &device, const uint32_t *code, size_t size) {
+    VkShaderModuleCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    info.codeSize = size;
+    info.pCode = code;
+    VkShaderModule rv;
+    vk_check(vkCreateShaderModule(device.device, &info, nullptr, &rv), "vkCreateShaderModule");
+    return rv;
+}
+
+VkSampler create_sampler(const VulkanDevice &device, VkSamplerAddressMode wrap_r) {
+    VkSamplerCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    info.magFilter = VK_FILTER_LINEAR;
+    info.minFilter = VK_FILTER_LINEAR;
+    info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    info.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    info.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    info.addressModeW = wrap_r;
+    info.maxLod = 0.f;
+    VkSampler rv;
+    vk_check(vkCreateSampler(device.device, &info, nullptr, &rv), "vkCreateSampler");
+    return rv;
+}
+
+void transition(VkCommandBuffer cmd, VkImage image, VkImageLayout from, VkImageLayout to,
+                VkPipelineStageFlags src_stage, VkAccessFlags src_access, VkPipelineStageFlags dst_stage,
+                VkAccessFlags dst_access) {
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = src_access;
+    barrier.dstAccessMask = dst_access;
+    barrier.oldLayout = from;
+    barrier.newLayout = to;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.layerCount = 1;
+    vkCmdPipelineBarrier(cmd, src_stage, dst_stage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+// One region of the staging buffer and where it goes.
+struct Upload {
+    const void *data;
+    VkDeviceSize size;
+    VkDeviceSize offset;
+};
+
+VkDeviceSize stage(vector<Upload> &uploads, VkDeviceSize &total, const void *data, VkDeviceSize size) {
+    // 16 covers the texel size and 4-byte alignment image copies need.
+    VkDeviceSize offset = (total + 15) / 16 * 16;
+    uploads.push_back({data, size, offset});
+    total = offset + size;
+    return offset;
+}
+
+void copy_to_image(VkCommandBuffer cmd, VkBuffer staging, VkDeviceSize offset, const VulkanImage &image) {
+    transition(cmd, image.handle, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+               VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+
+    VkBufferImageCopy region = {};
+    region.bufferOffset = offset;
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent = image.extent;
+    vkCmdCopyBufferToImage(cmd, staging, image.handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+    transition(cmd, image.handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+               VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+               VK_ACCESS_SHADER_READ_BIT);
+}
+
+VulkanImage create_texture(const VulkanDevice &device, MemoryPool &pool, const ImageView &image) {
+    VkExtent3D extent = {image.pixels ? image.width : 1, image.pixels ? image.height : 1, 1};
+    return create_vulkan_image(device, pool, VK_IMAGE_TYPE_2D, VK_FORMAT_R8G8B8A8_UNORM, extent,
+                               VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+}
+
+VkDeviceSize stage_texture(vector<Upload> &uploads, VkDeviceSize &total, const ImageView &image) {
+    if (!image.pixels) {
+        return stage(uploads, total, missing_texel, sizeof(missing_texel));
+    }
+    return stage(uploads, total, image.pixels, VkDeviceSize(image.width) * image.height * 4);
+}
+}
+
+VulkanScene load_vulkan_scene(const VulkanDevice &device, MemoryPool &pool, JobSystem &jobs,
+                              const AssetCache *cache) {
+    SceneAssets assets;
+    if (!cache) {
+        assets = parse_scene_assets(jobs);
+    }
+    vector<GLfloat> meshDecoded, flameDecoded;
+    MeshView meshObj = cache ? cached_mesh(*cache, "mesh", meshDecoded) : MeshView(assets.mesh);
+    MeshView flameObj = cache ? cached_mesh(*cache, "flame", flameDecoded) : MeshView(assets.flame);
+    ImageView meshImage = cache ? cached_image(*cache, "meshImage") : ImageView(assets.meshImage);
+    ImageView flameImage = cache ? cached_image(*cache, "flameImage") : ImageView(assets.flameImage);
+    DitherVolume dither = cache ? cached_dither(*cache, "ditherMap") : assets.ditherMap;
+
+    VulkanScene rv;
+    VkBufferUsageFlags vertexUsage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    VkDeviceSize meshSize = meshObj.floats * sizeof(float);
+    VkDeviceSize flameSize = flameObj.floats * sizeof(float);
+    rv.meshVertices = uint32_t(meshSize / vertex_stride);
+    rv.flameVertices = uint32_t(flameSize / vertex_stride);
+    rv.mesh = create_vulkan_buffer(device, pool, max<VkDeviceSize>(meshSize, 1), vertexUsage,
+                                   VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    rv.flame = create_vulkan_buffer(device, pool, max<VkDeviceSize>(flameSize, 1), vertexUsage,
+                                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    rv.meshTexture = create_texture(device, pool, meshImage);
+    rv.flameTexture = create_texture(device, pool, flameImage);
+    rv.ditherMap = create_vulkan_image(device, pool, VK_IMAGE_TYPE_3D, VK_FORMAT_R8_UNORM,
+                                       {uint32_t(dither.width), uint32_t(dither.height), uint32_t(dither.depth)},
+                                       VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+
+    vector<Upload> uploads;
+    VkDeviceSize total = 0;
+    VkDeviceSize meshOffset = stage(uploads, total, meshObj.data, meshSize);
+    VkDeviceSize flameOffset = stage(uploads, total, flameObj.data, flameSize);
+    VkDeviceSize meshImageOffset = stage_texture(uploads, total, meshImage);
+    VkDeviceSize flameImageOffset = stage_texture(uploads, total, flameImage);
+    VkDeviceSize ditherOffset = stage(uploads, total, dither.texels.data(), dither.texels.size());
+
+    {
+        MemoryPool stagingPool(device, total);
+        VulkanBuffer staging = create_vulkan_buffer(device, stagingPool, total, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                                    VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        for (auto &upload : uploads) {
+            if (upload.size > 0) {
+                memcpy(static_cast<char *>(staging.memory.mapped) + upload.offset, upload.data, upload.size);
+            }
+        }
+
+        submit_and_wait(device, [&](VkCommandBuffer cmd) {
+            VkBufferCopy region = {};
+            if (meshSize > 0) {
+                region.srcOffset = meshOffset;
+                region.size = meshSize;
+                vkCmdCopyBuffer(cmd, staging.handle, rv.mesh.handle, 1, &region);
+            }
+            if (flameSize > 0) {
+                region.srcOffset = flameOffset;
+                region.size = flameSize;
+                vkCmdCopyBuffer(cmd, staging.handle, rv.flame.handle, 1, &region);
+            }
+            VkMemoryBarrier barrier = {};
+            barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+            vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 1,
+                                 &barrier, 0, nullptr, 0, nullptr);
+
+            copy_to_image(cmd, staging.handle, meshImageOffset, rv.meshTexture);
+            copy_to_image(cmd, staging.handle, flameImageOffset, rv.flameTexture);
+            copy_to_image(cmd, staging.handle, ditherOffset, rv.ditherMap);
+        });
+        destroy_vulkan_buffer(device, staging);
+    }
+
+    rv.textureSampler = create_sampler(device, VK_SAMPLER_ADDRESS_MODE_REPEAT);
+    rv.ditherSampler = create_sampler(device, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE);
+    rv.vertexShader = create_shader_module(device, vertex_spirv, sizeof(vertex_spirv));
+    rv.fragmentShader = create_shader_module(device, fragment_spirv, sizeof(fragment_spirv));
+
+    VkDescriptorSetLayoutBinding bindings[3] = {};
+    bindings[0].binding = 0;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    bindings[0].descriptorCount = 1;
+    bindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+    bindings[1].binding = 1;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bindings[1].descriptorCount = 1;
+    bindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    bindings[2] = bindings[1];
+    bindings[2].binding = 2;
+
+    VkDescriptorSetLayoutCreateInfo setInfo = {};
+    setInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    setInfo.bindingCount = 3;
+    setInfo.pBindings = bindings;
+    vk_check(vkCreateDescriptorSetLayout(device.device, &setInfo, nullptr, &rv.setLayout),
+             "vkCreateDescriptorSetLayout");
+
+    VkPushConstantRange drawIndex = {};
+    drawIndex.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    drawIndex.size = sizeof(uint32_t);
+
+    VkPipelineLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layoutInfo.setLayoutCount = 1;
+    layoutInfo.pSetLayouts = &rv.setLayout;
+    layoutInfo.pushConstantRangeCount = 1;
+    layoutInfo.pPushConstantRanges = &drawIndex;
+    vk_check(vkCreatePipelineLayout(device.device, &layoutInfo, nullptr, &rv.pipelineLayout),
+             "vkCreatePipelineLayout");
+
+    return rv;
+}
+
+void destroy_vulkan_scene(const VulkanDevice &device, VulkanScene &scene) {
+    vkDestroyPipelineLayout(device.device, scene.pipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(device.device, scene.setLayout, nullptr);
+    vkDestroyShaderModule(device.device, scene.vertexShader, nullptr);
+    vkDestroyShaderModule(device.device, scene.fragmentShader, nullptr);
+    vkDestroySampler(device.device, scene.textureSampler, nullptr);
+    vkDestroySampler(device.device, scene.ditherSampler, nullptr);
+    destroy_vulkan_image(device, scene.meshTexture);
+    destroy_vulkan_image(device, scene.flameTexture);
+    destroy_vulkan_image(device, scene.ditherMap);
+    destroy_vulkan_buffer(device, scene.mesh);
+    destroy_vulkan_buffer(device, scene.flame);
+    scene = VulkanScene();
+}
+
+VkFormat scene_depth_format(const VulkanDevice &device) {
+    VkFormatProperties properties;
+    vkGetPhysicalDeviceFormatProperties(device.physical, VK_FORMAT_D32_SFLOAT, &properties);
+    if (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) {
+        return VK_FORMAT_D32_SFLOAT;
+    }
+    return VK_FORMAT_X8_D24_UNORM_PACK32;
+}
+
+VkRenderPass create_scene_render_pass(const VulkanDevice &device, VkFormat color, VkSampleCountFlagBits samples,
+                                      VkImageLayout final_layout) {
+    bool resolve = samples != VK_SAMPLE_COUNT_1_BIT;
+
+    VkAttachmentDescription attachments[3] = {};
+    attachments[0].format = color;
+    attachments[0].samples = samples;
+    attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    attachments[0].storeOp = resolve ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
+    attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachments[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    attachments[0].finalLayout = resolve ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : final_layout;
+
+    attachments[1] = attachments[0];
+    attachments[1].format = scene_depth_format(device);
+    attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    attachments[2] = attachments[0];
+    attachments[2].samples = VK_SAMPLE_COUNT_1_BIT;
+    attachments[2].loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    attachments[2].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    attachments[2].finalLayout = final_layout;
+
+    VkAttachmentReference colorRef = {0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+    VkAttachmentReference depthRef = {1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+    VkAttachmentReference resolveRef = {2, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+
+    VkSubpassDescription subpass = {};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = 1;
+    subpass.pColorAttachments = &colorRef;
+    subpass.pResolveAttachments = resolve ? &resolveRef : nullptr;
+    subpass.pDepthStencilAttachment = &depthRef;
+
+    // In: wait for the swapchain image and the previous frame's depth use.
+    // Out: make the picture visible to a readback copy.
+    VkSubpassDependency dependencies[2] = {};
+    dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[0].dstSubpass = 0;
+    dependencies[0].srcStageMask =
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependencies[0].dstStageMask =
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+    dependencies[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependencies[0].dstAccessMask =
+            VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependencies[1].srcSubpass = 0;
+    dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependencies[1].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    dependencies[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+    VkRenderPassCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    info.attachmentCount = resolve ? 3 : 2;
+    info.pAttachments = attachments;
+    info.subpassCount = 1;
+    info.pSubpasses = &subpass;
+    info.dependencyCount = 2;
+    info.pDependencies = dependencies;
+
+    VkRenderPass rv;
+    vk_check(vkCreateRenderPass(device.device, &info, nullptr, &rv), "vkCreateRenderPass");
+    return rv;
+}
+
+VkPipeline create_scene_pipeline(const VulkanDevice &device, const VulkanScene &scene, VkRenderPass render_pass,
+                                 VkSampleCountFlagBits samples) {
+    VkPipelineShaderStageCreateInfo stages[2] = {};
+    stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+    stages[0].module = scene.vertexShader;
+    stages[0].pName = "main";
+    stages[1] = stages[0];
+    stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    stages[1].module = scene.fragmentShader;
+
+    VkVertexInputBindingDescription binding = {0, vertex_stride, VK_VERTEX_INPUT_RATE_VERTEX};
+    VkVertexInputAttributeDescription attributes[3] = {
+            {0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0},
+            {1, 0, VK_FORMAT_R32G32_SFLOAT, 3 * sizeof(float)},
+            {2, 0, VK_FORMAT_R32G32B32_SFLOAT, 5 * sizeof(float)},
+    };
+    VkPipelineVertexInputStateCreateInfo vertexInput = {};
+    vertexInput.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertexInput.vertexBindingDescriptionCount = 1;
+    vertexInput.pVertexBindingDescriptions = &binding;
+    vertexInput.vertexAttributeDescriptionCount = 3;
+    vertexInput.pVertexAttributeDescriptions = attributes;
+
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
+    inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+    VkPipelineViewportStateCreateInfo viewport = {};
+    viewport.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewport.viewportCount = 1;
+    viewport.scissorCount = 1;
+
+    VkPipelineRasterizationStateCreateInfo rasterization = {};
+    rasterization.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterization.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterization.cullMode = VK_CULL_MODE_NONE;
+    rasterization.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    rasterization.lineWidth = 1.f;
+
+    VkPipelineMultisampleStateCreateInfo multisample = {};
+    multisample.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisample.rasterizationSamples = samples;
+
+    VkPipelineDepthStencilStateCreateInfo depth = {};
+    depth.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depth.depthTestEnable = VK_TRUE;
+    depth.depthWriteEnable = VK_TRUE;
+    depth.depthCompareOp = VK_COMPARE_OP_LESS;
+
+    VkPipelineColorBlendAttachmentState blendAttachment = {};
+    blendAttachment.colorWriteMask =
+            VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    VkPipelineColorBlendStateCreateInfo blend = {};
+    blend.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    blend.attachmentCount = 1;
+    blend.pAttachments = &blendAttachment;
+
+    VkDynamicState dynamicStates[2] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+    VkPipelineDynamicStateCreateInfo dynamic = {};
+    dynamic.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamic.dynamicStateCount = 2;
+    dynamic.pDynamicStates = dynamicStates;
+
+    VkGraphicsPipelineCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    info.stageCount = 2;
+    info.pStages = stages;
+    info.pVertexInputState = &vertexInput;
+    info.pInputAssemblyState = &inputAssembly;
+    info.pViewportState = &viewport;
+    info.pRasterizationState = &rasterization;
+    info.pMultisampleState = &multisample;
+    info.pDepthStencilState = &depth;
+    info.pColorBlendState = &blend;
+    info.pDynamicState = &dynamic;
+    info.layout = scene.pipelineLayout;
+    info.renderPass = render_pass;
+
+    VkPipeline rv;
+    vk_check(vkCreateGraphicsPipelines(device.device, device.pipeline_cache, 1, &info, nullptr, &rv),
+             "vkCreateGraphicsPipelines");
+    return rv;
+}
+
+SceneBindings create_scene_bindings(const VulkanDevice &device, MemoryPool &pool, const VulkanScene &scene,
+                                    int slots) {
+    SceneBindings rv;
+    VkDeviceSize alignment = device.properties.limits.minUniformBufferOffsetAlignment;
+    rv.stride = (sizeof(SceneUniforms) + alignment - 1) / alignment * alignment;
+    rv.uniforms = create_vulkan_buffer(device, pool, rv.stride * slots, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                                       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+    uint32_t sets = uint32_t(slots) * 2;
+    VkDescriptorPoolSize sizes[2] = {
+            {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, sets},
+            {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, sets * 2},
+    };
+    VkDescriptorPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.maxSets = sets;
+    poolInfo.poolSizeCount = 2;
+    poolInfo.pPoolSizes = sizes;
+    vk_check(vkCreateDescriptorPool(device.device, &poolInfo, nullptr, &rv.descriptorPool), "vkCreateDescriptorPool");
+
+    vector<VkDescriptorSetLayout> layouts(sets, scene.setLayout);
+    VkDescriptorSetAllocateInfo alloc = {};
+    alloc.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    alloc.descriptorPool = rv.descriptorPool;
+    alloc.descriptorSetCount = sets;
+    alloc.pSetLayouts = layouts.data();
+    rv.sets.resize(sets);
+    vk_check(vkAllocateDescriptorSets(device.device, &alloc, rv.sets.data()), "vkAllocateDescriptorSets");
+
+    for (uint32_t i = 0; i < sets; ++i) {
+        VkDescriptorBufferInfo uniforms = {rv.uniforms.handle, rv.stride * (i / 2), sizeof(SceneUniforms)};
+        const VulkanImage &texture = i % 2 == 0 ? scene.meshTexture : scene.flameTexture;
+        VkDescriptorImageInfo images[2] = {
+                {scene.textureSampler, texture.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL},
+                {scene.ditherSampler, scene.ditherMap.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL},
+        };
+
+        VkWriteDescriptorSet writes[3] = {};
+        for (int j = 0; j < 3; ++j) {
+            writes[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[j].dstSet = rv.sets[i];
+            writes[j].dstBinding = uint32_t(j);
+            writes[j].descriptorCount = 1;
+            writes[j].descriptorType =
+                    j == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        }
+        writes[0].pBufferInfo = &uniforms;
+        writes[1].pImageInfo = &images[0];
+        writes[2].pImageInfo = &images[1];
+        vkUpdateDescriptorSets(device.device, 3, writes, 0, nullptr);
+    }
+    return rv;
+}
+
+void destroy_scene_bindings(const VulkanDevice &device, SceneBindings &bindings) {
+    vkDestroyDescriptorPool(device.device, bindings.descriptorPool, nullptr);
+    destroy_vulkan_buffer(device, bindings.uniforms);
+    bindings = SceneBindings();
+}
+
+void write_scene_uniforms(const SceneBindings &bindings, int slot, const VulkanScene &scene,
+                          const SceneParams &params, int height) {
+    SceneUniforms uniforms;
+    uniforms.cam_proj = params.cam_proj;
+    uniforms.cam_view = params.cam_view;
+    uniforms.model[0] = params.model;
+    uniforms.model[1] = flame_model(params);
+    uniforms.light_pos = vec4(params.light_pos, params.light_radius);
+    uniforms.dither_size = vec2(scene.ditherMap.extent.width, scene.ditherMap.extent.height);
+    uniforms.frag_offset = params.frag_offset;
+    uniforms.target_height = float(height);
+    memcpy(static_cast<char *>(bindings.uniforms.memory.mapped) + bindings.stride * slot, &uniforms,
+           sizeof(uniforms));
+}
+
+namespace {
+// Clears and starts the render pass, leaving pipeline bound.
+void begin_scene_pass(VkCommandBuffer cmd, VkPipeline pipeline, VkRenderPass render_pass, VkFramebuffer framebuffer,
+                      VkExtent2D extent) {
+    VkClearValue clear[3] = {};
+    clear[0].color = {{1.f, 0.f, 1.f, 1.f}};
+    clear[1].depthStencil = {1.f, 0};
+    clear[2] = clear[0];
+
+    VkRenderPassBeginInfo begin = {};
+    begin.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    begin.renderPass = render_pass;
+    begin.framebuffer = framebuffer;
+    begin.renderArea.extent = extent;
+    begin.clearValueCount = 3;
+    begin.pClearValues = clear;
+    vkCmdBeginRenderPass(cmd, &begin, VK_SUBPASS_CONTENTS_INLINE);
+
+    VkViewport viewport = {0.f, float(extent.height), float(extent.width), -float(extent.height), 0.f, 1.f};
+    VkRect2D scissor = {{0, 0}, extent};
+    vkCmdSetViewport(cmd, 0, 1, &viewport);
+    vkCmdSetScissor(cmd, 0, 1, &scissor);
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+}
+
+void record_draw(VkCommandBuffer cmd, const VulkanScene &scene, const SceneBindings &bindings, int slot,
+                 uint32_t draw) {
+    const VulkanBuffer *buffers[2] = {&scene.mesh, &scene.flame};
+    uint32_t vertices[2] = {scene.meshVertices, scene.flameVertices};
+    VkDeviceSize offset = 0;
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, scene.pipelineLayout, 0, 1,
+                            &bindings.sets[slot * 2 + draw], 0, nullptr);
+    vkCmdPushConstants(cmd, scene.pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(draw), &draw);
+    vkCmdBindVertexBuffers(cmd, 0, 1, &buffers[draw]->handle, &offset);
+    vkCmdDraw(cmd, vertices[draw], 1, 0, 0);
+}
+}
+
+void record_scene(VkCommandBuffer cmd, const VulkanScene &scene, const SceneBindings &bindings, int slot,
+                  VkPipeline pipeline, VkRenderPass render_pass, VkFramebuffer framebuffer, VkExtent2D extent) {
+    begin_scene_pass(cmd, pipeline, render_pass, framebuffer, extent);
+    for (uint32_t draw = 0; draw < 2; ++draw) {
+        record_draw(cmd, scene, bindings, slot, draw);
+    }
+    vkCmdEndRenderPass(cmd);
+}
+
+void record_flame_draws(VkCommandBuffer cmd, const VulkanScene &scene, const SceneBindings &bindings, int slot,
+                        VkPipeline pipeline, VkRenderPass render_pass, VkFramebuffer framebuffer, VkExtent2D extent,
+                        int draws) {
+    begin_scene_pass(cmd, pipeline, render_pass, framebuffer, extent);
+    for (int i = 0; i < draws; ++i) {
+        record_draw(cmd, scene, bindings, slot, 1);
+    }
+    vkCmdEndRenderPass(cmd);
+}
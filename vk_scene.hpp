@@ -0,0 +1,92 @@
+#pragma once
+
+#include "scene.hpp"
+#include "vk_device.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+class JobSystem;
+struct AssetCache;
+
+// The uniform block of data/vk_scene.vert and data/vk_scene.frag, std140.
+// model[0] places the mesh, model[1] the flame.
+struct SceneUniforms {
+    glm::mat4 cam_proj;
+    glm::mat4 cam_view;
+    glm::mat4 model[2];
+    glm::vec4 light_pos;
+    glm::vec2 dither_size;
+    glm::vec2 frag_offset;
+    // gl_FragCoord starts at the top in Vulkan; the dither is laid out from
+    // the bottom as in GL.
+    float target_height;
+};
+
+// Scene for Vulkan: what load_scene uploads for GL, plus the layout every
+// pipeline drawing it shares.
+struct VulkanScene {
+    VulkanBuffer mesh;
+    VulkanBuffer flame;
+    uint32_t meshVertices = 0;
+    uint32_t flameVertices = 0;
+    VulkanImage meshTexture;
+    VulkanImage flameTexture;
+    VulkanImage ditherMap;
+    VkSampler textureSampler = VK_NULL_HANDLE;
+    VkSampler ditherSampler = VK_NULL_HANDLE;
+
+    VkShaderModule vertexShader = VK_NULL_HANDLE;
+    VkShaderModule fragmentShader = VK_NULL_HANDLE;
+    VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+};
+
+// Uploads through one staging buffer and a single submission. Device
+// memory comes from pool, which has to outlive the scene.
+VulkanScene load_vulkan_scene(const VulkanDevice &device, MemoryPool &pool, JobSystem &jobs,
+                              const AssetCache *cache = nullptr);
+void destroy_vulkan_scene(const VulkanDevice &device, VulkanScene &scene);
+
+// D32 where the device has it, X8_D24 otherwise.
+VkFormat scene_depth_format(const VulkanDevice &device);
+
+// Colour and depth at samples, resolved into a single-sampled attachment
+// when samples > 1. The image that ends up with the picture is left in
+// final_layout.
+VkRenderPass create_scene_render_pass(const VulkanDevice &device, VkFormat color, VkSampleCountFlagBits samples,
+                                      VkImageLayout final_layout);
+
+// Viewport and scissor are dynamic, so a pipeline outlives resizes.
+VkPipeline create_scene_pipeline(const VulkanDevice &device, const VulkanScene &scene, VkRenderPass render_pass,
+                                 VkSampleCountFlagBits samples);
+
+// Uniforms and descriptor sets for slots frames in flight. The uniforms sit
+// in persistently mapped memory, so a recorded command buffer picks up
+// whatever was last written to its slot.
+struct SceneBindings {
+    VulkanBuffer uniforms;
+    VkDeviceSize stride = 0;
+    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+    // Two per slot: the mesh's and the flame's.
+    std::vector<VkDescriptorSet> sets;
+};
+
+SceneBindings create_scene_bindings(const VulkanDevice &device, MemoryPool &pool, const VulkanScene &scene,
+                                    int slots);
+void destroy_scene_bindings(const VulkanDevice &device, SceneBindings &bindings);
+
+void write_scene_uniforms(const SceneBindings &bindings, int slot, const VulkanScene &scene,
+                          const SceneParams &params, int height);
+
+// Clears and draws the scene with slot's uniforms as one render pass. The
+// viewport is flipped so the picture comes out the way up GL draws it.
+void record_scene(VkCommandBuffer cmd, const VulkanScene &scene, const SceneBindings &bindings, int slot,
+                  VkPipeline pipeline, VkRenderPass render_pass, VkFramebuffer framebuffer, VkExtent2D extent);
+
+// The same pass with the flame drawn draws times, each draw binding its own
+// state as a scene of many objects would. For --bench submit.
+void record_flame_draws(VkCommandBuffer cmd, const VulkanScene &scene, const SceneBindings &bindings, int slot,
+                        VkPipeline pipeline, VkRenderPass render_pass, VkFramebuffer framebuffer, VkExtent2D extent,
+                        int draws);
@@ -0,0 +1,628 @@
+#include "backend.hpp"
+
+#include <stdexcept>
+
+using namespace std;
+
+#ifdef SANDY_VULKAN
+
+#include "options.hpp"
+#include "vk_scene.hpp"
+
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+namespace {
+const int frames_in_flight = 2;
+
+VkSampleCountFlagBits scene_samples(const VulkanDevice &device, const Options &options) {
+    if (options.aa != AntiAliasing::msaa) {
+        return VK_SAMPLE_COUNT_1_BIT;
+    }
+    VkSampleCountFlagBits rv = supported_samples(device, options.msaa_samples);
+    if (int(rv) < options.msaa_samples) {
+        clog << "Warning: " << options.msaa_samples << "x MSAA is not supported, using " << int(rv) << "x" << endl;
+    }
+    return rv;
+}
+
+VkFramebuffer create_framebuffer(const VulkanDevice &device, VkRenderPass render_pass, VkExtent2D extent,
+                                 const vector<VkImageView> &attachments) {
+    VkFramebufferCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    info.renderPass = render_pass;
+    info.attachmentCount = uint32_t(attachments.size());
+    info.pAttachments = attachments.data();
+    info.width = extent.width;
+    info.height = extent.height;
+    info.layers = 1;
+    VkFramebuffer rv;
+    vk_check(vkCreateFramebuffer(device.device, &info, nullptr, &rv), "vkCreateFramebuffer");
+    return rv;
+}
+
+// Depth, plus the multisampled colour target when there is one, for a
+// framebuffer of extent. The image that ends up with the picture is the
+// caller's.
+struct SceneTargets {
+    VulkanImage color;
+    VulkanImage depth;
+};
+
+SceneTargets create_scene_targets(const VulkanDevice &device, MemoryPool &pool, VkFormat format, VkExtent2D extent,
+                                  VkSampleCountFlagBits samples) {
+    SceneTargets rv;
+    VkExtent3D size = {extent.width, extent.height, 1};
+    rv.depth = create_vulkan_image(device, pool, VK_IMAGE_TYPE_2D, scene_depth_format(device), size,
+                                   VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, samples);
+    if (samples != VK_SAMPLE_COUNT_1_BIT) {
+        rv.color = create_vulkan_image(device, pool, VK_IMAGE_TYPE_2D, format, size,
+                                       VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                                       VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT, samples);
+    }
+    return rv;
+}
+
+void destroy_scene_targets(const VulkanDevice &device, SceneTargets &targets) {
+    if (targets.color.handle != VK_NULL_HANDLE) {
+        destroy_vulkan_image(device, targets.color);
+    }
+    if (targets.depth.handle != VK_NULL_HANDLE) {
+        destroy_vulkan_image(device, targets.depth);
+    }
+}
+
+// In create_scene_render_pass order.
+vector<VkImageView> framebuffer_attachments(const SceneTargets &targets, VkImageView picture) {
+    if (targets.color.handle != VK_NULL_HANDLE) {
+        return {targets.color.view, targets.depth.view, picture};
+    }
+    return {picture, targets.depth.view};
+}
+
+// Draws into a swapchain. Each swapchain image gets a command buffer
+// recorded once, when the swapchain is built, and a uniform slot; a frame
+// only writes the uniforms and submits.
+class VulkanBackend : public RenderBackend {
+public:
+    VulkanBackend(GLFWwindow *window, const Options &options, JobSystem &jobs, const AssetCache *cache)
+            : swapInterval(options.swap_interval) {
+        uint32_t count = 0;
+        const char **extensions = glfwGetRequiredInstanceExtensions(&count);
+        if (!extensions) {
+            throw runtime_error("GLFW can't present with Vulkan here");
+        }
+        instance = create_vulkan_instance(vector<const char *>(extensions, extensions + count));
+        vk_check(glfwCreateWindowSurface(instance, window, nullptr, &surface), "glfwCreateWindowSurface");
+        device = create_vulkan_device(instance, surface, options.pipeline_cache);
+        scenePool = make_unique<MemoryPool>(device);
+        swapchainPool = make_unique<MemoryPool>(device);
+
+        scene = load_vulkan_scene(device, *scenePool, jobs, cache);
+        samples = scene_samples(device, options);
+        surfaceFormat = choose_surface_format();
+        renderPass = create_scene_render_pass(device, surfaceFormat.format, samples,
+                                              VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+        pipeline = create_scene_pipeline(device, scene, renderPass, samples);
+
+        VkSemaphoreCreateInfo semaphoreInfo = {};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        VkFenceCreateInfo fenceInfo = {};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+        for (auto &frame : frames) {
+            vk_check(vkCreateSemaphore(device.device, &semaphoreInfo, nullptr, &frame.imageAvailable),
+                     "vkCreateSemaphore");
+            vk_check(vkCreateFence(device.device, &fenceInfo, nullptr, &frame.fence), "vkCreateFence");
+        }
+    }
+
+    ~VulkanBackend() override {
+        vkDeviceWaitIdle(device.device);
+        destroy_swapchain();
+        for (auto &frame : frames) {
+            vkDestroySemaphore(device.device, frame.imageAvailable, nullptr);
+            vkDestroyFence(device.device, frame.fence, nullptr);
+        }
+        vkDestroyPipeline(device.device, pipeline, nullptr);
+        vkDestroyRenderPass(device.device, renderPass, nullptr);
+        destroy_vulkan_scene(device, scene);
+        swapchainPool.reset();
+        scenePool.reset();
+        destroy_vulkan_device(device);
+        vkDestroySurfaceKHR(instance, surface, nullptr);
+        vkDestroyInstance(instance, nullptr);
+    }
+
+    void draw_frame(const SceneParams &params, int fbWidth, int fbHeight, long long, double) override {
+        acquired = false;
+        // Minimized; there is nothing to draw into.
+        if (fbWidth == 0 || fbHeight == 0) {
+            return;
+        }
+        if (swapchain == VK_NULL_HANDLE || stale || fbWidth != requestedWidth || fbHeight != requestedHeight) {
+            requestedWidth = fbWidth;
+            requestedHeight = fbHeight;
+            create_swapchain();
+        }
+        if (swapchain == VK_NULL_HANDLE) {
+            return;
+        }
+
+        Frame &frame = frames[currentFrame];
+        vk_check(vkWaitForFences(device.device, 1, &frame.fence, VK_TRUE, UINT64_MAX), "vkWaitForFences");
+        VkResult result = vkAcquireNextImageKHR(device.device, swapchain, UINT64_MAX, frame.imageAvailable,
+                                                VK_NULL_HANDLE, &imageIndex);
+        if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+            stale = true;
+            return;
+        }
+        if (result != VK_SUBOPTIMAL_KHR) {
+            vk_check(result, "vkAcquireNextImageKHR");
+        }
+        // The image's uniforms may still be read by its previous frame.
+        if (images[imageIndex].fence != VK_NULL_HANDLE) {
+            vk_check(vkWaitForFences(device.device, 1, &images[imageIndex].fence, VK_TRUE, UINT64_MAX),
+                     "vkWaitForFences");
+        }
+        images[imageIndex].fence = frame.fence;
+
+        timer.start();
+        write_scene_uniforms(bindings, int(imageIndex), scene, params, int(extent.height));
+
+        VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        VkSubmitInfo submit = {};
+        submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit.waitSemaphoreCount = 1;
+        submit.pWaitSemaphores = &frame.imageAvailable;
+        submit.pWaitDstStageMask = &waitStage;
+        submit.commandBufferCount = 1;
+        submit.pCommandBuffers = &images[imageIndex].commands;
+        submit.signalSemaphoreCount = 1;
+        submit.pSignalSemaphores = &images[imageIndex].renderFinished;
+        vk_check(vkResetFences(device.device, 1, &frame.fence), "vkResetFences");
+        vk_check(vkQueueSubmit(device.queue, 1, &submit, frame.fence), "vkQueueSubmit");
+        timer.stop();
+        acquired = true;
+    }
+
+    void present() override {
+        if (!acquired) {
+            return;
+        }
+        VkPresentInfoKHR info = {};
+        info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+        info.waitSemaphoreCount = 1;
+        info.pWaitSemaphores = &images[imageIndex].renderFinished;
+        info.swapchainCount = 1;
+        info.pSwapchains = &swapchain;
+        info.pImageIndices = &imageIndex;
+        VkResult result = vkQueuePresentKHR(device.queue, &info);
+        if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
+            stale = true;
+        } else {
+            vk_check(result, "vkQueuePresentKHR");
+        }
+        currentFrame = (currentFrame + 1) % frames_in_flight;
+    }
+
+    // The present mode is part of the swapchain, so this rebuilds it.
+    void set_swap_interval(int interval) override {
+        swapInterval = interval;
+        stale = true;
+    }
+
+    void reload_assets() override {
+        clog << "Warning: The Vulkan renderer does not stream assets" << endl;
+    }
+
+    bool update_assets() override {
+        return false;
+    }
+
+    void report_stats(ostream &out) override {
+        timer.report(out, "Vulkan");
+    }
+
+private:
+    struct Frame {
+        VkSemaphore imageAvailable = VK_NULL_HANDLE;
+        VkFence fence = VK_NULL_HANDLE;
+    };
+
+    struct SwapchainImage {
+        VkImageView view = VK_NULL_HANDLE;
+        VkFramebuffer framebuffer = VK_NULL_HANDLE;
+        VkCommandBuffer commands = VK_NULL_HANDLE;
+        VkSemaphore renderFinished = VK_NULL_HANDLE;
+        // Of the frame that last drew into the image.
+        VkFence fence = VK_NULL_HANDLE;
+    };
+
+    VkSurfaceFormatKHR choose_surface_format() {
+        uint32_t count = 0;
+        vkGetPhysicalDeviceSurfaceFormatsKHR(device.physical, surface, &count, nullptr);
+        vector<VkSurfaceFormatKHR> formats(count);
+        vkGetPhysicalDeviceSurfaceFormatsKHR(device.physical, surface, &count, formats.data());
+        if (formats.empty()) {
+            throw runtime_error("The window surface has no formats");
+        }
+        // GL's default framebuffer isn't sRGB either.
+        for (auto &format : formats) {
+            if ((format.format == VK_FORMAT_B8G8R8A8_UNORM || format.format == VK_FORMAT_R8G8B8A8_UNORM) &&
+                format.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
+                return format;
+            }
+        }
+        return formats[0];
+    }
+
+    VkPresentModeKHR choose_present_mode() {
+        if (swapInterval != 0) {
+            return VK_PRESENT_MODE_FIFO_KHR;
+        }
+        uint32_t count = 0;
+        vkGetPhysicalDeviceSurfacePresentModesKHR(device.physical, surface, &count, nullptr);
+        vector<VkPresentModeKHR> modes(count);
+        vkGetPhysicalDeviceSurfacePresentModesKHR(device.physical, surface, &count, modes.data());
+        for (VkPresentModeKHR wanted : {VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR}) {
+            if (find(modes.begin(), modes.end(), wanted) != modes.end()) {
+                return wanted;
+            }
+        }
+        return VK_PRESENT_MODE_FIFO_KHR;
+    }
+
+    void create_swapchain() {
+        vkDeviceWaitIdle(device.device);
+        destroy_swapchain();
+        stale = false;
+
+        VkSurfaceCapabilitiesKHR caps;
+        vk_check(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device.physical, surface, &caps),
+                 "vkGetPhysicalDeviceSurfaceCapabilitiesKHR");
+        extent = caps.currentExtent;
+        if (extent.width == UINT32_MAX) {
+            extent.width = min(max(uint32_t(requestedWidth), caps.minImageExtent.width), caps.maxImageExtent.width);
+            extent.height =
+                    min(max(uint32_t(requestedHeight), caps.minImageExtent.height), caps.maxImageExtent.height);
+        }
+        if (extent.width == 0 || extent.height == 0) {
+            stale = true;
+            return;
+        }
+        uint32_t imageCount = caps.minImageCount + 1;
+        if (caps.maxImageCount > 0) {
+            imageCount = min(imageCount, caps.maxImageCount);
+        }
+        VkCompositeAlphaFlagBitsKHR alpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+        if (!(caps.supportedCompositeAlpha & alpha)) {
+            alpha = VK_COMPOSITE_ALPHA_INHERIT_BIT_KHR;
+        }
+
+        VkSwapchainCreateInfoKHR info = {};
+        info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+        info.surface = surface;
+        info.minImageCount = imageCount;
+        info.imageFormat = surfaceFormat.format;
+        info.imageColorSpace = surfaceFormat.colorSpace;
+        info.imageExtent = extent;
+        info.imageArrayLayers = 1;
+        info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+        info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        info.preTransform = caps.currentTransform;
+        info.compositeAlpha = alpha;
+        info.presentMode = choose_present_mode();
+        info.clipped = VK_TRUE;
+        vk_check(vkCreateSwapchainKHR(device.device, &info, nullptr, &swapchain), "vkCreateSwapchainKHR");
+
+        vkGetSwapchainImagesKHR(device.device, swapchain, &imageCount, nullptr);
+        vector<VkImage> handles(imageCount);
+        vkGetSwapchainImagesKHR(device.device, swapchain, &imageCount, handles.data());
+
+        targets = create_scene_targets(device, *swapchainPool, surfaceFormat.format, extent, samples);
+        bindings = create_scene_bindings(device, *swapchainPool, scene, int(imageCount));
+
+        vector<VkCommandBuffer> commands(imageCount);
+        VkCommandBufferAllocateInfo alloc = {};
+        alloc.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        alloc.commandPool = device.command_pool;
+        alloc.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        alloc.commandBufferCount = imageCount;
+        vk_check(vkAllocateCommandBuffers(device.device, &alloc, commands.data()), "vkAllocateCommandBuffers");
+
+        VkSemaphoreCreateInfo semaphoreInfo = {};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        images.resize(imageCount);
+        for (uint32_t i = 0; i < imageCount; ++i) {
+            SwapchainImage &image = images[i];
+            image.commands = commands[i];
+
+            VkImageViewCreateInfo view = {};
+            view.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            view.image = handles[i];
+            view.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            view.format = surfaceFormat.format;
+            view.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            view.subresourceRange.levelCount = 1;
+            view.subresourceRange.layerCount = 1;
+            vk_check(vkCreateImageView(device.device, &view, nullptr, &image.view), "vkCreateImageView");
+            image.framebuffer =
+                    create_framebuffer(device, renderPass, extent, framebuffer_attachments(targets, image.view));
+            vk_check(vkCreateSemaphore(device.device, &semaphoreInfo, nullptr, &image.renderFinished),
+                     "vkCreateSemaphore");
+
+            VkCommandBufferBeginInfo begin = {};
+            begin.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            vk_check(vkBeginCommandBuffer(image.commands, &begin), "vkBeginCommandBuffer");
+            record_scene(image.commands, scene, bindings, int(i), pipeline, renderPass, image.framebuffer, extent);
+            vk_check(vkEndCommandBuffer(image.commands), "vkEndCommandBuffer");
+        }
+    }
+
+    // Only once the device is idle.
+    void destroy_swapchain() {
+        if (swapchain == VK_NULL_HANDLE) {
+            return;
+        }
+        for (auto &image : images) {
+            vkFreeCommandBuffers(device.device, device.command_pool, 1, &image.commands);
+            vkDestroyFramebuffer(device.device, image.framebuffer, nullptr);
+            vkDestroyImageView(device.device, image.view, nullptr);
+            vkDestroySemaphore(device.device, image.renderFinished, nullptr);
+        }
+        images.clear();
+        destroy_scene_bindings(device, bindings);
+        destroy_scene_targets(device, targets);
+        swapchainPool->reset();
+        vkDestroySwapchainKHR(device.device, swapchain, nullptr);
+        swapchain = VK_NULL_HANDLE;
+    }
+
+    int swapInterval;
+    VkInstance instance = VK_NULL_HANDLE;
+    VkSurfaceKHR surface = VK_NULL_HANDLE;
+    VulkanDevice device;
+    // Scene assets live as long as the backend; everything sized to the
+    // window goes when the swapchain does.
+    unique_ptr<MemoryPool> scenePool;
+    unique_ptr<MemoryPool> swapchainPool;
+
+    VulkanScene scene;
+    VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+    VkSurfaceFormatKHR surfaceFormat;
+    VkRenderPass renderPass = VK_NULL_HANDLE;
+    VkPipeline pipeline = VK_NULL_HANDLE;
+
+    VkSwapchainKHR swapchain = VK_NULL_HANDLE;
+    VkExtent2D extent = {0, 0};
+    int requestedWidth = 0;
+    int requestedHeight = 0;
+    bool stale = false;
+    SceneTargets targets;
+    SceneBindings bindings;
+    vector<SwapchainImage> images;
+
+    Frame frames[frames_in_flight];
+    int currentFrame = 0;
+    uint32_t imageIndex = 0;
+    bool acquired = false;
+    SubmitTimer timer;
+};
+
+// Renders into an image and copies it to host memory. The command buffer
+// is recorded again only when the size changes.
+class VulkanOffscreen : public OffscreenBackend {
+public:
+    VulkanOffscreen(const Options &options, JobSystem &jobs, const AssetCache *cache) {
+        instance = create_vulkan_instance({});
+        device = create_vulkan_device(instance, VK_NULL_HANDLE, options.pipeline_cache);
+        scenePool = make_unique<MemoryPool>(device);
+        targetPool = make_unique<MemoryPool>(device);
+
+        scene = load_vulkan_scene(device, *scenePool, jobs, cache);
+        bindings = create_scene_bindings(device, *scenePool, scene, 1);
+        samples = scene_samples(device, options);
+        renderPass = create_scene_render_pass(device, VK_FORMAT_R8G8B8A8_UNORM, samples,
+                                              VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+        pipeline = create_scene_pipeline(device, scene, renderPass, samples);
+
+        VkCommandBufferAllocateInfo alloc = {};
+        alloc.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        alloc.commandPool = device.command_pool;
+        alloc.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        alloc.commandBufferCount = 1;
+        vk_check(vkAllocateCommandBuffers(device.device, &alloc, &commands), "vkAllocateCommandBuffers");
+        VkFenceCreateInfo fenceInfo = {};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        vk_check(vkCreateFence(device.device, &fenceInfo, nullptr, &fence), "vkCreateFence");
+    }
+
+    ~VulkanOffscreen() override {
+        vkDeviceWaitIdle(device.device);
+        destroy_targets();
+        vkDestroyFence(device.device, fence, nullptr);
+        vkFreeCommandBuffers(device.device, device.command_pool, 1, &commands);
+        vkDestroyPipeline(device.device, pipeline, nullptr);
+        vkDestroyRenderPass(device.device, renderPass, nullptr);
+        destroy_scene_bindings(device, bindings);
+        destroy_vulkan_scene(device, scene);
+        targetPool.reset();
+        scenePool.reset();
+        destroy_vulkan_device(device);
+        vkDestroyInstance(instance, nullptr);
+    }
+
+    void render(const SceneParams &params, int width, int height, vector<unsigned char> &pixels) override {
+        if (uint32_t(width) != extent.width || uint32_t(height) != extent.height) {
+            resize(width, height);
+        }
+        write_scene_uniforms(bindings, 0, scene, params, height);
+
+        VkSubmitInfo submit = {};
+        submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit.commandBufferCount = 1;
+        submit.pCommandBuffers = &commands;
+        vk_check(vkQueueSubmit(device.queue, 1, &submit, fence), "vkQueueSubmit");
+        vk_check(vkWaitForFences(device.device, 1, &fence, VK_TRUE, UINT64_MAX), "vkWaitForFences");
+        vk_check(vkResetFences(device.device, 1, &fence), "vkResetFences");
+
+        // The image is top row first; the wire format is bottom row first.
+        size_t row = size_t(width) * 4;
+        pixels.resize(row * height);
+        auto source = static_cast<const unsigned char *>(readback.memory.mapped);
+        for (int y = 0; y < height; ++y) {
+            memcpy(pixels.data() + row * y, source + row * (height - 1 - y), row);
+        }
+    }
+
+    // See measure_vulkan_submit. Leaves the command buffer to be recorded
+    // again by the next render.
+    double submit_ms(int draws, int frames, bool rerecord) {
+        resize(64, 64);
+        write_scene_uniforms(bindings, 0, scene, default_scene_params(), int(extent.height));
+        auto record = [&] {
+            VkCommandBufferBeginInfo begin = {};
+            begin.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            vk_check(vkBeginCommandBuffer(commands, &begin), "vkBeginCommandBuffer");
+            record_flame_draws(commands, scene, bindings, 0, pipeline, renderPass, framebuffer, extent, draws);
+            vk_check(vkEndCommandBuffer(commands), "vkEndCommandBuffer");
+        };
+        record();
+
+        VkSubmitInfo submit = {};
+        submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit.commandBufferCount = 1;
+        submit.pCommandBuffers = &commands;
+        double total = 0;
+        for (int i = 0; i < frames; ++i) {
+            auto start = chrono::steady_clock::now();
+            if (rerecord) {
+                record();
+            }
+            vk_check(vkQueueSubmit(device.queue, 1, &submit, fence), "vkQueueSubmit");
+            total += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            vk_check(vkWaitForFences(device.device, 1, &fence, VK_TRUE, UINT64_MAX), "vkWaitForFences");
+            vk_check(vkResetFences(device.device, 1, &fence), "vkResetFences");
+        }
+        // Records the readback again.
+        destroy_targets();
+        return total / frames;
+    }
+
+private:
+    void resize(int width, int height) {
+        destroy_targets();
+        extent = {uint32_t(width), uint32_t(height)};
+
+        VkFormat format = VK_FORMAT_R8G8B8A8_UNORM;
+        targets = create_scene_targets(device, *targetPool, format, extent, samples);
+        picture = create_vulkan_image(device, *targetPool, VK_IMAGE_TYPE_2D, format, {extent.width, extent.height, 1},
+                                      VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+        framebuffer = create_framebuffer(device, renderPass, extent, framebuffer_attachments(targets, picture.view));
+
+        // Cached memory reads back much faster where the device has it.
+        VkDeviceSize size = VkDeviceSize(width) * height * 4;
+        VkMemoryPropertyFlags coherent = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        try {
+            readback = create_vulkan_buffer(device, *targetPool, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                            coherent | VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+        } catch (const runtime_error &) {
+            readback = create_vulkan_buffer(device, *targetPool, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, coherent);
+        }
+
+        VkCommandBufferBeginInfo begin = {};
+        begin.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        vk_check(vkBeginCommandBuffer(commands, &begin), "vkBeginCommandBuffer");
+        record_scene(commands, scene, bindings, 0, pipeline, renderPass, framebuffer, extent);
+
+        VkBufferImageCopy region = {};
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.layerCount = 1;
+        region.imageExtent = {extent.width, extent.height, 1};
+        vkCmdCopyImageToBuffer(commands, picture.handle, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readback.handle, 1,
+                               &region);
+
+        VkBufferMemoryBarrier barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.buffer = readback.handle;
+        barrier.size = VK_WHOLE_SIZE;
+        vkCmdPipelineBarrier(commands, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1,
+                             &barrier, 0, nullptr);
+        vk_check(vkEndCommandBuffer(commands), "vkEndCommandBuffer");
+    }
+
+    void destroy_targets() {
+        if (framebuffer == VK_NULL_HANDLE) {
+            return;
+        }
+        vkDestroyFramebuffer(device.device, framebuffer, nullptr);
+        framebuffer = VK_NULL_HANDLE;
+        destroy_vulkan_image(device, picture);
+        destroy_vulkan_buffer(device, readback);
+        destroy_scene_targets(device, targets);
+        targetPool->reset();
+        extent = {0, 0};
+    }
+
+    VkInstance instance = VK_NULL_HANDLE;
+    VulkanDevice device;
+    unique_ptr<MemoryPool> scenePool;
+    unique_ptr<MemoryPool> targetPool;
+
+    VulkanScene scene;
+    SceneBindings bindings;
+    VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+    VkRenderPass renderPass = VK_NULL_HANDLE;
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    VkCommandBuffer commands = VK_NULL_HANDLE;
+    VkFence fence = VK_NULL_HANDLE;
+
+    VkExtent2D extent = {0, 0};
+    SceneTargets targets;
+    VulkanImage picture;
+    VkFramebuffer framebuffer = VK_NULL_HANDLE;
+    VulkanBuffer readback;
+};
+}
+
+unique_ptr<RenderBackend> create_vulkan_backend(GLFWwindow *window, const Options &options, JobSystem &jobs,
+                                                const AssetCache *cache) {
+    return make_unique<VulkanBackend>(window, options, jobs, cache);
+}
+
+unique_ptr<OffscreenBackend> create_vulkan_offscreen(const Options &options, JobSystem &jobs,
+                                                     const AssetCache *cache) {
+    return make_unique<VulkanOffscreen>(options, jobs, cache);
+}
+
+double measure_vulkan_submit(JobSystem &jobs, int draws, int frames, bool rerecord) {
+    Options options;
+    options.aa = AntiAliasing::none;
+    VulkanOffscreen renderer(options, jobs, nullptr);
+    return renderer.submit_ms(draws, frames, rerecord);
+}
+
+#else
+
+unique_ptr<RenderBackend> create_vulkan_backend(GLFWwindow *, const Options &, JobSystem &, const AssetCache *) {
+    throw runtime_error("This build has no Vulkan support");
+}
+
+unique_ptr<OffscreenBackend> create_vulkan_offscreen(const Options &, JobSystem &, const AssetCache *) {
+    throw runtime_error("This build has no Vulkan support");
+}
+
+double measure_vulkan_submit(JobSystem &, int, int, bool) {
+    throw runtime_error("This build has no Vulkan support");
+}
+
+#endif